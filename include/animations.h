@@ -3,206 +3,397 @@
 
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
-#include "images.h"
-#include <String.h>
-#include <functional>
+#include "display_flush.h"
+#include "sprites.h"
+#include "scroll_strip.h"
+#include "deferred_log.h"
 #include <algorithm> // Added for std::max
 
-#define SCREEN_WIDTH 128  // OLED display width
-#define SCREEN_HEIGHT 32  // OLED display height
+// One sprite at a fixed position within a frame
+struct SpritePlacement {
+    const PageSprite* sprite;
+    int16_t x;
+    int16_t y;
+};
+
+// One frame of an animation: the sprites to draw and how long the frame stays up
+struct AnimationFrame {
+    const SpritePlacement* layers;
+    uint8_t layerCount;
+    uint16_t durationMs;
+};
+
+// A complete animation timeline: frames played in order, `loops` times.
+// With a clip, frame i shows clip frame i at (clipX, clipY). Clip frames have
+// no layers, since the deltas expect the framebuffer to hold only the clip.
+struct AnimationDesc {
+    const char* name;  // For the animation stats
+    const AnimationFrame* frames;
+    uint8_t frameCount;
+    uint16_t loops;
+    const SpriteClip* clip;
+    int16_t clipX;
+    int16_t clipY;
+};
+
+#define CLIP_NONE 0xFF  // No clip frame in the framebuffer
+
+// Helpers so layer and frame counts are taken from the array sizes
+template <size_t N>
+constexpr AnimationFrame animationFrame(const SpritePlacement (&layers)[N], uint16_t durationMs) {
+    return {layers, (uint8_t)N, durationMs};
+}
+
+// Frame of a clip animation with nothing drawn on top of the clip
+constexpr AnimationFrame animationFrame(uint16_t durationMs) {
+    return {nullptr, 0, durationMs};
+}
 
-// Function pointer type for drawing functions
-typedef void (*DrawFunction)(Adafruit_SSD1306& display, String state);
+template <size_t N>
+constexpr AnimationDesc animation(const char* name, const AnimationFrame (&frames)[N], uint16_t loops) {
+    return {name, frames, (uint8_t)N, loops, nullptr, 0, 0};
+}
+
+template <size_t N>
+constexpr AnimationDesc clipAnimation(const char* name, const SpriteClip& clip, int16_t x, int16_t y,
+                                       const AnimationFrame (&frames)[N], uint16_t loops) {
+    return {name, frames, (uint8_t)N, loops, &clip, x, y};
+}
 
 // Animation state structure
 struct AnimationState {
     bool isAnimating;
-    int currentIteration;
-    int totalIterations;
-    bool isFirstState;
-    unsigned long lastFrameTime;
-    int delayMs;
-    String state1;
-    String state2;
-    DrawFunction drawFunc;
+    const AnimationDesc* anim;  // nullptr while scrolling text
+    uint8_t frameIndex;         // Next frame to draw
+    uint8_t clipFrame;          // Clip frame in the framebuffer, or CLIP_NONE
+    uint16_t currentLoop;
+    uint32_t lastFrameTime;
+    uint32_t delayMs;           // Time from lastFrameTime until the next frame is due
     // Text scrolling fields
-    String scrollText;
+    const char* scrollText;     // Points into flash, never copied
+    int scrollLength;
     int textX;
     int textWidth;
-    // Animation chaining
-    std::function<void()> nextAnimation;
+    int scrollPos;  // Start of the next chunk in hardware scroll mode
+    int stripFirst; // First character in the strip, for messages longer than it
+    // Animation chaining: started when the current timeline finishes
+    const AnimationDesc* nextAnimation;
+    ScrollStrip strip;  // The message being scrolled, rendered
+};
+
+// What each animation has cost since boot (or the last reset), for the 'a'
+// serial query and tools/bench.py. Scrolling text counts as one animation.
+struct AnimationStats {
+    const AnimationDesc* anim;  // nullptr for scrolling text
+    uint32_t frames;            // Updates that flushed the framebuffer
+    uint32_t bytes;             // Bytes sent to the panel
+    uint32_t byteOps;           // Framebuffer bytes written
+    uint32_t awakeUs;           // Time spent in updateAnimation()
+};
+
+#define ANIMATION_STATS_MAX 8
+
+static AnimationStats animationStats[ANIMATION_STATS_MAX] = {};
+static uint8_t animationStatsCount = 0;
+
+inline AnimationStats* animationStatsFor(const AnimationDesc* anim) {
+    for (uint8_t i = 0; i < animationStatsCount; i++) {
+        if (animationStats[i].anim == anim) return &animationStats[i];
+    }
+    if (animationStatsCount == ANIMATION_STATS_MAX) return nullptr;
+    AnimationStats& stats = animationStats[animationStatsCount++];
+    stats = {};
+    stats.anim = anim;
+    return &stats;
+}
+
+inline void resetAnimationStats() {
+    animationStatsCount = 0;
+}
+
+// One line per animation: name frames bytes byte-ops awake-us
+inline void printAnimationReport(Print& out) {
+    out.println("animation frames bytes byteops awake_us");
+    for (uint8_t i = 0; i < animationStatsCount; i++) {
+        const AnimationStats& s = animationStats[i];
+        out.printf("%s %lu %lu %lu %lu\n", s.anim ? s.anim->name : "scroll", (unsigned long)s.frames,
+                   (unsigned long)s.bytes, (unsigned long)s.byteOps, (unsigned long)s.awakeUs);
+    }
+}
+
+// ---- Animation timelines ----------------------------------------------------
+
+// Idle: lady and gentleman with a beating heart
+static constexpr SpritePlacement ladyAndGentlemanSmallHeart[] = {
+    {&sprite_lady, 96, 8},
+    {&sprite_gentleman, 114, 8},
+    {&sprite_small_heart, 104, 4},
+};
+static constexpr SpritePlacement ladyAndGentlemanBigHeart[] = {
+    {&sprite_lady, 96, 8},
+    {&sprite_gentleman, 114, 8},
+    {&sprite_big_heart, 102, 4},
+};
+static constexpr AnimationFrame ladyAndGentlemanFrames[] = {
+    animationFrame(ladyAndGentlemanSmallHeart, 500),
+    animationFrame(ladyAndGentlemanBigHeart, 500),
 };
+static constexpr AnimationDesc ladyAndGentleman = animation("idle", ladyAndGentlemanFrames, 100);
 
-static AnimationState animState = {false, 0, 0, true, 0, 0, "", "", nullptr, "", 0, 0, nullptr};
+// Dose due: replaces the idle animation, the big heart flashes until the dose is taken
+static constexpr SpritePlacement doseReminderHeart[] = {
+    {&sprite_lady, 96, 8},
+    {&sprite_gentleman, 114, 8},
+    {&sprite_big_heart, 102, 4},
+};
+static constexpr SpritePlacement doseReminderNoHeart[] = {
+    {&sprite_lady, 96, 8},
+    {&sprite_gentleman, 114, 8},
+};
+static constexpr AnimationFrame doseReminderFrames[] = {
+    animationFrame(doseReminderHeart, 250),
+    animationFrame(doseReminderNoHeart, 250),
+};
+static constexpr AnimationDesc doseReminder = animation("reminder", doseReminderFrames, 100);
+
+// Celebration after a dispense: the two poses are a delta-encoded clip
+static constexpr AnimationFrame dancingCoupleFrames[] = {
+    animationFrame(150),
+    animationFrame(150),
+};
+static_assert(sizeof(dancingCoupleFrames) / sizeof(dancingCoupleFrames[0]) == clip_dancing_couple.frameCount,
+              "one frame per clip frame");
+static constexpr AnimationDesc dancingCouple = clipAnimation("dance", clip_dancing_couple, 0, 0, dancingCoupleFrames, 20);
 
-// Animation function declarations
-void drawLadyAndGentleman(Adafruit_SSD1306& display, String heartsize);
-void drawDancingCouple(Adafruit_SSD1306& display, String frame);
-void drawScrollText(Adafruit_SSD1306& display, String text);
+// ---- Playback -----------------------------------------------------------------
+
+// Scrolling text animation function: copies the visible window of the
+// pre-rendered strip, rendering the strip further along first when the
+// window has run past what it holds
+inline void drawScrollText(RetainedSSD1306& display, AnimationState& state) {
+    int firstVisible = state.textX < 0 ? -state.textX / SCROLL_CHAR_WIDTH : 0;
+    int endVisible = min(state.scrollLength, (SCREEN_WIDTH - 1 - state.textX) / SCROLL_CHAR_WIDTH + 1);
+    if (firstVisible < state.stripFirst || endVisible > state.stripFirst + SCROLL_STRIP_MAX_CHARS) {
+        state.stripFirst = firstVisible;
+        renderScrollStrip(state.strip, state.scrollText + firstVisible, state.scrollLength - firstVisible);
+    }
+    drawSprite(display, state.strip.sprite, state.textX + state.stripFirst * SCROLL_CHAR_WIDTH, SCROLL_TEXT_Y);
+}
+
+// Draw every layer of a frame
+inline void drawAnimationFrame(RetainedSSD1306& display, const AnimationFrame& frame) {
+    for (uint8_t i = 0; i < frame.layerCount; i++) {
+        const SpritePlacement& layer = frame.layers[i];
+        drawSprite(display, *layer.sprite, layer.x, layer.y);
+    }
+}
 
 // Function to show scrolling text (simplified)
-inline void showScrollingText(Adafruit_SSD1306& display, String message, int scrollSpeed) {
+inline void showScrollingText(AnimationState& state, const ScrollMessage& message, int scrollSpeed) {
     // Set up the animation state for custom scrolling
-    animState.isAnimating = true;
-    animState.currentIteration = 0;
-    animState.totalIterations = 1; // Just one iteration
-    animState.lastFrameTime = millis();
-    animState.delayMs = scrollSpeed; // Smaller values = faster scrolling
-    animState.drawFunc = drawScrollText;
-    animState.scrollText = message;
-    
-    // Calculate text width more accurately
-    display.setTextSize(2);
-    int16_t x1, y1;
-    uint16_t w, h;
-    display.getTextBounds(message, 0, 0, &x1, &y1, &w, &h);
-    
-    // Make sure we get the correct width
-    Serial.print("Text width: ");
-    Serial.println(w);
-    
-    // Get a more accurate text width by calculating character by character
-    // Each character in size 2 is approximately 12 pixels wide
-    int calculatedWidth = message.length() * 12;
-    Serial.print("Calculated width: ");
-    Serial.println(calculatedWidth);
-    
-    // Use the larger of the two width calculations plus extra buffer
-    int textWidth = (int)w;  // Convert uint16_t to int
-    if (calculatedWidth > textWidth) {
-        textWidth = calculatedWidth;
-    }
-    animState.textWidth = textWidth + 20;
-    
-    // Start text from right edge of screen
-    animState.textX = SCREEN_WIDTH;
-    
+    state.isAnimating = true;
+    state.anim = nullptr;
+    state.lastFrameTime = millis();
+    state.delayMs = scrollSpeed; // Smaller values = faster scrolling
+    state.scrollText = message.text;
+    state.scrollLength = message.length;
+
+    state.textX = SCREEN_WIDTH;  // Start text from right edge of screen
+    state.scrollPos = 0;
+    state.stripFirst = 0;
+
+#if SCROLL_HARDWARE
+    // Chunks are rendered as the controller finishes each revolution
+    state.textWidth = 0;
+    state.lastFrameTime = millis() - scrollSpeed;  // Show the first chunk right away
+#else
+    // Render the message once (or its first strip); every frame is then a copy out of the strip
+    renderScrollStrip(state.strip, message.text, message.length);
+    state.textWidth = message.width;
+    logEvent<LOG_TEXT_WIDTH>(state.textWidth);
+#endif
+
     // Clear any existing nextAnimation
-    animState.nextAnimation = nullptr;
+    state.nextAnimation = nullptr;
 }
 
-// Start a regular animation sequence
-inline void startAnimation(DrawFunction drawFunc, String state1, String state2, int iterations, int delayMs, Adafruit_SSD1306& display) {
-    animState.isAnimating = true;
-    animState.currentIteration = 0;
-    animState.totalIterations = iterations;
-    animState.isFirstState = true;
-    animState.lastFrameTime = millis();
-    animState.delayMs = delayMs;
-    animState.state1 = state1;
-    animState.state2 = state2;
-    animState.drawFunc = drawFunc;
+// Start playing an animation timeline; the first frame is drawn after its duration
+inline void startAnimation(AnimationState& state, const AnimationDesc& anim) {
+    state.nextAnimation = nullptr;
+    state.isAnimating = true;
+    state.anim = &anim;
+    state.frameIndex = 0;
+    state.clipFrame = CLIP_NONE;
+    state.currentLoop = 0;
+    state.lastFrameTime = millis();
+    state.delayMs = anim.frames[0].durationMs;
 }
 
-// Non-blocking animation update function
-inline void updateAnimation(Adafruit_SSD1306& display) {
-    if (!animState.isAnimating) return;
+// Play `next` once the current timeline animation has finished
+inline void chainAnimation(AnimationState& state, const AnimationDesc& next) {
+    state.nextAnimation = &next;
+}
+
+// Continue a timeline animation at the given frame; it is drawn on the next update
+inline void resumeAnimation(AnimationState& state, const AnimationDesc& anim, uint8_t frameIndex, uint16_t loop) {
+    startAnimation(state, anim);
+    state.frameIndex = frameIndex < anim.frameCount ? frameIndex : 0;
+    state.currentLoop = loop;
+    state.delayMs = 0;
+}
+
+// Hardware scroll mode: each call ends the previous revolution and starts the next chunk
+inline void updateHardwareScroll(RetainedSSD1306& display, AnimationState& state) {
+    if (state.textWidth > 0) {
+        stopHardwareScroll(display);
+    }
+
+    const char* text = state.scrollText;
+    int length = state.scrollLength;
+    while (state.scrollPos < length && text[state.scrollPos] == ' ') {
+        state.scrollPos++;
+    }
+    if (state.scrollPos >= length) {
+        state.isAnimating = false;
+        clearFrame(display);
+        flushDirty(display);
+        return;
+    }
+
+    int chunk = nextScrollChunk(text + state.scrollPos, length - state.scrollPos);
+    state.textWidth = renderScrollStrip(state.strip, text + state.scrollPos, chunk);
+    state.scrollPos += chunk;
+
+    // Center the chunk and let the controller rotate it once around the panel
+    clearFrame(display);
+    drawSprite(display, state.strip.sprite, (SCREEN_WIDTH - state.textWidth) / 2, SCROLL_TEXT_Y);
+    flushDirty(display);
+    startHardwareScroll(display);
+    state.delayMs = SCROLL_HW_REVOLUTION_MS;
+}
+
+// One step of updateAnimation()
+inline void stepAnimation(RetainedSSD1306& display, AnimationState& state) {
+    uint32_t currentTime = millis();
 
-    unsigned long currentTime = millis();
-    
     // Handle custom text scrolling
-    if (animState.drawFunc == drawScrollText) {
-        if (currentTime - animState.lastFrameTime >= animState.delayMs) {
+    if (!state.anim) {
+        if (currentTime - state.lastFrameTime >= state.delayMs) {
+#if SCROLL_HARDWARE
+            updateHardwareScroll(display, state);
+#else
             // Update text position
-            animState.textX -= 3; // Scrolling speed
-            
+            state.textX -= 3; // Scrolling speed
+
             // Check if text scroll is complete (text has completely left the screen)
-            if (animState.textX <= -(animState.textWidth + 40)) {  // Add extra buffer space to ensure text completely exits
+            if (state.textX <= -state.textWidth) {
                 // Text has fully scrolled off screen - end animation
-                animState.isAnimating = false;
-                display.clearDisplay();
-                display.display();
+                state.isAnimating = false;
+                clearFrame(display);
+                flushDirty(display);
                 return;
             }
-            
+
             // Draw the text at its current position
-            display.clearDisplay();
-            drawScrollText(display, animState.scrollText);
-            
-            animState.lastFrameTime = currentTime;
+            clearFrame(display);
+            drawScrollText(display, state);
+            flushDirty(display);
+#endif
+
+            state.lastFrameTime = currentTime;
         }
         return;
     }
-    
-    // Normal animation updates
-    if (currentTime - animState.lastFrameTime >= animState.delayMs) {
-        if (animState.currentIteration >= animState.totalIterations) {
-            animState.isAnimating = false;
-            display.clearDisplay();
-            display.display();
-            
-            if (animState.nextAnimation) {
-                auto next = animState.nextAnimation;
-                animState.nextAnimation = nullptr;
-                next();
+
+    // Timeline animation updates
+    if (currentTime - state.lastFrameTime >= state.delayMs) {
+        const AnimationDesc& anim = *state.anim;
+        if (state.currentLoop >= anim.loops) {
+            state.isAnimating = false;
+            clearFrame(display);
+            flushDirty(display);
+
+            if (state.nextAnimation) {
+                startAnimation(state, *state.nextAnimation);
             }
             return;
         }
 
-        display.clearDisplay();
-        animState.drawFunc(display, animState.isFirstState ? animState.state1 : animState.state2);
-        display.display();
-        
-        if (!animState.isFirstState) {
-            animState.currentIteration++;
+        const AnimationFrame& frame = anim.frames[state.frameIndex];
+        if (anim.clip && state.clipFrame != CLIP_NONE) {
+            // The previous clip frame is still in the framebuffer: apply the delta
+            advanceClip(display, *anim.clip, state.clipFrame, anim.clipX, anim.clipY);
+        } else {
+            clearFrame(display);
+            if (anim.clip) {
+                // Rebuild the clip frame from the key, e.g. when resuming mid-animation
+                drawClipKey(display, *anim.clip, anim.clipX, anim.clipY);
+                for (uint8_t f = 0; f < state.frameIndex; f++) {
+                    advanceClip(display, *anim.clip, f, anim.clipX, anim.clipY);
+                }
+            }
+        }
+        if (anim.clip) state.clipFrame = state.frameIndex;
+        drawAnimationFrame(display, frame);
+        flushDirty(display);
+
+        if (++state.frameIndex >= anim.frameCount) {
+            state.frameIndex = 0;
+            state.currentLoop++;
         }
-        animState.isFirstState = !animState.isFirstState;
-        
-        animState.lastFrameTime = currentTime;
+
+        state.delayMs = frame.durationMs;
+        state.lastFrameTime = currentTime;
     }
 }
 
+// Non-blocking animation update function
+inline void updateAnimation(RetainedSSD1306& display, AnimationState& state) {
+    if (!state.isAnimating) return;
+
+    // Charged to the animation that was playing, not to the one it chains into
+    AnimationStats* stats = animationStatsFor(state.anim);
+    uint32_t start = micros();
+    uint32_t flushes = display.stats.flushes;
+    uint32_t bytes = display.stats.bytes;
+    uint32_t byteOps = framebufferByteOps;
+
+    stepAnimation(display, state);
+
+    if (!stats) return;
+    stats->frames += display.stats.flushes - flushes;
+    stats->bytes += display.stats.bytes - bytes;
+    stats->byteOps += framebufferByteOps - byteOps;
+    stats->awakeUs += micros() - start;
+}
+
 // Check if animation is currently running
-inline bool isAnimating() {
-    return animState.isAnimating;
+inline bool isAnimating(const AnimationState& state) {
+    return state.isAnimating;
 }
 
-// Stop current animation
-inline void stopAnimation(Adafruit_SSD1306& display) {
-    animState.isAnimating = false;
-    animState.nextAnimation = nullptr;
-    display.clearDisplay();
-    display.display();
-}
-
-// Implementation of animation functions
-inline void drawLadyAndGentleman(Adafruit_SSD1306& display, String heartsize) {
-    // Draw the lady and gentleman
-    display.drawBitmap(96, 8, lady, 9, 16, WHITE);
-    display.drawBitmap(114, 8, gentleman, 7, 16, WHITE);
-
-    // Draw the appropriate heart size
-    if (heartsize == "small") {
-        display.drawBitmap(104, 4, small_heart, 9, 8, WHITE);
-    } else if (heartsize == "big") {
-        display.drawBitmap(102, 4, big_heart, 13, 11, WHITE);
-    }
-    display.display();
+// When updateAnimation() next has work to do
+inline uint32_t nextFrameTime(const AnimationState& state) {
+    return state.lastFrameTime + state.delayMs;
 }
 
-// Dancing couple animation function
-inline void drawDancingCouple(Adafruit_SSD1306& display, String frame) {
-    if (frame == "frame1") {
-        // Frame 1: Position (0,0), size 39x32
-        display.drawBitmap(0, 0, dancing_couple_1, 39, 32, WHITE);
-    } else if (frame == "frame2") {
-        // Frame 2: Position (4,-1), size 31x32
-        display.drawBitmap(4, 0, dancing_couple_2, 31, 32, WHITE);
-    }
-    display.display();
+// Pick an animation whose task was cancelled up again at `now`: the next
+// frame is due then, not when it was due before the pause
+inline void rebaseFrameClock(AnimationState& state, uint32_t now) {
+    state.lastFrameTime = now - state.delayMs;
 }
 
-// Scrolling text animation function (simplified)
-inline void drawScrollText(Adafruit_SSD1306& display, String text) {
-    display.setTextSize(2);
-    display.setTextColor(WHITE);
-    display.setTextWrap(false);
-    
-    // Draw text at current X position (from right to left)
-    // Center text vertically (typical text height for size 2 is 16 pixels)
-    display.setCursor(animState.textX, 9); // Center vertically
-    display.print(animState.scrollText);
-    display.display();
+// Stop current animation
+inline void stopAnimation(RetainedSSD1306& display, AnimationState& state) {
+    state.isAnimating = false;
+    state.nextAnimation = nullptr;
+#if SCROLL_HARDWARE
+    if (!state.anim && state.textWidth > 0) {
+        stopHardwareScroll(display);
+    }
+#endif
+    clearFrame(display);
+    flushDirty(display);
 }
 
-#endif // ANIMATIONS_H
\ No newline at end of file
+#endif // ANIMATIONS_H
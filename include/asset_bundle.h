@@ -0,0 +1,327 @@
+#ifndef ASSET_BUNDLE_H
+#define ASSET_BUNDLE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "animations.h"
+#include "sprite_blit.h"
+
+// Sprites, clips, animation timelines and messages from the "assets" flash
+// partition (partitions.csv), so new content is a partition write instead
+// of a firmware build. The partition is mapped into the address space with
+// esp_partition_mmap() and the bundle used where it lies: sprite data, clip
+// streams, animation names and message texts are read straight out of flash.
+// Only the descriptors that hold pointers (PageSprite, AnimationDesc and
+// friends) are filled in, into fixed tables, when the bundle is loaded.
+//
+// Mapping and unmapping take and give back heap for the MMU bookkeeping, so
+// the partition is mapped once, by the load in setup() before the heap guard
+// is armed (heap_guard.h), and stays mapped. A reload after an upload only
+// reads the bundle again: partition writes and erases invalidate the cache
+// over the ranges they change, so the mapping shows the new bundle.
+//
+// tools/build_assets.py writes the bundle from images.h and a message list;
+// it gets into the partition with esptool or over serial (asset_upload.h).
+// Without a valid bundle the firmware runs on what is compiled in.
+//
+// Layout, little endian, every table 4 byte aligned; offsets are from the
+// start of the bundle:
+//
+//   AssetHeader
+//   AssetSprite[spriteCount]         width, height, format, data offset
+//   AssetClip[clipCount]             canvas, frame count, key and delta table offsets
+//   AssetAnimation[animationCount]   name, frame table, clip index, position, loops
+//   AssetFrame[], AssetLayer[]       per animation: duration and sprite placements
+//   AssetMessage[messageCount]       text offset, length, scrolled width
+//   sprite and clip streams, names and texts (NUL terminated)
+//
+// Animations replace the built-in one of the same name ("idle", "reminder",
+// "dance"); the rest of the bundle's animations are not used yet.
+
+#define ASSET_PARTITION_LABEL "assets"
+#define ASSET_PARTITION_SUBTYPE 0x41  // Next custom data subtype after the dispense log
+#define ASSET_MAGIC 0x414C4950        // "PILA"
+#define ASSET_FORMAT 1                // Bumped when the layout changes
+
+#define ASSET_MAX_SPRITES 32
+#define ASSET_MAX_CLIPS 4
+#define ASSET_MAX_CLIP_FRAMES 16
+#define ASSET_MAX_ANIMATIONS 8
+#define ASSET_MAX_FRAMES 64   // All animations together
+#define ASSET_MAX_LAYERS 128  // All frames together
+#define ASSET_NO_CLIP 0xFF
+
+struct AssetHeader {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t headerSize;
+    uint32_t size;            // Whole bundle
+    uint32_t crc;             // CRC-32 of the bytes after the header
+    uint32_t version;         // Of the content, set by the builder
+    uint8_t spriteCount;
+    uint8_t clipCount;
+    uint8_t animationCount;
+    uint8_t messageCount;
+    uint32_t sprites;         // Table offsets
+    uint32_t clips;
+    uint32_t animations;
+    uint32_t messages;
+};
+static_assert(sizeof(AssetHeader) == 40, "bundle layout");
+
+struct AssetSprite {
+    uint16_t width;
+    uint8_t height;
+    uint8_t format;           // SpriteFormat
+    uint32_t data;
+};
+
+struct AssetClip {
+    uint16_t width;
+    uint8_t height;
+    uint8_t frameCount;
+    uint32_t key;
+    uint32_t deltas;          // uint32_t[frameCount] stream offsets
+};
+
+struct AssetAnimation {
+    uint32_t name;
+    uint32_t frames;          // AssetFrame[frameCount]
+    uint8_t frameCount;
+    uint8_t clip;             // Index, or ASSET_NO_CLIP
+    uint16_t loops;
+    int16_t clipX;
+    int16_t clipY;
+};
+
+struct AssetFrame {
+    uint32_t layers;          // AssetLayer[layerCount]
+    uint16_t durationMs;
+    uint8_t layerCount;
+    uint8_t reserved;
+};
+
+struct AssetLayer {
+    uint8_t sprite;
+    uint8_t reserved;
+    int16_t x;
+    int16_t y;
+    uint16_t reserved2;
+};
+
+struct AssetMessage {
+    uint32_t text;
+    uint16_t length;
+    uint16_t width;           // As scrollMessage() works it out
+};
+
+static_assert(sizeof(AssetSprite) == 8 && sizeof(AssetClip) == 12 && sizeof(AssetAnimation) == 16 &&
+              sizeof(AssetFrame) == 8 && sizeof(AssetLayer) == 8 && sizeof(AssetMessage) == 8, "bundle layout");
+
+// What the animations play: the built-in timelines, or the bundle's
+enum AnimationRole : uint8_t {
+    ANIMATION_IDLE,
+    ANIMATION_REMINDER,
+    ANIMATION_DANCE,
+    ANIMATION_ROLE_COUNT
+};
+
+static const AnimationDesc* const builtinAnimations[ANIMATION_ROLE_COUNT] = {
+    &ladyAndGentleman, &doseReminder, &dancingCouple
+};
+
+struct AssetBundle {
+    const esp_partition_t* partition;
+    const uint8_t* mapped;               // The whole partition, for good once mapped
+    spi_flash_mmap_handle_t mapping;
+    const uint8_t* base;                 // Loaded bundle, nullptr when not loaded
+    const AssetHeader* header;
+    const AnimationDesc* roles[ANIMATION_ROLE_COUNT];
+};
+
+static AssetBundle assets = {nullptr, nullptr, 0, nullptr, nullptr, {&ladyAndGentleman, &doseReminder, &dancingCouple}};
+
+static PageSprite assetSprites[ASSET_MAX_SPRITES];
+static SpriteClip assetClips[ASSET_MAX_CLIPS];
+static const uint8_t* assetClipDeltas[ASSET_MAX_CLIPS][ASSET_MAX_CLIP_FRAMES];
+static AnimationDesc assetAnimations[ASSET_MAX_ANIMATIONS];
+static AnimationFrame assetFrames[ASSET_MAX_FRAMES];
+static SpritePlacement assetLayers[ASSET_MAX_LAYERS];
+
+inline const AnimationDesc& animationFor(AnimationRole role) {
+    return *assets.roles[role];
+}
+
+// Whether `anim` is one of the timelines playing at the moment, e.g. to
+// trust a pointer kept across deep sleep
+inline bool isKnownAnimation(const AnimationDesc* anim) {
+    for (const AnimationDesc* known : assets.roles) {
+        if (known == anim) return true;
+    }
+    return false;
+}
+
+// CRC-32 as zlib computes it, a nibble at a time to keep the table small
+inline uint32_t assetCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+    static const uint32_t nibbles[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ nibbles[crc & 0x0F];
+        crc = (crc >> 4) ^ nibbles[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+inline const esp_partition_t* findAssetPartition() {
+    if (!assets.partition) {
+        assets.partition = esp_partition_find_first(
+            ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)ASSET_PARTITION_SUBTYPE, ASSET_PARTITION_LABEL);
+    }
+    return assets.partition;
+}
+
+// Whether [offset, offset + count * size) lies inside the bundle
+inline bool assetRangeValid(uint32_t offset, uint32_t count, uint32_t size) {
+    uint32_t total = assets.header->size;
+    return offset <= total && count * size <= total - offset && offset % 4 == 0;
+}
+
+inline bool assetStringValid(uint32_t offset) {
+    if (offset >= assets.header->size) return false;
+    return memchr(assets.base + offset, 0, assets.header->size - offset) != nullptr;
+}
+
+template <typename T>
+inline const T* assetTable(uint32_t offset) {
+    return (const T*)(assets.base + offset);
+}
+
+// The partition's mapping, made on the first call and kept from then on
+inline const uint8_t* mapAssetPartition(const esp_partition_t* part) {
+    if (!assets.mapped) {
+        const void* mapped;
+        if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &mapped, &assets.mapping) != ESP_OK) return nullptr;
+        assets.mapped = (const uint8_t*)mapped;
+    }
+    return assets.mapped;
+}
+
+// Back to the compiled-in content; the mapping stays. Stop the animation
+// first: it may be playing from the bundle.
+inline void unloadAssets() {
+    for (uint8_t r = 0; r < ANIMATION_ROLE_COUNT; r++) assets.roles[r] = builtinAnimations[r];
+    assets.base = nullptr;
+    assets.header = nullptr;
+}
+
+// Fill the descriptor tables from the mapped bundle; false if anything in it
+// points outside the bundle or past the tables
+inline bool parseAssets() {
+    const AssetHeader& h = *assets.header;
+    if (h.spriteCount > ASSET_MAX_SPRITES || h.clipCount > ASSET_MAX_CLIPS || h.animationCount > ASSET_MAX_ANIMATIONS) return false;
+    if (!assetRangeValid(h.sprites, h.spriteCount, sizeof(AssetSprite)) ||
+        !assetRangeValid(h.clips, h.clipCount, sizeof(AssetClip)) ||
+        !assetRangeValid(h.animations, h.animationCount, sizeof(AssetAnimation)) ||
+        !assetRangeValid(h.messages, h.messageCount, sizeof(AssetMessage))) return false;
+
+    const AssetSprite* sprites = assetTable<AssetSprite>(h.sprites);
+    for (uint8_t i = 0; i < h.spriteCount; i++) {
+        if (sprites[i].data >= h.size) return false;
+        assetSprites[i] = {sprites[i].width, sprites[i].height, assets.base + sprites[i].data, (SpriteFormat)sprites[i].format};
+    }
+
+    const AssetClip* clips = assetTable<AssetClip>(h.clips);
+    for (uint8_t i = 0; i < h.clipCount; i++) {
+        const AssetClip& c = clips[i];
+        if (c.frameCount == 0 || c.frameCount > ASSET_MAX_CLIP_FRAMES || c.key >= h.size ||
+            !assetRangeValid(c.deltas, c.frameCount, sizeof(uint32_t))) return false;
+        const uint32_t* deltas = assetTable<uint32_t>(c.deltas);
+        for (uint8_t f = 0; f < c.frameCount; f++) {
+            if (deltas[f] >= h.size) return false;
+            assetClipDeltas[i][f] = assets.base + deltas[f];
+        }
+        assetClips[i] = {c.width, c.height, c.frameCount, assets.base + c.key, assetClipDeltas[i]};
+    }
+
+    const AssetAnimation* anims = assetTable<AssetAnimation>(h.animations);
+    uint8_t frameCount = 0;
+    uint8_t layerCount = 0;
+    for (uint8_t i = 0; i < h.animationCount; i++) {
+        const AssetAnimation& a = anims[i];
+        if (a.frameCount == 0 || a.frameCount > ASSET_MAX_FRAMES - frameCount || !assetStringValid(a.name) ||
+            !assetRangeValid(a.frames, a.frameCount, sizeof(AssetFrame))) return false;
+        if (a.clip != ASSET_NO_CLIP && (a.clip >= h.clipCount || assetClips[a.clip].frameCount != a.frameCount)) return false;
+
+        AnimationFrame* frames = &assetFrames[frameCount];
+        const AssetFrame* src = assetTable<AssetFrame>(a.frames);
+        for (uint8_t f = 0; f < a.frameCount; f++) {
+            if (src[f].layerCount > ASSET_MAX_LAYERS - layerCount ||
+                !assetRangeValid(src[f].layers, src[f].layerCount, sizeof(AssetLayer))) return false;
+            SpritePlacement* layers = &assetLayers[layerCount];
+            const AssetLayer* placed = assetTable<AssetLayer>(src[f].layers);
+            for (uint8_t l = 0; l < src[f].layerCount; l++) {
+                if (placed[l].sprite >= h.spriteCount) return false;
+                layers[l] = {&assetSprites[placed[l].sprite], placed[l].x, placed[l].y};
+            }
+            frames[f] = {src[f].layerCount ? layers : nullptr, src[f].layerCount, src[f].durationMs};
+            layerCount += src[f].layerCount;
+        }
+        frameCount += a.frameCount;
+
+        assetAnimations[i] = {(const char*)assets.base + a.name, frames, a.frameCount, a.loops,
+                              a.clip == ASSET_NO_CLIP ? nullptr : &assetClips[a.clip], a.clipX, a.clipY};
+    }
+
+    const AssetMessage* messages = assetTable<AssetMessage>(h.messages);
+    for (uint8_t i = 0; i < h.messageCount; i++) {
+        if (!assetStringValid(messages[i].text)) return false;
+    }
+
+    // Everything checks out: the bundle's timelines take over their roles
+    for (uint8_t i = 0; i < h.animationCount; i++) {
+        for (uint8_t r = 0; r < ANIMATION_ROLE_COUNT; r++) {
+            if (!strcmp(assetAnimations[i].name, builtinAnimations[r]->name)) assets.roles[r] = &assetAnimations[i];
+        }
+    }
+    return true;
+}
+
+// Check the bundle and load it; false (and the built-in content) without a
+// partition, with an empty one or with a bundle that fails its CRC. The
+// partition is mapped even when it holds no bundle, for one uploaded later.
+inline bool loadAssets() {
+    unloadAssets();
+    const esp_partition_t* part = findAssetPartition();
+    if (!part) return false;
+    const uint8_t* base = mapAssetPartition(part);
+    if (!base) return false;
+
+    AssetHeader h;
+    if (esp_partition_read(part, 0, &h, sizeof(h)) != ESP_OK) return false;
+    if (h.magic != ASSET_MAGIC || h.format != ASSET_FORMAT || h.headerSize != sizeof(AssetHeader) ||
+        h.size < sizeof(AssetHeader) || h.size > part->size) return false;
+
+    assets.base = base;
+    assets.header = (const AssetHeader*)base;
+    if (assetCrc32(0, assets.base + sizeof(AssetHeader), h.size - sizeof(AssetHeader)) != h.crc || !parseAssets()) {
+        unloadAssets();
+        return false;
+    }
+    return true;
+}
+
+// Messages of the bundle, nullptr if there is none loaded
+inline const AssetMessage* assetMessages(uint8_t& count) {
+    count = assets.header ? assets.header->messageCount : 0;
+    return assets.header ? assetTable<AssetMessage>(assets.header->messages) : nullptr;
+}
+
+inline uint32_t assetVersion() {
+    return assets.header ? assets.header->version : 0;
+}
+
+#endif // ASSET_BUNDLE_H
@@ -0,0 +1,177 @@
+#ifndef ASSET_UPLOAD_H
+#define ASSET_UPLOAD_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "asset_bundle.h"
+
+// Serial upload of an asset bundle straight into the "assets" partition,
+// driven by tools/upload_assets.py. The 'U' query is answered with "asset
+// ready <chunk max>" (or "asset error busy 0" during a dispense), and from
+// then on everything the host sends is binary, little endian, until the
+// upload ends:
+//
+//   'S' size:u32 crc:u32       bundle size and the CRC-32 of the whole bundle
+//   'C' len:u16 data crc:u32   next len bytes (at most ASSET_CHUNK_MAX), crc of data
+//   'F'                        finish: check the written bundle and load it
+//   'A'                        abort
+//
+// Every frame gets a one line reply: "asset ack <bytes written>", "asset
+// done <version>", or "asset error <reason> <bytes written>", after which
+// the host sends that chunk again (or gives up with 'A'). A sector is erased
+// when the writes reach it, so a chunk can take a sector erase longer to be
+// acked. ASSET_UPLOAD_TIMEOUT_MS without a byte ends the upload as aborted.
+//
+// The partition only holds a loadable bundle again once the last chunk is
+// in and the CRC matches, so an upload cut short leaves the firmware on its
+// built-in content rather than on half a bundle.
+
+#define ASSET_CHUNK_MAX 128             // Fits the serial receive buffer with its framing
+#define ASSET_UPLOAD_TIMEOUT_MS 5000
+#define ASSET_UPLOAD_POLL_MS 5          // How often the loop looks at the serial port meanwhile
+#define ASSET_SECTOR_SIZE 4096
+
+enum AssetUploadResult : uint8_t {
+    ASSET_UPLOAD_RUNNING,
+    ASSET_UPLOAD_DONE,                  // New bundle written and checked
+    ASSET_UPLOAD_ABORTED                // By the host, a timeout or a flash error
+};
+
+struct AssetUpload {
+    bool active;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t written;
+    uint32_t erasedTo;                  // Partition bytes erased so far
+    uint32_t lastByteMs;
+    uint8_t frame[1 + 2 + ASSET_CHUNK_MAX + 4];
+    uint16_t frameLen;
+};
+
+static AssetUpload assetUpload = {};
+
+// Bytes a frame needs in total, judged from what has arrived of it; 0 for an unknown type
+inline uint16_t assetFrameLength(const uint8_t* frame, uint16_t len) {
+    switch (frame[0]) {
+        case 'S': return 1 + 8;
+        case 'C': return len < 3 ? 3 : 1 + 2 + (frame[1] | frame[2] << 8) + 4;
+        case 'F':
+        case 'A': return 1;
+        default: return 0;
+    }
+}
+
+inline uint32_t assetGet32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+inline void assetUploadReply(Print& out, const char* what, uint32_t value) {
+    out.printf("asset %s %lu\n", what, (unsigned long)value);
+}
+
+// Start the upload, the 'U' query having been read already. The current
+// bundle is about to be overwritten: unload it, with whatever plays from it
+// stopped, before calling this.
+inline void beginAssetUpload(Print& out) {
+    assetUpload = {};
+    assetUpload.active = true;
+    assetUpload.lastByteMs = millis();
+    assetUploadReply(out, "ready", ASSET_CHUNK_MAX);
+}
+
+inline bool assetUploadWrite(const uint8_t* data, uint16_t len) {
+    const esp_partition_t* part = findAssetPartition();
+    uint32_t end = assetUpload.written + len;
+    while (assetUpload.erasedTo < end) {
+        if (esp_partition_erase_range(part, assetUpload.erasedTo, ASSET_SECTOR_SIZE) != ESP_OK) return false;
+        assetUpload.erasedTo += ASSET_SECTOR_SIZE;
+    }
+    if (esp_partition_write(part, assetUpload.written, data, len) != ESP_OK) return false;
+    assetUpload.written = end;
+    return true;
+}
+
+// CRC of what was written, read back from flash
+inline bool assetUploadVerify() {
+    uint8_t chunk[ASSET_CHUNK_MAX];
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < assetUpload.size; offset += sizeof(chunk)) {
+        uint32_t n = min((uint32_t)sizeof(chunk), assetUpload.size - offset);
+        if (esp_partition_read(findAssetPartition(), offset, chunk, n) != ESP_OK) return false;
+        crc = assetCrc32(crc, chunk, n);
+    }
+    return crc == assetUpload.crc;
+}
+
+// Act on one complete frame
+inline AssetUploadResult handleAssetFrame(Print& out) {
+    const uint8_t* f = assetUpload.frame;
+    const esp_partition_t* part = findAssetPartition();
+    switch (f[0]) {
+        case 'S':
+            assetUpload.size = assetGet32(f + 1);
+            assetUpload.crc = assetGet32(f + 5);
+            assetUpload.written = 0;
+            assetUpload.erasedTo = 0;  // A restarted upload erases every sector again
+            if (!part || assetUpload.size < sizeof(AssetHeader) || assetUpload.size > part->size) {
+                assetUploadReply(out, "error size", 0);
+                return ASSET_UPLOAD_ABORTED;
+            }
+            assetUploadReply(out, "ack", 0);
+            return ASSET_UPLOAD_RUNNING;
+
+        case 'C': {
+            uint16_t len = f[1] | f[2] << 8;
+            if (assetCrc32(0, f + 3, len) != assetGet32(f + 3 + len)) {
+                assetUploadReply(out, "error crc", assetUpload.written);
+            } else if (len > assetUpload.size - assetUpload.written) {
+                assetUploadReply(out, "error length", assetUpload.written);
+            } else if (!assetUploadWrite(f + 3, len)) {
+                assetUploadReply(out, "error flash", assetUpload.written);
+                return ASSET_UPLOAD_ABORTED;
+            } else {
+                assetUploadReply(out, "ack", assetUpload.written);
+            }
+            return ASSET_UPLOAD_RUNNING;
+        }
+
+        case 'F':
+            if (assetUpload.written != assetUpload.size || !assetUploadVerify() || !loadAssets()) {
+                assetUploadReply(out, "error verify", assetUpload.written);
+                return ASSET_UPLOAD_ABORTED;
+            }
+            assetUploadReply(out, "done", assetVersion());
+            return ASSET_UPLOAD_DONE;
+
+        default:
+            assetUploadReply(out, "aborted", assetUpload.written);
+            return ASSET_UPLOAD_ABORTED;
+    }
+}
+
+// Take what has arrived on `in`; call from the loop while assetUpload.active
+inline AssetUploadResult pollAssetUpload(Stream& in, Print& out) {
+    AssetUploadResult result = ASSET_UPLOAD_RUNNING;
+    while (result == ASSET_UPLOAD_RUNNING && in.available() > 0) {
+        uint8_t b = in.read();
+        assetUpload.lastByteMs = millis();
+        assetUpload.frame[assetUpload.frameLen++] = b;
+        uint16_t need = assetFrameLength(assetUpload.frame, assetUpload.frameLen);
+        if (need == 0 || need > sizeof(assetUpload.frame)) {
+            assetUploadReply(out, "error frame", assetUpload.written);
+            assetUpload.frameLen = 0;  // Resynchronise on the next frame type
+            continue;
+        }
+        if (assetUpload.frameLen < need) continue;
+        result = handleAssetFrame(out);
+        assetUpload.frameLen = 0;
+    }
+    if (result == ASSET_UPLOAD_RUNNING && millis() - assetUpload.lastByteMs > ASSET_UPLOAD_TIMEOUT_MS) {
+        assetUploadReply(out, "error timeout", assetUpload.written);
+        result = ASSET_UPLOAD_ABORTED;
+    }
+    if (result != ASSET_UPLOAD_RUNNING) assetUpload.active = false;
+    return result;
+}
+
+#endif // ASSET_UPLOAD_H
@@ -0,0 +1,20 @@
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+// One controller can run several dispensers side by side, each a channel
+// with its own panel, servo and touch pad (pins in src/main.cpp). The panels
+// share the I2C bus: either behind a TCA9548A multiplexer, when
+// DISPLAY_MUX_ADDRESS is set, or at the two addresses an SSD1306 can have.
+// Build with e.g. -DCHANNEL_COUNT=2 [-DDISPLAY_MUX_ADDRESS=0x70].
+
+#ifndef CHANNEL_COUNT
+#define CHANNEL_COUNT 1
+#endif
+#define CHANNEL_MAX 4  // Free GPIOs of the ESP32-C3 for servos and touch pads
+
+static_assert(CHANNEL_COUNT >= 1 && CHANNEL_COUNT <= CHANNEL_MAX, "CHANNEL_COUNT out of range");
+#if CHANNEL_COUNT > 2 && !defined(DISPLAY_MUX_ADDRESS)
+#error "More than two panels need an I2C multiplexer (DISPLAY_MUX_ADDRESS)"
+#endif
+
+#endif // CHANNELS_H
@@ -0,0 +1,187 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <Arduino.h>
+#include "log_formats.h"
+
+// Deferred log: logEvent<LOG_...>(args) stores the message id, the time and
+// the integer arguments as varints in a RAM ring, a few bytes and no
+// formatting. drainLog() sends the ring out when the loop is about to sleep
+// anyway, and only as much as the serial transmit buffer takes without
+// blocking. Logging therefore never stalls a frame or the servo, and a full
+// ring drops records (and says how many) instead of waiting.
+//
+// On the wire each record is 0x1E, the COBS encoded record, 0x00, so it can
+// share the console with the plain text replies to serial queries;
+// tools/decode_log.py turns both back into text. Build with LOG_TEXT=1 to
+// have the firmware format the records itself at drain time instead.
+//
+// Log from the loop only, not from interrupts or the display task.
+
+#ifndef LOG_TEXT
+#define LOG_TEXT 0
+#endif
+
+#define LOG_RING_SIZE 1024       // Bytes, power of two
+#define LOG_MAX_ARGS 4
+#define LOG_RECORD_MAX (1 + 5 * (1 + LOG_MAX_ARGS))  // Id, millis and args as varints
+#define LOG_FRAME_START 0x1E     // Marks a binary record among text lines
+
+enum LogId : uint8_t {
+#define LOG_FORMAT_ID(id, fmt) id,
+    LOG_FORMATS(LOG_FORMAT_ID)
+#undef LOG_FORMAT_ID
+    LOG_FORMAT_COUNT
+};
+
+static constexpr const char* logFormatText[] = {
+#define LOG_FORMAT_TEXT(id, fmt) fmt,
+    LOG_FORMATS(LOG_FORMAT_TEXT)
+#undef LOG_FORMAT_TEXT
+};
+
+// Arguments a format takes, for the compile time check in logEvent()
+constexpr uint8_t logArgCount(const char* fmt) {
+    return *fmt == 0 ? 0
+         : *fmt != '%' ? logArgCount(fmt + 1)
+         : fmt[1] == '%' ? logArgCount(fmt + 2)
+         : 1 + logArgCount(fmt + 1);
+}
+
+static uint8_t logRing[LOG_RING_SIZE];  // Records, each prefixed with its length
+static uint32_t logHead = 0;            // Bytes ever written
+static uint32_t logTail = 0;            // Bytes ever drained
+static uint32_t logDropped = 0;         // Records lost to a full ring since the last drain
+
+inline uint8_t logPutVarint(uint8_t* out, uint8_t len, uint32_t value) {
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+inline uint32_t logGetVarint(const uint8_t* in, uint8_t len, uint8_t& pos) {
+    uint32_t value = 0;
+    for (uint8_t shift = 0; pos < len && shift < 35; shift += 7) {
+        uint8_t b = in[pos++];
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return value;
+}
+
+inline uint8_t logEncode(uint8_t* rec, LogId id, const uint32_t* args, uint8_t count) {
+    uint8_t len = 0;
+    rec[len++] = id;
+    len = logPutVarint(rec, len, millis());
+    for (uint8_t i = 0; i < count; i++) len = logPutVarint(rec, len, args[i]);
+    return len;
+}
+
+// Queue a record without checking its arguments against the format; prefer logEvent()
+inline void logWrite(LogId id, const uint32_t* args, uint8_t count) {
+    uint8_t rec[LOG_RECORD_MAX];
+    uint8_t len = logEncode(rec, id, args, count);
+    if (LOG_RING_SIZE - (logHead - logTail) < len + 1u) {
+        logDropped++;
+        return;
+    }
+    logRing[logHead++ & (LOG_RING_SIZE - 1)] = len;
+    for (uint8_t i = 0; i < len; i++) logRing[logHead++ & (LOG_RING_SIZE - 1)] = rec[i];
+}
+
+template <LogId Id, typename... Args>
+inline void logEvent(Args... args) {
+    static_assert(sizeof...(Args) == logArgCount(logFormatText[Id]), "argument count does not match the log format");
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    const uint32_t values[] = {(uint32_t)args..., 0};
+    logWrite(Id, values, sizeof...(Args));
+}
+
+#if LOG_TEXT
+// Format a record as "seconds.millis text"; only the conversions log_formats.h allows
+inline size_t logFormat(char* out, size_t size, const uint8_t* rec, uint8_t len) {
+    uint8_t pos = 1;
+    uint32_t ms = logGetVarint(rec, len, pos);
+    int n = snprintf(out, size, "%6lu.%03lu ", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000));
+    size_t used = n > 0 ? n : 0;
+    const char* fmt = rec[0] < LOG_FORMAT_COUNT ? logFormatText[rec[0]] : "unknown log record";
+    while (*fmt && used + 12 < size) {
+        if (*fmt != '%') {
+            out[used++] = *fmt++;
+            continue;
+        }
+        fmt++;
+        while (*fmt == 'l') fmt++;
+        uint32_t value = *fmt == '%' ? 0 : logGetVarint(rec, len, pos);
+        switch (*fmt) {
+            case 'd': n = snprintf(out + used, size - used, "%ld", (long)(int32_t)value); break;
+            case 'x': n = snprintf(out + used, size - used, "%lx", (unsigned long)value); break;
+            case '%': n = snprintf(out + used, size - used, "%%"); break;
+            default:  n = snprintf(out + used, size - used, "%lu", (unsigned long)value); break;
+        }
+        used += n > 0 ? n : 0;
+        if (*fmt) fmt++;
+    }
+    out[used++] = '\n';
+    return used;
+}
+
+inline bool logEmit(const uint8_t* rec, uint8_t len) {
+    char line[128];
+    size_t n = logFormat(line, sizeof(line), rec, len);
+    if ((size_t)Serial.availableForWrite() < n) return false;
+    Serial.write((const uint8_t*)line, n);
+    return true;
+}
+#else
+#define LOG_FRAME_MAX (LOG_RECORD_MAX + 3)  // Start byte, COBS overhead and end
+
+// 0x1E, the record COBS encoded, 0x00: the frame holds no 0x00 until its
+// end, so a decoder can resync anywhere. Returns the frame length.
+inline uint8_t logFrame(uint8_t* frame, const uint8_t* rec, uint8_t len) {
+    uint8_t n = 0;
+    frame[n++] = LOG_FRAME_START;
+    uint8_t code = n++;
+    frame[code] = 1;
+    for (uint8_t i = 0; i < len; i++) {
+        if (rec[i] == 0) {
+            code = n++;
+            frame[code] = 1;
+        } else {
+            frame[n++] = rec[i];
+            frame[code]++;
+        }
+    }
+    frame[n++] = 0;
+    return n;
+}
+
+inline bool logEmit(const uint8_t* rec, uint8_t len) {
+    uint8_t frame[LOG_FRAME_MAX];
+    uint8_t n = logFrame(frame, rec, len);
+    if ((size_t)Serial.availableForWrite() < n) return false;
+    Serial.write(frame, n);
+    return true;
+}
+#endif
+
+// Send queued records while the serial transmit buffer has room; call when idle
+inline void drainLog() {
+    while (logTail != logHead) {
+        uint8_t rec[LOG_RECORD_MAX];
+        uint8_t len = logRing[logTail & (LOG_RING_SIZE - 1)];
+        for (uint8_t i = 0; i < len; i++) rec[i] = logRing[(logTail + 1 + i) & (LOG_RING_SIZE - 1)];
+        if (!logEmit(rec, len)) return;
+        logTail += 1 + len;
+    }
+    if (logDropped) {
+        uint8_t rec[LOG_RECORD_MAX];
+        uint32_t dropped = logDropped;
+        if (logEmit(rec, logEncode(rec, LOG_DROPPED, &dropped, 1))) logDropped = 0;
+    }
+}
+
+#endif // DEFERRED_LOG_H
@@ -0,0 +1,197 @@
+#ifndef DISPENSE_LOG_H
+#define DISPENSE_LOG_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <sys/time.h>
+
+// Record of every dispense in the "dlog" flash partition (partitions.csv).
+// The partition is a ring of 4 KB sectors filled front to back with 16 byte
+// records, each numbered, so the write position is found from the first
+// record of every sector plus a scan of the newest one. A sector is erased
+// when writing reaches it, so every sector is erased once per trip round
+// the ring (4096 dispenses with the 64 KB partition).
+//
+// New records wait in RTC memory, which survives deep sleep, and are written
+// DLOG_BATCH at a time by commitDispenseLog(), called between sequences.
+// Records still pending are lost on a power cut or reset.
+
+#define DLOG_PARTITION_LABEL "dlog"
+#define DLOG_PARTITION_SUBTYPE 0x40   // First custom data subtype
+#define DLOG_SECTOR_SIZE 4096
+#define DLOG_BATCH 8                  // Pending records that make a flash write worthwhile
+#define DLOG_PENDING_MAX 16           // Records kept while flash is unavailable; newer ones are dropped
+#define DLOG_MAX_PENDING_S (6 * 3600UL)  // Written before a sleep once the oldest pending record is this old
+#define DLOG_READ_CHUNK 16            // Records read at a time when streaming the log
+#define DLOG_PILLS_MAX 0xFF           // Larger pill counts are recorded as this
+
+#define DLOG_DOSE_TAKEN 0x01  // The dispense took a due dose
+
+struct DispenseRecord {
+    uint32_t seq;         // 0xFFFFFFFF in erased flash
+    uint32_t time;        // gettimeofday() seconds: local time once the clock is set, else since power-on
+    uint16_t durationMs;  // Touch to end of the sequence
+    uint8_t trigger;      // TouchGesture that started it
+    uint8_t message;      // Index into messages[]
+    uint8_t flags;        // DLOG_ bits
+    uint8_t channel;      // Dispenser it came from
+    uint8_t pills;        // Pills dispensed, up to DLOG_PILLS_MAX
+    uint8_t check;        // Catches a record torn by a reset during the write
+};
+static_assert(sizeof(DispenseRecord) == 16, "records must tile flash pages and sectors");
+
+struct DispenseLog {
+    const esp_partition_t* partition;  // Found on first use
+    uint32_t size;                     // Whole sectors of the partition
+    uint32_t writeOffset;
+    uint32_t nextSeq;
+};
+
+static DispenseLog dispenseLog = {};
+
+static RTC_DATA_ATTR DispenseRecord dlogPending[DLOG_PENDING_MAX];
+static RTC_DATA_ATTR uint8_t dlogPendingCount = 0;
+static RTC_DATA_ATTR uint16_t dlogDropped = 0;
+
+inline uint8_t dispenseRecordCheck(const DispenseRecord& rec) {
+    const uint8_t* bytes = (const uint8_t*)&rec;
+    uint8_t sum = 0x5A;
+    for (size_t i = 0; i < offsetof(DispenseRecord, check); i++) sum += bytes[i];
+    return sum;
+}
+
+inline bool isDispenseRecordValid(const DispenseRecord& rec) {
+    return rec.seq != 0xFFFFFFFF && rec.check == dispenseRecordCheck(rec);
+}
+
+// Find the partition and the write position; false without a dlog partition
+inline bool mountDispenseLog() {
+    if (dispenseLog.partition) return true;
+    const esp_partition_t* part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)DLOG_PARTITION_SUBTYPE, DLOG_PARTITION_LABEL);
+    if (!part) return false;
+    uint32_t sectors = part->size / DLOG_SECTOR_SIZE;
+    if (sectors < 2) return false;
+
+    // The newest sector starts with the highest sequence number
+    int newest = -1;
+    uint32_t newestSeq = 0;
+    DispenseRecord rec;
+    for (uint32_t s = 0; s < sectors; s++) {
+        if (esp_partition_read(part, s * DLOG_SECTOR_SIZE, &rec, sizeof(rec)) != ESP_OK) return false;
+        if (!isDispenseRecordValid(rec)) continue;
+        if (newest < 0 || (int32_t)(rec.seq - newestSeq) > 0) {
+            newest = s;
+            newestSeq = rec.seq;
+        }
+    }
+
+    dispenseLog.size = sectors * DLOG_SECTOR_SIZE;
+    dispenseLog.writeOffset = 0;
+    dispenseLog.nextSeq = 0;
+    if (newest >= 0) {
+        // Append after its last used slot; a torn record still takes its slot
+        uint32_t offset = newest * DLOG_SECTOR_SIZE;
+        uint32_t end = offset + DLOG_SECTOR_SIZE;
+        for (; offset < end; offset += sizeof(rec)) {
+            if (esp_partition_read(part, offset, &rec, sizeof(rec)) != ESP_OK) return false;
+            if (rec.seq == 0xFFFFFFFF) break;
+            if (isDispenseRecordValid(rec)) dispenseLog.nextSeq = rec.seq + 1;
+        }
+        dispenseLog.writeOffset = offset % dispenseLog.size;
+    }
+    dispenseLog.partition = part;
+    return true;
+}
+
+// Queue a record; cheap enough to call from the dispense sequence
+inline void logDispense(uint8_t channel, uint8_t trigger, uint8_t message, uint32_t durationMs, uint8_t flags,
+                        uint8_t pills) {
+    if (dlogPendingCount >= DLOG_PENDING_MAX) {
+        dlogDropped++;
+        return;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    DispenseRecord& rec = dlogPending[dlogPendingCount++];
+    memset(&rec, 0xFF, sizeof(rec));
+    rec.time = (uint32_t)tv.tv_sec;
+    rec.durationMs = durationMs > 0xFFFF ? 0xFFFF : (uint16_t)durationMs;
+    rec.trigger = trigger;
+    rec.message = message;
+    rec.flags = flags;
+    rec.channel = channel;
+    rec.pills = pills;
+}
+
+// Whether a commit is due: a full batch, or optionally records pending longer than DLOG_MAX_PENDING_S
+inline bool isDispenseLogCommitDue(bool byAge) {
+    if (dlogPendingCount >= DLOG_BATCH) return true;
+    if (!byAge || dlogPendingCount == 0) return false;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint32_t)tv.tv_sec - dlogPending[0].time >= DLOG_MAX_PENDING_S;
+}
+
+// Write all pending records, one flash write per sector they land in. Takes
+// a sector erase (tens of ms) whenever writing enters a new sector.
+inline bool commitDispenseLog() {
+    if (dlogPendingCount == 0) return true;
+    if (!mountDispenseLog()) return false;
+    const esp_partition_t* part = dispenseLog.partition;
+    uint8_t done = 0;
+    while (done < dlogPendingCount) {
+        uint32_t offset = dispenseLog.writeOffset;
+        if (offset % DLOG_SECTOR_SIZE == 0) {
+            if (esp_partition_erase_range(part, offset, DLOG_SECTOR_SIZE) != ESP_OK) break;
+        }
+        uint32_t room = (DLOG_SECTOR_SIZE - offset % DLOG_SECTOR_SIZE) / sizeof(DispenseRecord);
+        uint8_t count = min((uint32_t)(dlogPendingCount - done), room);
+        for (uint8_t i = done; i < done + count; i++) {
+            dlogPending[i].seq = dispenseLog.nextSeq++;
+            dlogPending[i].check = dispenseRecordCheck(dlogPending[i]);
+        }
+        if (esp_partition_write(part, offset, &dlogPending[done], count * sizeof(DispenseRecord)) != ESP_OK) break;
+        dispenseLog.writeOffset = (offset + count * sizeof(DispenseRecord)) % dispenseLog.size;
+        done += count;
+    }
+    // Keep whatever did not make it for the next try
+    memmove(dlogPending, dlogPending + done, (dlogPendingCount - done) * sizeof(DispenseRecord));
+    dlogPendingCount -= done;
+    return dlogPendingCount == 0;
+}
+
+inline void printDispenseRecord(Print& out, const DispenseRecord& rec, uint32_t seq, const char* where) {
+    out.printf("%lu,%lu,%u,%u,%u,%u,%s,%u,%u\n", (unsigned long)seq, (unsigned long)rec.time, rec.trigger,
+               rec.message, rec.durationMs, (rec.flags & DLOG_DOSE_TAKEN) ? 1 : 0, where,
+               rec.channel, rec.pills);
+}
+
+// Stream the log as CSV, oldest first, followed by the records not yet in flash
+inline void printDispenseLog(Print& out) {
+    bool mounted = mountDispenseLog();
+    uint32_t inFlash = 0;
+    out.println("seq,time,trigger,message,duration_ms,dose_taken,where,channel,pills");
+    if (mounted) {
+        // Oldest records are in the next sector to be erased
+        uint32_t offset = dispenseLog.writeOffset;
+        if (offset % DLOG_SECTOR_SIZE) offset = (offset - offset % DLOG_SECTOR_SIZE + DLOG_SECTOR_SIZE) % dispenseLog.size;
+        DispenseRecord chunk[DLOG_READ_CHUNK];
+        for (uint32_t n = 0; n < dispenseLog.size; n += sizeof(chunk)) {
+            if (esp_partition_read(dispenseLog.partition, offset, chunk, sizeof(chunk)) != ESP_OK) break;
+            for (const DispenseRecord& rec : chunk) {
+                if (!isDispenseRecordValid(rec)) continue;
+                printDispenseRecord(out, rec, rec.seq, "flash");
+                inFlash++;
+            }
+            offset = (offset + sizeof(chunk)) % dispenseLog.size;
+        }
+    }
+    for (uint8_t i = 0; i < dlogPendingCount; i++) {
+        printDispenseRecord(out, dlogPending[i], dispenseLog.nextSeq + i, "pending");
+    }
+    out.printf("# %lu in flash%s, %u pending, %u dropped\n", (unsigned long)inFlash,
+               mounted ? "" : " (no dlog partition)", dlogPendingCount, dlogDropped);
+}
+
+#endif // DISPENSE_LOG_H
@@ -0,0 +1,154 @@
+#ifndef DISPENSE_PLANNER_H
+#define DISPENSE_PLANNER_H
+
+#include <Arduino.h>
+#include "servo_motion.h"
+#include "dose_schedule.h"
+
+// Plans the servo paths for a whole dose. The compartments of a dispenser
+// lie along the servo's sweep: moving from a compartment's load angle to its
+// drop angle lets one pill go, moving back picks up the next. A dose of N
+// pills is N such strokes in one touch sequence, rather than N sequences
+// with a message and a dance each. A path holds as many strokes as the
+// servo's waypoint queue does; the pills that did not fit stay in the dose
+// for the next plan, made once the servo has run this one.
+//
+// The strokes themselves cost the same in any order, so only the moves
+// between compartments are up to the planner. It tries every order of the
+// compartments in use (at most DOSE_MAX_COMPARTMENTS, so a table of 16 x 4)
+// for the least travel from where the horn is. Moves take time in proportion
+// to their travel, a dwell follows only a drop or a load, and the path ends
+// at the last drop instead of going home: the next plan starts from there.
+
+#define DISPENSE_MS_PER_DEGREE 12    // Eased move time per degree of travel
+#define DISPENSE_MIN_MOVE_MS 60
+#define DISPENSE_DROP_DWELL_MS 500   // For the pill to clear the chute
+#define DISPENSE_LOAD_DWELL_MS 250   // For the next pill to settle in the slider
+#define DISPENSE_MAX_PILLS (SERVO_QUEUE_LEN / 2)  // Per path: a load and a drop each
+
+struct DispenseCompartment {
+    int16_t loadAngle;
+    int16_t dropAngle;
+};
+
+struct DispensePlan {
+    ServoWaypoint path[SERVO_QUEUE_LEN];
+    uint8_t length;
+    uint8_t pills;        // At most DISPENSE_MAX_PILLS
+    uint8_t unplannable;  // Pills asked of compartments the dispenser does not have
+    uint16_t travelDeg;
+    uint32_t durationMs;  // Moves and dwells, to the end of the last drop's dwell
+};
+
+inline uint16_t dispenseMoveMs(int travelDeg) {
+    return max(DISPENSE_MIN_MOVE_MS, travelDeg * DISPENSE_MS_PER_DEGREE);
+}
+
+// Move to `angle` and hold it; nothing when the horn is there already.
+// `angle` and `at` are both as the servo is sent them (servoTarget()).
+inline void planMove(DispensePlan& plan, int& at, int angle, uint16_t dwellMs) {
+    if (angle == at) return;
+    uint16_t travel = abs(angle - at);
+    ServoWaypoint& wp = plan.path[plan.length++];
+    wp = {(int16_t)angle, dispenseMoveMs(travel), dwellMs, MOTION_MIN_JERK};
+    plan.travelDeg += travel;
+    plan.durationMs += wp.moveMs + dwellMs;
+    at = angle;
+}
+
+// Order of the compartments with pills that travels least between them,
+// starting at `fromAngle`. Each compartment is entered at its load angle and
+// left at its drop angle. Returns how many go into `order`.
+inline uint8_t planCompartmentOrder(const DispenseCompartment* compartments, uint8_t count,
+                                    const DosePills& pills, int fromAngle, uint8_t* order) {
+    uint8_t used[DOSE_MAX_COMPARTMENTS];
+    uint8_t n = 0;
+    for (uint8_t c = 0; c < count && c < DOSE_MAX_COMPARTMENTS; c++) {
+        if (pills.count[c]) used[n++] = c;
+    }
+    if (n == 0) return 0;
+
+    // best[mask][last]: least travel to visit `mask`, ending with `last`. The
+    // table grows as 2^n * n, and the masks are uint8_t.
+    static_assert(DOSE_MAX_COMPARTMENTS < 8, "compartment subsets must fit the uint8_t masks");
+    const uint16_t none = 0xFFFF;
+    uint16_t best[1 << DOSE_MAX_COMPARTMENTS][DOSE_MAX_COMPARTMENTS];
+    uint8_t prev[1 << DOSE_MAX_COMPARTMENTS][DOSE_MAX_COMPARTMENTS];
+    uint8_t full = (1 << n) - 1;
+    for (uint8_t mask = 1; mask <= full; mask++) {
+        for (uint8_t last = 0; last < n; last++) {
+            best[mask][last] = none;
+            if (!(mask & (1 << last))) continue;
+            const DispenseCompartment& to = compartments[used[last]];
+            uint8_t rest = mask & ~(1 << last);
+            if (!rest) {
+                best[mask][last] = abs(to.loadAngle - fromAngle);
+                continue;
+            }
+            for (uint8_t p = 0; p < n; p++) {
+                if (!(rest & (1 << p)) || best[rest][p] == none) continue;
+                uint16_t travel = best[rest][p] + abs(to.loadAngle - compartments[used[p]].dropAngle);
+                if (travel < best[mask][last]) {
+                    best[mask][last] = travel;
+                    prev[mask][last] = p;
+                }
+            }
+        }
+    }
+
+    uint8_t last = 0;
+    for (uint8_t i = 1; i < n; i++) {
+        if (best[full][i] < best[full][last]) last = i;
+    }
+    for (uint8_t mask = full, i = n; i > 0; i--) {
+        order[i - 1] = used[last];
+        uint8_t rest = mask & ~(1 << last);
+        if (rest) last = prev[mask][last];
+        mask = rest;
+    }
+    return n;
+}
+
+// Plan the strokes for as many of `pills` as fit in one path on `motion`,
+// from the horn's current angle, and take them out of `pills`. An empty plan
+// means the dose is done. Compartment angles go through the servo's own
+// clamp first, so the plan skips and counts exactly the moves the servo
+// will make.
+inline void planDispense(DispensePlan& plan, const ServoMotion& motion, const DispenseCompartment* compartments,
+                         uint8_t count, DosePills& pills) {
+    DispenseCompartment clamped[DOSE_MAX_COMPARTMENTS];
+    count = min(count, (uint8_t)DOSE_MAX_COMPARTMENTS);
+    for (uint8_t c = 0; c < count; c++) {
+        clamped[c] = {(int16_t)servoTarget(motion, compartments[c].loadAngle),
+                      (int16_t)servoTarget(motion, compartments[c].dropAngle)};
+    }
+    compartments = clamped;
+    int fromAngle = motion.angle;
+    plan.length = 0;
+    plan.pills = 0;
+    plan.unplannable = 0;
+    plan.travelDeg = 0;
+    plan.durationMs = 0;
+    for (uint8_t c = count; c < DOSE_MAX_COMPARTMENTS; c++) {
+        plan.unplannable += pills.count[c];
+        pills.count[c] = 0;
+    }
+    uint8_t order[DOSE_MAX_COMPARTMENTS];
+    uint8_t n = planCompartmentOrder(compartments, count, pills, fromAngle, order);
+    int at = fromAngle;
+    for (uint8_t i = 0; i < n; i++) {
+        const DispenseCompartment& c = compartments[order[i]];
+        for (; pills.count[order[i]] && plan.pills < DISPENSE_MAX_PILLS; pills.count[order[i]]--) {
+            planMove(plan, at, c.loadAngle, DISPENSE_LOAD_DWELL_MS);
+            planMove(plan, at, c.dropAngle, DISPENSE_DROP_DWELL_MS);
+            plan.pills++;
+        }
+    }
+}
+
+// Pills per minute in hundredths, over `ms` of motion
+inline uint32_t pillsPerMinute100(uint32_t pills, uint32_t ms) {
+    return ms ? (uint32_t)((uint64_t)pills * 6000000ULL / ms) : 0;
+}
+
+#endif // DISPENSE_PLANNER_H
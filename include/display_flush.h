@@ -0,0 +1,380 @@
+#ifndef DISPLAY_FLUSH_H
+#define DISPLAY_FLUSH_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_SSD1306.h>
+#include "energy.h"
+#include "trace.h"
+#include "power_management.h"
+#include "channels.h"
+
+#define SCREEN_WIDTH 128  // OLED display width
+#define SCREEN_HEIGHT 32  // OLED display height
+#define SCREEN_PAGES (SCREEN_HEIGHT / 8)  // SSD1306 pages are 8 pixel rows each
+
+#ifndef SCREEN_ADDRESS
+#define SCREEN_ADDRESS 0x3C
+#endif
+#define SCREEN_ADDRESS_ALT (SCREEN_ADDRESS ^ 1)  // The other SSD1306 address, SA0 strapped the other way
+
+// I2C fast mode. The SSD1306 is specified for 400 kHz; most modules also run at 1000000.
+#ifndef DISPLAY_I2C_CLOCK
+#define DISPLAY_I2C_CLOCK 400000
+#endif
+
+// Wire buffer that holds a whole frame plus its addressing commands, so a flush
+// is one transaction. Wire.setBufferSize() must get this before Wire.begin().
+#define DISPLAY_WIRE_BUFFER (SCREEN_WIDTH * SCREEN_PAGES + 16)
+
+// Largest I2C write the default Wire buffer accepts, used until startDisplayPipeline()
+#if defined(I2C_BUFFER_LENGTH)
+#define FLUSH_WIRE_MAX I2C_BUFFER_LENGTH
+#else
+#define FLUSH_WIRE_MAX 32
+#endif
+
+// Send frames from a FreeRTOS task while the next one is drawn
+#ifndef DISPLAY_ASYNC
+#ifdef ARDUINO_ARCH_ESP32
+#define DISPLAY_ASYNC 1
+#else
+#define DISPLAY_ASYNC 0
+#endif
+#endif
+
+#if DISPLAY_ASYNC
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#define DISPLAY_TASK_STACK 2048
+#define DISPLAY_TASK_PRIORITY 2  // Above loopTask so the bus is kept busy
+#endif
+
+// Bytes a window costs besides its pixels: address, six Co = 1 command pairs, data control byte
+#define DISPLAY_WINDOW_OVERHEAD 14
+
+// Touched column span per page. A page is clean when x0 > x1.
+struct DirtyRegion {
+    uint8_t x0[SCREEN_PAGES];
+    uint8_t x1[SCREEN_PAGES];
+};
+
+// Rectangle of pages and columns written in one transaction
+struct DisplayWindow {
+    uint8_t page0, page1;
+    uint8_t x0, x1;
+};
+
+// Front buffers: what each panel's GDDRAM holds, or is being sent. The
+// Adafruit framebuffer is the back buffer the next frame is drawn into. Both
+// live in RTC memory: the panels keep their content through a deep sleep of the MCU.
+static RTC_DATA_ATTR uint8_t panelShadow[CHANNEL_COUNT][SCREEN_WIDTH * SCREEN_PAGES];
+static RTC_DATA_ATTR bool panelShadowValid[CHANNEL_COUNT];  // False until the panel has been fully written once
+static RTC_DATA_ATTR bool panelAsleep[CHANNEL_COUNT];       // Display off command sent, GDDRAM still holds panelShadow
+
+// Totals per panel, for the animation and channel stats
+struct DisplayStats {
+    uint32_t flushes;  // flushDirty() calls
+    uint32_t bytes;    // Window bytes queued for the panel, addressing commands included
+};
+
+// Adafruit_SSD1306 plus what the flush keeps track of for its panel. The
+// panel of channel i is at panelAddress(i), behind multiplexer port i if
+// there is one, and uses panelShadow[i].
+class RetainedSSD1306 : public Adafruit_SSD1306 {
+public:
+    explicit RetainedSSD1306(uint8_t channel = 0)
+        : Adafruit_SSD1306(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, -1), channel(channel) {}
+
+    uint8_t channel;
+    DirtyRegion frameDirty = {{0xFF, 0xFF, 0xFF, 0xFF}, {0, 0, 0, 0}};  // Drawn since last flush
+    DirtyRegion shownDirty = {{0, 0, 0, 0}, {SCREEN_WIDTH - 1, SCREEN_WIDTH - 1, SCREEN_WIDTH - 1, SCREEN_WIDTH - 1}};  // Drawn in the frame on the panel
+    DisplayStats stats = {};
+
+    // Take over a panel which is still configured from before a deep sleep,
+    // without the init sequence (which blanks it): allocate the framebuffer
+    // only, the panel keeps showing panelShadow
+    bool resume(uint8_t address) {
+        if (!buffer && !(buffer = (uint8_t*)malloc(WIDTH * ((HEIGHT + 7) / 8)))) return false;
+        clearDisplay();
+        i2caddr = address;
+        return true;
+    }
+
+    uint8_t address() const { return i2caddr; }
+};
+
+// The transfer in flight: only one panel is sent to at a time
+static RetainedSSD1306* pendingPanel = nullptr;
+static DisplayWindow pendingWindows[SCREEN_PAGES];
+static uint8_t pendingWindowCount = 0;
+static size_t displayWireMax = FLUSH_WIRE_MAX;
+
+#ifdef DISPLAY_MUX_ADDRESS
+static uint8_t muxSelected = 0xFF;  // Port the multiplexer passes through, unknown after a reset
+#endif
+
+#if DISPLAY_ASYNC
+static TaskHandle_t displayTaskHandle = nullptr;
+static SemaphoreHandle_t displayIdle = nullptr;  // Available while no transfer is in flight
+#endif
+
+// Panel of a channel: every one at SCREEN_ADDRESS behind the multiplexer,
+// or without one, channel 0 at SCREEN_ADDRESS and channel 1 at the other address
+inline uint8_t panelAddress(uint8_t channel) {
+#ifdef DISPLAY_MUX_ADDRESS
+    (void)channel;  // Told apart by the multiplexer port
+    return SCREEN_ADDRESS;
+#else
+    return channel == 0 ? SCREEN_ADDRESS : SCREEN_ADDRESS_ALT;
+#endif
+}
+
+// Route the bus to a panel; costs a one byte transaction when the
+// multiplexer has to switch ports. The caller owns the bus: nothing in
+// flight, or it is the transfer itself.
+inline void selectPanel(uint8_t channel) {
+#ifdef DISPLAY_MUX_ADDRESS
+    if (muxSelected == channel) return;
+    Wire.beginTransmission(DISPLAY_MUX_ADDRESS);
+    Wire.write((uint8_t)(1 << channel));
+    Wire.endTransmission();
+    muxSelected = channel;
+#else
+    (void)channel;
+#endif
+}
+
+inline void clearDirtyRegion(DirtyRegion& region) {
+    for (int p = 0; p < SCREEN_PAGES; p++) {
+        region.x0[p] = 0xFF;
+        region.x1[p] = 0;
+    }
+}
+
+// Record that the pixels in (x, y, w, h) were drawn this frame
+inline void markDirty(RetainedSSD1306& display, int x, int y, int w, int h) {
+    int xEnd = x + w - 1;
+    int yEnd = y + h - 1;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (xEnd >= SCREEN_WIDTH) xEnd = SCREEN_WIDTH - 1;
+    if (yEnd >= SCREEN_HEIGHT) yEnd = SCREEN_HEIGHT - 1;
+    if (x > xEnd || y > yEnd) return;
+
+    for (int p = y >> 3; p <= (yEnd >> 3); p++) {
+        if (x < display.frameDirty.x0[p]) display.frameDirty.x0[p] = x;
+        if (xEnd > display.frameDirty.x1[p]) display.frameDirty.x1[p] = xEnd;
+    }
+}
+
+inline void markAllDirty(RetainedSSD1306& display) {
+    markDirty(display, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+}
+
+// Block until the frame in flight has been sent
+inline void waitForDisplayIdle() {
+#if DISPLAY_ASYNC
+    if (!displayIdle) return;
+    EnergyState prev = energyEnter(ENERGY_I2C);
+    xSemaphoreTake(displayIdle, portMAX_DELAY);
+    xSemaphoreGive(displayIdle);
+    energyEnter(prev);
+#endif
+}
+
+// Forget what the panel shows, e.g. after it was written behind our back
+inline void invalidateDisplay(RetainedSSD1306& display) {
+    waitForDisplayIdle();
+    panelShadowValid[display.channel] = false;
+    markAllDirty(display);
+}
+
+// Send a list of SSD1306 commands in a single I2C transaction
+inline void sendDisplayCommands(RetainedSSD1306& display, const uint8_t* cmds, uint8_t count) {
+    waitForDisplayIdle();
+    EnergyState prev = energyEnter(ENERGY_I2C);
+    acquirePowerLock(POWER_LOCK_I2C);
+    Wire.setClock(DISPLAY_I2C_CLOCK);
+    selectPanel(display.channel);
+    Wire.beginTransmission(display.address());
+    Wire.write((uint8_t)0x00);  // Co = 0, D/C# = 0: command stream
+    Wire.write(cmds, count);
+    Wire.endTransmission();
+    releasePowerLock(POWER_LOCK_I2C);
+    energyEnter(prev);
+}
+
+// Switch the panel on or off. Off keeps GDDRAM, so switching back on shows
+// the same frame without a redraw.
+inline void setPanelPower(RetainedSSD1306& display, bool on) {
+    if (panelAsleep[display.channel] != on) return;
+    const uint8_t cmd = on ? SSD1306_DISPLAYON : SSD1306_DISPLAYOFF;
+    sendDisplayCommands(display, &cmd, 1);
+    panelAsleep[display.channel] = !on;
+    energyPanel(on);
+}
+
+// Write one window from the front buffer. The addressing commands (Co = 1) and
+// the data stream share a transaction, split only when the Wire buffer is too small.
+inline void sendDisplayWindow(const RetainedSSD1306& display, const DisplayWindow& w) {
+    const uint8_t header[] = {
+        0x80, SSD1306_PAGEADDR, 0x80, w.page0, 0x80, w.page1,
+        0x80, SSD1306_COLUMNADDR, 0x80, w.x0, 0x80, w.x1,
+        0x40  // Co = 0, D/C# = 1: data stream follows
+    };
+    const uint8_t width = w.x1 - w.x0 + 1;
+
+    Wire.beginTransmission(display.address());
+    Wire.write(header, sizeof(header));
+    size_t room = displayWireMax - sizeof(header);
+    for (uint8_t page = w.page0; page <= w.page1; page++) {
+        const uint8_t* ptr = panelShadow[display.channel] + page * SCREEN_WIDTH + w.x0;
+        uint8_t remaining = width;
+        while (remaining > 0) {
+            if (room == 0) {
+                Wire.endTransmission();
+                Wire.beginTransmission(display.address());
+                Wire.write((uint8_t)0x40);
+                room = displayWireMax - 1;
+            }
+            uint8_t chunk = remaining < room ? remaining : room;
+            Wire.write(ptr, chunk);
+            ptr += chunk;
+            remaining -= chunk;
+            room -= chunk;
+        }
+    }
+    Wire.endTransmission();
+}
+
+// Send the pending windows; runs in the transfer task when DISPLAY_ASYNC is set
+inline void runDisplayTransfer() {
+    trace(TRACE_I2C, TRACE_BEGIN, pendingWindowCount);
+    acquirePowerLock(POWER_LOCK_I2C);  // Bus clock, and no light sleep while the task waits on the bus
+    Wire.setClock(DISPLAY_I2C_CLOCK);
+    selectPanel(pendingPanel->channel);
+    for (uint8_t i = 0; i < pendingWindowCount; i++) {
+        sendDisplayWindow(*pendingPanel, pendingWindows[i]);
+    }
+    pendingWindowCount = 0;
+    releasePowerLock(POWER_LOCK_I2C);
+    trace(TRACE_I2C, TRACE_END);
+}
+
+#if DISPLAY_ASYNC
+inline void displayTransferTask(void*) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        runDisplayTransfer();
+        xSemaphoreGive(displayIdle);
+    }
+}
+#endif
+
+// Call once, after display.begin() or display.resume() of every panel. `wireBuffer` is what
+// Wire.setBufferSize() returned before Wire.begin(); 0 keeps the default chunked writes.
+inline void startDisplayPipeline(size_t wireBuffer) {
+    if (wireBuffer > 0) displayWireMax = wireBuffer;
+#if DISPLAY_ASYNC
+    displayIdle = xSemaphoreCreateBinary();
+    xSemaphoreGive(displayIdle);
+    xTaskCreate(displayTransferTask, "oled", DISPLAY_TASK_STACK, nullptr, DISPLAY_TASK_PRIORITY, &displayTaskHandle);
+#endif
+}
+
+// Push only the changed part of the framebuffer to the panel.
+// The region flushed per page is what was drawn this frame plus what was drawn
+// in the previous one (clearDisplay() erased it), trimmed to bytes that differ
+// from what the panel already shows. Those bytes are copied into the front
+// buffer and sent from there, so the caller can draw the next frame right away.
+inline void flushDirty(RetainedSSD1306& display) {
+    const uint8_t* buffer = display.getBuffer();
+    DisplayWindow spans[SCREEN_PAGES];
+    uint8_t spanCount = 0;
+    int spanBytes = 0;
+    int boxX0 = SCREEN_WIDTH, boxX1 = -1;
+
+    trace(TRACE_FLUSH, TRACE_BEGIN);
+#if DISPLAY_ASYNC
+    if (displayIdle) {
+        EnergyState prev = energyEnter(ENERGY_I2C);
+        xSemaphoreTake(displayIdle, portMAX_DELAY);  // Front buffer is free again
+        energyEnter(prev);
+    }
+#endif
+
+    const DirtyRegion& frameDirty = display.frameDirty;
+    const DirtyRegion& shownDirty = display.shownDirty;
+    uint8_t* front = panelShadow[display.channel];
+    for (int p = 0; p < SCREEN_PAGES; p++) {
+        int x0 = min(frameDirty.x0[p], shownDirty.x0[p]);
+        int x1 = max(frameDirty.x1[p], shownDirty.x1[p]);
+        if (frameDirty.x0[p] > frameDirty.x1[p]) {
+            x0 = shownDirty.x0[p];
+            x1 = shownDirty.x1[p];
+        } else if (shownDirty.x0[p] > shownDirty.x1[p]) {
+            x0 = frameDirty.x0[p];
+            x1 = frameDirty.x1[p];
+        }
+        if (x0 > x1) continue;
+
+        const uint8_t* row = buffer + p * SCREEN_WIDTH;
+        const uint8_t* shadow = front + p * SCREEN_WIDTH;
+        if (panelShadowValid[display.channel]) {
+            while (x0 <= x1 && row[x0] == shadow[x0]) x0++;
+            while (x1 >= x0 && row[x1] == shadow[x1]) x1--;
+            if (x0 > x1) continue;
+        }
+
+        spans[spanCount++] = {(uint8_t)p, (uint8_t)p, (uint8_t)x0, (uint8_t)x1};
+        spanBytes += x1 - x0 + 1 + DISPLAY_WINDOW_OVERHEAD;
+        if (x0 < boxX0) boxX0 = x0;
+        if (x1 > boxX1) boxX1 = x1;
+    }
+
+    // One bounding window when it costs no more bytes than a window per page
+    pendingPanel = &display;
+    pendingWindowCount = 0;
+    if (spanCount > 0) {
+        uint8_t page0 = spans[0].page0;
+        uint8_t page1 = spans[spanCount - 1].page1;
+        int boxBytes = (page1 - page0 + 1) * (boxX1 - boxX0 + 1) + DISPLAY_WINDOW_OVERHEAD;
+        if (spanCount > 1 && boxBytes <= spanBytes) {
+            pendingWindows[pendingWindowCount++] = {page0, page1, (uint8_t)boxX0, (uint8_t)boxX1};
+        } else {
+            for (uint8_t i = 0; i < spanCount; i++) pendingWindows[pendingWindowCount++] = spans[i];
+        }
+    }
+
+    for (uint8_t i = 0; i < pendingWindowCount; i++) {
+        const DisplayWindow& w = pendingWindows[i];
+        for (uint8_t p = w.page0; p <= w.page1; p++) {
+            memcpy(front + p * SCREEN_WIDTH + w.x0, buffer + p * SCREEN_WIDTH + w.x0, w.x1 - w.x0 + 1);
+        }
+        display.stats.bytes += (w.page1 - w.page0 + 1) * (w.x1 - w.x0 + 1) + DISPLAY_WINDOW_OVERHEAD;
+    }
+    display.stats.flushes++;
+
+    panelShadowValid[display.channel] = true;
+    display.shownDirty = display.frameDirty;
+    clearDirtyRegion(display.frameDirty);
+
+    trace(TRACE_FLUSH, TRACE_END, pendingWindowCount);
+#if DISPLAY_ASYNC
+    if (displayIdle) {
+        if (pendingWindowCount > 0) {
+            xTaskNotifyGive(displayTaskHandle);
+        } else {
+            xSemaphoreGive(displayIdle);
+        }
+        return;
+    }
+#endif
+    EnergyState prev = energyEnter(ENERGY_I2C);
+    runDisplayTransfer();
+    energyEnter(prev);
+}
+
+#endif // DISPLAY_FLUSH_H
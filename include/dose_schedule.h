@@ -0,0 +1,219 @@
+#ifndef DOSE_SCHEDULE_H
+#define DOSE_SCHEDULE_H
+
+#include <Arduino.h>
+#include <sys/time.h>
+
+// When doses are due. The schedule is a table of times of day with the days
+// of the week they apply to, and the pills each dose is made of; each
+// occurrence is due from its time until its grace window runs out, or until
+// a dispense takes it. The wall clock is
+// local time, set over serial ('T' followed by seconds since 1970) and kept
+// by the RTC through deep sleep. Until it is set there are no doses.
+//
+// At first use the table is expanded into one sorted list of minutes into
+// the week, so the next deadline is a binary search.
+
+#define DOSE_DAY(d) (1 << (d))              // 0 = Sunday ... 6 = Saturday
+#define DOSE_EVERY_DAY 0x7F
+#define DOSE_WEEKDAYS 0x3E
+#define DOSE_MAX_SLOTS 32                   // Table entries times their days
+#define DOSE_CLOCK_VALID_AFTER 1577836800L  // 2020-01-01: anything earlier means the clock was never set
+#define DOSE_MAX_COMPARTMENTS 4             // Pill compartments of one dispenser (dispense_planner.h)
+
+#define MINUTES_PER_DAY 1440
+#define MINUTES_PER_WEEK (7 * MINUTES_PER_DAY)
+
+// Pills of one dose from each compartment, first compartment first
+struct DosePills {
+    uint8_t count[DOSE_MAX_COMPARTMENTS];
+};
+
+struct DoseTime {
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t days;       // DOSE_DAY() bits
+    uint8_t graceMin;   // Due for this long after the dose time
+    DosePills pills;
+};
+
+// Edit to match the prescription
+static constexpr DoseTime doseSchedule[] = {
+    {8, 0, DOSE_EVERY_DAY, 60, {{1}}},
+    {20, 0, DOSE_EVERY_DAY, 60, {{1}}},
+};
+
+struct DoseSlot {
+    uint16_t minuteOfWeek;
+    uint8_t graceMin;
+    uint8_t dose;       // Index into doseSchedule
+};
+
+enum DoseEvent : uint8_t {
+    DOSE_NO_CHANGE,
+    DOSE_NOW_DUE,
+    DOSE_MISSED
+};
+
+// What has happened to the occurrences. Kept in RTC memory so a deep sleep
+// does not forget that a dose was already taken.
+struct DoseState {
+    int32_t handledUntilMin;  // Occurrences starting at or before this minute are taken or missed
+    int32_t dueMin;           // Start of the occurrence being reminded about, or -1
+    uint16_t taken;
+    uint16_t missed;
+};
+
+static RTC_DATA_ATTR DoseState doseState = {0, -1, 0, 0};
+
+static DoseSlot doseSlots[DOSE_MAX_SLOTS];
+static uint8_t doseSlotCount = 0;
+
+inline void buildDoseSlots() {
+    doseSlotCount = 0;
+    for (uint8_t d = 0; d < sizeof(doseSchedule) / sizeof(doseSchedule[0]); d++) {
+        const DoseTime& dose = doseSchedule[d];
+        for (uint8_t day = 0; day < 7; day++) {
+            if (!(dose.days & DOSE_DAY(day)) || doseSlotCount >= DOSE_MAX_SLOTS) continue;
+            DoseSlot slot = {(uint16_t)(day * MINUTES_PER_DAY + dose.hour * 60 + dose.minute), dose.graceMin, d};
+            uint8_t i = doseSlotCount++;
+            while (i > 0 && doseSlots[i - 1].minuteOfWeek > slot.minuteOfWeek) {
+                doseSlots[i] = doseSlots[i - 1];
+                i--;
+            }
+            doseSlots[i] = slot;
+        }
+    }
+}
+
+// Local wall clock in whole minutes since 1970, or -1 if it was never set
+inline int32_t doseClockMinutes() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    if (tv.tv_sec < DOSE_CLOCK_VALID_AFTER) return -1;
+    return (int32_t)(tv.tv_sec / 60);
+}
+
+inline void setDoseClock(uint32_t epochSeconds) {
+    struct timeval tv = {(time_t)epochSeconds, 0};
+    settimeofday(&tv, nullptr);
+}
+
+// 1970-01-01 was a Thursday
+inline int32_t minuteOfWeek(int32_t epochMin) {
+    return (epochMin + 4 * MINUTES_PER_DAY) % MINUTES_PER_WEEK;
+}
+
+// First slot at or after a minute of the week, wrapping to the next week
+inline uint8_t nextSlotIndex(int32_t mow) {
+    uint8_t lo = 0, hi = doseSlotCount;
+    while (lo < hi) {
+        uint8_t mid = (lo + hi) / 2;
+        if (doseSlots[mid].minuteOfWeek < mow) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Start of the next occurrence at or after `nowMin`, with its slot
+inline int32_t nextOccurrence(int32_t nowMin, const DoseSlot** slot) {
+    int32_t mow = minuteOfWeek(nowMin);
+    uint8_t i = nextSlotIndex(mow);
+    int32_t weekStart = nowMin - mow;
+    if (i == doseSlotCount) {
+        i = 0;
+        weekStart += MINUTES_PER_WEEK;
+    }
+    *slot = &doseSlots[i];
+    return weekStart + doseSlots[i].minuteOfWeek;
+}
+
+// Latest occurrence whose grace window still covers `nowMin`, or -1. Grace
+// windows are checked a day back, which covers any uint8_t grace.
+inline int32_t dueOccurrence(int32_t nowMin) {
+    const DoseSlot* slot;
+    int32_t due = -1;
+    for (int32_t t = nextOccurrence(nowMin - MINUTES_PER_DAY, &slot); t <= nowMin; t = nextOccurrence(t + 1, &slot)) {
+        if (nowMin < t + slot->graceMin) due = t;
+    }
+    return due;
+}
+
+inline bool isDoseDue() {
+    return doseState.dueMin >= 0;
+}
+
+// Bring the due dose up to date with the clock; call from the dose task
+inline DoseEvent updateDoseSchedule() {
+    if (doseSlotCount == 0) buildDoseSlots();
+    int32_t nowMin = doseClockMinutes();
+    if (nowMin < 0 || doseSlotCount == 0) return DOSE_NO_CHANGE;
+
+    DoseEvent event = DOSE_NO_CHANGE;
+    if (isDoseDue() && dueOccurrence(nowMin) != doseState.dueMin) {
+        doseState.handledUntilMin = doseState.dueMin;
+        doseState.dueMin = -1;
+        doseState.missed++;
+        event = DOSE_MISSED;
+    }
+    int32_t due = dueOccurrence(nowMin);
+    if (!isDoseDue() && due > doseState.handledUntilMin) {
+        doseState.dueMin = due;
+        event = DOSE_NOW_DUE;
+    }
+    return event;
+}
+
+// Pills of the due dose, or nullptr when none is due
+inline const DosePills* dueDosePills() {
+    if (!isDoseDue()) return nullptr;
+    if (doseSlotCount == 0) buildDoseSlots();  // The due dose may be from before a deep sleep
+    const DoseSlot* slot;
+    nextOccurrence(doseState.dueMin, &slot);
+    return &doseSchedule[slot->dose].pills;
+}
+
+// A dispense took the due dose; false when none was due
+inline bool markDoseTaken() {
+    if (!isDoseDue()) return false;
+    doseState.handledUntilMin = doseState.dueMin;
+    doseState.dueMin = -1;
+    doseState.taken++;
+    return true;
+}
+
+// Seconds until the schedule next changes: the due dose expiring or the next
+// one starting. False when there is nothing to wait for.
+inline bool doseDeadline(uint32_t& waitSec) {
+    if (doseSlotCount == 0) buildDoseSlots();
+    int32_t nowMin = doseClockMinutes();
+    if (nowMin < 0 || doseSlotCount == 0) return false;
+
+    const DoseSlot* slot;
+    int32_t next;
+    if (isDoseDue()) {
+        nextOccurrence(doseState.dueMin, &slot);
+        next = doseState.dueMin + slot->graceMin;
+    } else {
+        next = nextOccurrence(nowMin + 1, &slot);
+    }
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    int64_t wait = (int64_t)next * 60 - tv.tv_sec;
+    waitSec = wait > 0 ? (uint32_t)wait : 0;
+    return true;
+}
+
+inline void printDoseReport(Print& out) {
+    int32_t nowMin = doseClockMinutes();
+    if (nowMin < 0) {
+        out.println("dose    clock not set");
+        return;
+    }
+    uint32_t waitSec = 0;
+    doseDeadline(waitSec);
+    out.printf("dose    %s, next change in %lu min, taken %u missed %u\n", isDoseDue() ? "due" : "not due",
+               (unsigned long)(waitSec / 60), doseState.taken, doseState.missed);
+}
+
+#endif // DOSE_SCHEDULE_H
@@ -0,0 +1,206 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+
+// Attributes wall time to what the CPU is doing and estimates the average
+// supply current from it. Code that changes state brackets itself with
+//     EnergyState prev = energyEnter(ENERGY_RENDER); ... energyEnter(prev);
+// so nested states (a flush inside a render) are charged correctly.
+// The counters live in RTC memory so they keep adding up across deep sleep.
+
+// Current model in microamps. Measure your board and override with -D.
+#ifndef ENERGY_ACTIVE_UA
+#define ENERGY_ACTIVE_UA 22000       // CPU running task and loop code
+#endif
+#ifndef ENERGY_RENDER_UA
+#define ENERGY_RENDER_UA 22000       // CPU drawing into the framebuffer
+#endif
+#ifndef ENERGY_I2C_UA
+#define ENERGY_I2C_UA 24000          // CPU waiting on a display transfer
+#endif
+#ifndef ENERGY_DELAY_UA
+#define ENERGY_DELAY_UA 18000        // Busy-wait in delay()
+#endif
+#ifndef ENERGY_LIGHT_SLEEP_UA
+#define ENERGY_LIGHT_SLEEP_UA 250
+#endif
+#ifndef ENERGY_DEEP_SLEEP_UA
+#define ENERGY_DEEP_SLEEP_UA 20      // Chip in deep sleep plus regulator quiescent current
+#endif
+#ifndef ENERGY_SERVO_UA
+#define ENERGY_SERVO_UA 150000       // Added while the servo is moving
+#endif
+#ifndef ENERGY_DISPLAY_UA
+#define ENERGY_DISPLAY_UA 6000       // OLED panel while it is on
+#endif
+#ifndef ENERGY_DISPLAY_OFF_UA
+#define ENERGY_DISPLAY_OFF_UA 10     // OLED panel after the display off command
+#endif
+#ifndef ENERGY_BATTERY_MAH
+#define ENERGY_BATTERY_MAH 1000      // For the battery life estimate
+#endif
+
+enum EnergyState : uint8_t {
+    ENERGY_ACTIVE,
+    ENERGY_RENDER,
+    ENERGY_I2C,
+    ENERGY_DELAY,
+    ENERGY_LIGHT_SLEEP,
+    ENERGY_DEEP_SLEEP,
+    ENERGY_STATE_COUNT
+};
+
+static const char* const energyStateNames[ENERGY_STATE_COUNT] = {
+    "active", "render", "i2c", "delay", "sleep", "deep"
+};
+
+static const uint32_t energyStateCurrent[ENERGY_STATE_COUNT] = {
+    ENERGY_ACTIVE_UA, ENERGY_RENDER_UA, ENERGY_I2C_UA, ENERGY_DELAY_UA, ENERGY_LIGHT_SLEEP_UA,
+    ENERGY_DEEP_SLEEP_UA
+};
+
+struct EnergyStats {
+    uint64_t stateUs[ENERGY_STATE_COUNT];
+    uint64_t servoUs;              // Overlaps the CPU states
+    uint64_t panelOffUs;           // Overlaps the CPU states
+    uint32_t timerWakeups;
+    uint32_t gpioWakeups;
+    uint32_t otherWakeups;
+    uint32_t deepSleeps;
+    uint64_t lastUs;               // energyNowUs() at the last state change
+    uint64_t servoSinceUs;
+    uint64_t panelOffSinceUs;
+    uint64_t deepSleepStartUs;     // RTC time when deep sleep was entered
+    EnergyState state;
+    bool servoOn;
+    bool panelOff;
+};
+
+static RTC_DATA_ATTR EnergyStats energyStats = {};
+
+// Time since boot. 64 bits: the 32 bit micros() wraps after 71 minutes, less
+// than a light sleep between doses can last
+inline uint64_t energyNowUs() {
+    return (uint64_t)esp_timer_get_time();
+}
+
+// RTC clock; unlike esp_timer it keeps counting through deep sleep
+inline uint64_t rtcTimeUs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+// Charge the time since the last change to the current state
+inline void energyUpdate() {
+    uint64_t now = energyNowUs();
+    energyStats.stateUs[energyStats.state] += now - energyStats.lastUs;
+    energyStats.lastUs = now;
+    if (energyStats.servoOn) {
+        energyStats.servoUs += now - energyStats.servoSinceUs;
+        energyStats.servoSinceUs = now;
+    }
+    if (energyStats.panelOff) {
+        energyStats.panelOffUs += now - energyStats.panelOffSinceUs;
+        energyStats.panelOffSinceUs = now;
+    }
+}
+
+// Switch state, returns the previous one for the caller to restore
+inline EnergyState energyEnter(EnergyState state) {
+    energyUpdate();
+    EnergyState prev = energyStats.state;
+    energyStats.state = state;
+    return prev;
+}
+
+inline void energyServo(bool on) {
+    energyUpdate();
+    energyStats.servoOn = on;
+    energyStats.servoSinceUs = energyNowUs();
+}
+
+inline void energyPanel(bool on) {
+    energyUpdate();
+    energyStats.panelOff = !on;
+    energyStats.panelOffSinceUs = energyNowUs();
+}
+
+// Call right before esp_deep_sleep_start()
+inline void energyDeepSleep() {
+    energyEnter(ENERGY_DEEP_SLEEP);
+    energyStats.deepSleeps++;
+    energyStats.deepSleepStartUs = rtcTimeUs();
+}
+
+// Call early on a deep sleep wake: charges the sleep and rebases on the new boot's clock
+inline void energyWake() {
+    uint64_t sleptUs = rtcTimeUs() - energyStats.deepSleepStartUs;
+    energyStats.stateUs[ENERGY_DEEP_SLEEP] += sleptUs;
+    if (energyStats.panelOff) energyStats.panelOffUs += sleptUs;
+    energyStats.state = ENERGY_ACTIVE;
+    energyStats.servoOn = false;
+    energyStats.lastUs = energyStats.servoSinceUs = energyStats.panelOffSinceUs = energyNowUs();
+}
+
+// Count the cause of the wakeup that just happened
+inline void energyCountWakeup() {
+    switch (esp_sleep_get_wakeup_cause()) {
+        case ESP_SLEEP_WAKEUP_TIMER: energyStats.timerWakeups++; break;
+        case ESP_SLEEP_WAKEUP_GPIO:  energyStats.gpioWakeups++; break;
+        default:                     energyStats.otherWakeups++; break;
+    }
+}
+
+inline void energyReset() {
+    EnergyState state = energyStats.state;
+    bool servoOn = energyStats.servoOn;
+    bool panelOff = energyStats.panelOff;
+    energyStats = {};
+    energyStats.state = state;
+    energyStats.servoOn = servoOn;
+    energyStats.panelOff = panelOff;
+    energyStats.lastUs = energyStats.servoSinceUs = energyStats.panelOffSinceUs = energyNowUs();
+}
+
+// Estimated average supply current since the last reset
+inline uint32_t energyAverageMicroamps() {
+    energyUpdate();
+    uint64_t totalUs = 0;
+    uint64_t charge = 0;  // uA * us
+    for (int s = 0; s < ENERGY_STATE_COUNT; s++) {
+        totalUs += energyStats.stateUs[s];
+        charge += energyStats.stateUs[s] * energyStateCurrent[s];
+    }
+    if (totalUs == 0) return 0;
+    charge += energyStats.servoUs * ENERGY_SERVO_UA;
+    uint64_t panelOffUs = min(energyStats.panelOffUs, totalUs);
+    charge += (totalUs - panelOffUs) * ENERGY_DISPLAY_UA + panelOffUs * ENERGY_DISPLAY_OFF_UA;
+    return (uint32_t)(charge / totalUs);
+}
+
+// Compact report: time per state, servo and panel off time, wakeups and the current estimate
+inline void printEnergyReport(Print& out) {
+    uint32_t avgUa = energyAverageMicroamps();
+    uint64_t totalUs = 0;
+    for (int s = 0; s < ENERGY_STATE_COUNT; s++) totalUs += energyStats.stateUs[s];
+    if (totalUs == 0) totalUs = 1;
+
+    for (int s = 0; s < ENERGY_STATE_COUNT; s++) {
+        out.printf("%-7s %10lu ms %6.2f%%\n", energyStateNames[s],
+                   (unsigned long)(energyStats.stateUs[s] / 1000), 100.0 * energyStats.stateUs[s] / totalUs);
+    }
+    out.printf("servo   %10lu ms %6.2f%%\n", (unsigned long)(energyStats.servoUs / 1000), 100.0 * energyStats.servoUs / totalUs);
+    out.printf("panel off %8lu ms %6.2f%%\n", (unsigned long)(energyStats.panelOffUs / 1000), 100.0 * energyStats.panelOffUs / totalUs);
+    out.printf("wakeups timer %lu gpio %lu other %lu, %lu deep sleeps\n", (unsigned long)energyStats.timerWakeups,
+               (unsigned long)energyStats.gpioWakeups, (unsigned long)energyStats.otherWakeups,
+               (unsigned long)energyStats.deepSleeps);
+    out.printf("avg %lu uA, ~%lu h on %u mAh\n", (unsigned long)avgUa,
+               (unsigned long)((uint64_t)ENERGY_BATTERY_MAH * 1000 / (avgUa ? avgUa : 1)), ENERGY_BATTERY_MAH);
+}
+
+#endif // ENERGY_H
@@ -0,0 +1,94 @@
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <Arduino.h>
+#include <new>
+
+// Steady-state heap check. Everything the firmware needs is allocated during
+// setup() and the deferred init; after that nothing may touch the heap, so
+// weeks of uptime cannot fragment it. armHeapGuard() marks the end of init
+// and checkHeapGuard() complains about anything allocated since:
+//
+//   - every operator new (String, std::function, containers) is counted by
+//     the replacements below, so even a block freed straight away is caught
+//   - plain malloc() from C code is caught when it changes the free heap
+//
+// HEAP_GUARD_ABORT turns the complaint into a crash, which the simulator
+// build uses so a stray allocation fails the run.
+//
+// The operator new/delete replacements are ordinary definitions: include
+// this header from main.cpp only.
+
+#ifndef HEAP_GUARD
+#define HEAP_GUARD 1
+#endif
+
+#ifndef HEAP_GUARD_ABORT
+#define HEAP_GUARD_ABORT 0
+#endif
+
+struct HeapGuard {
+    bool armed;
+    uint32_t freeBytes;      // Free heap when armed
+    uint32_t allocations;    // operator new calls since armed
+    size_t lastSize;         // Size of the latest of them
+    uint32_t violations;
+};
+
+static HeapGuard heapGuard = {};
+
+#if HEAP_GUARD
+static void* heapGuardAlloc(size_t size) {
+    if (heapGuard.armed) {
+        heapGuard.allocations++;
+        heapGuard.lastSize = size;
+    }
+    return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size) {
+    void* p = heapGuardAlloc(size);
+    if (!p) abort();  // Out of memory is fatal on the device anyway
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return heapGuardAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return heapGuardAlloc(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+#endif
+
+inline void armHeapGuard() {
+    if (!HEAP_GUARD) return;
+    heapGuard.armed = true;
+    heapGuard.freeBytes = ESP.getFreeHeap();
+    heapGuard.allocations = 0;
+}
+
+// Call once per loop pass
+inline void checkHeapGuard() {
+    if (!heapGuard.armed) return;
+    uint32_t freeBytes = ESP.getFreeHeap();
+    if (heapGuard.allocations == 0 && freeBytes == heapGuard.freeBytes) return;
+
+    heapGuard.violations++;
+    Serial.print("HEAP GUARD: ");
+    Serial.print((unsigned long)heapGuard.allocations);
+    Serial.print(" allocations in steady state, last ");
+    Serial.print((unsigned long)heapGuard.lastSize);
+    Serial.print(" bytes; free heap ");
+    Serial.print((unsigned long)heapGuard.freeBytes);
+    Serial.print(" -> ");
+    Serial.println((unsigned long)freeBytes);
+    if (HEAP_GUARD_ABORT) {
+        Serial.flush();
+        abort();
+    }
+    // Report each change once
+    heapGuard.freeBytes = freeBytes;
+    heapGuard.allocations = 0;
+}
+
+#endif // HEAP_GUARD_H
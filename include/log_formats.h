@@ -0,0 +1,44 @@
+#ifndef LOG_FORMATS_H
+#define LOG_FORMATS_H
+
+// Every message the firmware logs through deferred_log.h. A record carries
+// only the position in this list and the raw arguments; the text is put back
+// together on the host by tools/decode_log.py, from the table that
+// tools/log_formats.py extracts from this file at build time.
+//
+// Append only, and keep entries that are no longer logged: renumbering breaks
+// decoding of captures from older builds.
+// Arguments are integers; conversions are %u, %d, %x and %% (an l length
+// modifier is accepted and ignored).
+
+#define LOG_FORMATS(X) \
+    X(LOG_BOOT, "Boot: %u log formats, warm %u") \
+    X(LOG_DROPPED, "%u log records dropped, ring full") \
+    X(LOG_DISPLAY_INIT, "Initializing display...") \
+    X(LOG_DISPLAY_FAILED, "SSD1306 allocation failed") \
+    X(LOG_DISPLAY_READY, "Display initialized successfully!") \
+    X(LOG_FIRST_FRAME_COLD, "First frame %u us after power-on") \
+    X(LOG_FIRST_FRAME_WARM, "First frame %u us after wake") \
+    X(LOG_POWER_MODE, "Power saving mode active - CPU at 80MHz with light sleep") \
+    X(LOG_TOUCH_TAP, "Touch gesture: tap") \
+    X(LOG_TOUCH_DOUBLE_TAP, "Touch gesture: double tap") \
+    X(LOG_TOUCH_LONG_PRESS, "Touch gesture: long press") \
+    X(LOG_SERVO_START, "Starting servo sequence") \
+    X(LOG_SERVO_DONE, "Servo sequence complete") \
+    X(LOG_SHOWING_MESSAGE, "Showing message %u") \
+    X(LOG_TEXT_WIDTH, "Text width: %u") \
+    X(LOG_DANCE_START, "Starting dancing couple animation") \
+    X(LOG_SEQUENCE_DONE, "Touch sequence complete") \
+    X(LOG_IDLE_SLEEP, "Idle, sleeping until touched") \
+    X(LOG_DOSE_DUE, "Dose due") \
+    X(LOG_DOSE_MISSED, "Dose missed") \
+    X(LOG_DISPENSE_LOG_FAILED, "Dispense log: flash write failed") \
+    X(LOG_MESSAGE_POOL_FULL, "Message pool full, %u messages are never shown") \
+    X(LOG_DEBUG, "Touch pin %u, animating %u, interrupts %u") \
+    X(LOG_POWER_MANAGEMENT, "CPU %u-%u MHz, automatic light sleep %u") \
+    X(LOG_ASSETS_LOADED, "Asset bundle version %u loaded") \
+    X(LOG_DISPENSE_PLAN, "Dispense plan: %u pills, %u degrees, %u ms") \
+    X(LOG_DISPENSE_RATE, "Dispensed %u pills in %u ms, %u.%u pills per minute") \
+    X(LOG_DISPENSE_NO_COMPARTMENT, "%u pills of the dose are in compartments this dispenser does not have")
+
+#endif // LOG_FORMATS_H
@@ -0,0 +1,41 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <Arduino.h>
+#include "secrets.h"
+#include "scroll_strip.h"
+#include "deferred_log.h"
+#include "asset_bundle.h"
+
+// The messages with their lengths and scrolled widths: those of the asset
+// bundle, which has them worked out already, or else those of secrets.h,
+// worked out once during init. The texts stay in flash, mapped or where the
+// compiler put them; showing a message copies nothing and allocates nothing.
+
+#define MESSAGE_POOL_MAX 32
+
+static ScrollMessage messagePool[MESSAGE_POOL_MAX];
+static uint8_t messagePoolCount = 0;
+
+inline void initMessagePool() {
+    messagePoolCount = 0;
+    uint8_t count;
+    const AssetMessage* bundled = assetMessages(count);
+    if (bundled && count > 0) {
+        for (uint8_t i = 0; i < count && messagePoolCount < MESSAGE_POOL_MAX; i++) {
+            messagePool[messagePoolCount++] = {(const char*)assets.base + bundled[i].text, bundled[i].length, bundled[i].width};
+        }
+        if (count > MESSAGE_POOL_MAX) {
+            logEvent<LOG_MESSAGE_POOL_FULL>(count - MESSAGE_POOL_MAX);
+        }
+        return;
+    }
+    for (int i = 0; i < messageCount && messagePoolCount < MESSAGE_POOL_MAX; i++) {
+        messagePool[messagePoolCount++] = scrollMessage(messages[i]);
+    }
+    if (messageCount > MESSAGE_POOL_MAX) {
+        logEvent<LOG_MESSAGE_POOL_FULL>(messageCount - MESSAGE_POOL_MAX);
+    }
+}
+
+#endif // MESSAGE_POOL_H
@@ -0,0 +1,136 @@
+#ifndef POWER_MANAGEMENT_H
+#define POWER_MANAGEMENT_H
+
+#include <Arduino.h>
+#include <esp_pm.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <hal/gpio_ll.h>
+
+// esp_pm frequency scaling and automatic light sleep. The loop holds a CPU
+// lock while it runs and lets go of it only while it waits for the next
+// deadline or a touch, so every idle moment runs at POWER_MIN_MHZ, and
+// becomes a light sleep when no other lock is held either. The other locks
+// cover the hardware that needs its clock: I2C transfers to the panel and
+// the servo PWM, which both run off the APB clock.
+//
+// Automatic light sleep needs a core built with tickless idle
+// (CONFIG_FREERTOS_USE_TICKLESS_IDLE); the stock Arduino core is not, so
+// there the configuration is retried without it and the loop keeps doing its
+// own light sleeps (power.autoSleep stays false). Such a core should also
+// have CONFIG_PM_LIGHT_SLEEP_CALLBACKS, for power.lightSleeps.
+
+#ifndef POWER_AUTO_SLEEP
+#define POWER_AUTO_SLEEP 1
+#endif
+
+#define POWER_MAX_MHZ 160      // While the loop runs
+#define POWER_MIN_MHZ 40       // XTAL, while it waits
+#define POWER_SLEEP_MIN_MS 3   // Shorter waits stay awake (CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP)
+#define POWER_WAIT_FOREVER 0xFFFFFFFFUL
+
+enum PowerLock : uint8_t {
+    POWER_LOCK_LOOP,   // CPU at POWER_MAX_MHZ while the loop is not waiting
+    POWER_LOCK_I2C,    // APB clock for a panel transfer
+    POWER_LOCK_SERVO,  // APB clock, and so the pulse width, while the servo moves
+    POWER_LOCK_COUNT
+};
+
+struct PowerManagement {
+    bool dfs;          // esp_pm_configure() took the frequency range
+    bool autoSleep;    // ...and automatic light sleep
+    TaskHandle_t loopTask;
+    esp_pm_lock_handle_t locks[POWER_LOCK_COUNT];
+    uint8_t held[POWER_LOCK_COUNT];
+    volatile uint32_t lightSleeps;  // Automatic light sleeps so far, from the esp_pm exit callback
+};
+
+static PowerManagement power = {};
+
+inline void acquirePowerLock(PowerLock lock) {
+    if (!power.locks[lock]) return;
+    if (power.held[lock]++ == 0) esp_pm_lock_acquire(power.locks[lock]);
+}
+
+inline void releasePowerLock(PowerLock lock) {
+    if (!power.locks[lock] || power.held[lock] == 0) return;
+    if (--power.held[lock] == 0) esp_pm_lock_release(power.locks[lock]);
+}
+
+// Whether a peripheral keeps the chip from light sleep at the moment
+inline bool isPowerLocked() {
+    return power.held[POWER_LOCK_I2C] > 0 || power.held[POWER_LOCK_SERVO] > 0;
+}
+
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// Runs in the idle task on the way out of each automatic light sleep
+inline esp_err_t IRAM_ATTR onLightSleepExit(int64_t, void*) {
+    power.lightSleeps++;
+    return ESP_OK;
+}
+#endif
+
+// Call from the loop task, once nothing allocates any more locks after it
+inline void initPowerManagement() {
+    static const esp_pm_lock_type_t types[POWER_LOCK_COUNT] = {
+        ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX, ESP_PM_APB_FREQ_MAX
+    };
+    static const char* const names[POWER_LOCK_COUNT] = {"loop", "i2c", "servo"};
+
+    power.loopTask = xTaskGetCurrentTaskHandle();
+    esp_pm_config_esp32c3_t config = {};
+    config.max_freq_mhz = POWER_MAX_MHZ;
+    config.min_freq_mhz = POWER_MIN_MHZ;
+    config.light_sleep_enable = POWER_AUTO_SLEEP != 0;
+    esp_err_t err = esp_pm_configure(&config);
+    if (err == ESP_ERR_NOT_SUPPORTED && config.light_sleep_enable) {
+        config.light_sleep_enable = false;  // No tickless idle in this core
+        err = esp_pm_configure(&config);
+    }
+    power.dfs = err == ESP_OK;
+    power.autoSleep = power.dfs && config.light_sleep_enable;
+    if (!power.dfs) return;  // CONFIG_PM_ENABLE is off: fixed clock, locks not needed
+
+    for (uint8_t i = 0; i < POWER_LOCK_COUNT; i++) {
+        if (esp_pm_lock_create(types[i], 0, names[i], &power.locks[i]) != ESP_OK) power.locks[i] = nullptr;
+    }
+    acquirePowerLock(POWER_LOCK_LOOP);
+
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    if (power.autoSleep) {
+        esp_pm_sleep_cbs_register_config_t callbacks = {};
+        callbacks.exit_cb = onLightSleepExit;
+        esp_pm_light_sleep_register_cbs(&callbacks);
+    }
+#endif
+}
+
+// Block the loop until `ms` have passed or wakeLoopFromISR(); the CPU drops to
+// POWER_MIN_MHZ meanwhile, or sleeps. Returns whether it was woken.
+inline bool waitForWake(uint32_t ms) {
+    releasePowerLock(POWER_LOCK_LOOP);
+    bool woken = ulTaskNotifyTake(pdTRUE, ms == POWER_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(ms)) > 0;
+    acquirePowerLock(POWER_LOCK_LOOP);
+    return woken;
+}
+
+// Forget wakes that were given for work the loop has done since
+inline void clearWake() {
+    ulTaskNotifyTake(pdTRUE, 0);
+}
+
+// Set the level a pin wakes light sleep on from its interrupt, which that
+// same setting triggers. A plain register write: gpio_wakeup_enable() is not
+// in IRAM, and the interrupt also runs while a flash write has the cache off.
+inline void IRAM_ATTR setWakeLevelFromISR(int pin, bool high) {
+    gpio_ll_set_intr_type(&GPIO, (gpio_num_t)pin, high ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+}
+
+inline void IRAM_ATTR wakeLoopFromISR() {
+    if (!power.loopTask) return;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(power.loopTask, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+#endif // POWER_MANAGEMENT_H
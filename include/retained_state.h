@@ -0,0 +1,57 @@
+#ifndef RETAINED_STATE_H
+#define RETAINED_STATE_H
+
+#include <Arduino.h>
+#include <esp_system.h>
+#include "animations.h"
+#include "servo_motion.h"
+#include "display_flush.h"
+
+// State kept in RTC memory across deep sleep. Ordinary globals start over on
+// every wake; these are only trusted after a deep sleep wake with a matching
+// magic. The panel front buffers and power states (panelShadow,
+// panelShadowValid, panelAsleep) are retained by display_flush.h itself, since
+// the SSD1306 keeps its GDDRAM while the MCU sleeps.
+
+#define RETAINED_MAGIC 0x50494C4C  // "PILL"
+
+struct RetainedChannel {
+    int16_t servoAngle;         // Last commanded angle, so homing can be skipped
+    const AnimationDesc* anim;  // Timeline animation that was playing, or nullptr
+    uint8_t frameIndex;
+    uint16_t currentLoop;
+};
+
+struct RetainedState {
+    uint32_t magic;
+    RetainedChannel channels[CHANNEL_COUNT];
+};
+
+static RTC_DATA_ATTR RetainedState retained;
+
+// Call for every channel right before deep sleep, then saveRetainedState()
+inline void retainChannel(uint8_t channel, const ServoMotion& motion, const AnimationState& state) {
+    RetainedChannel& r = retained.channels[channel];
+    r.servoAngle = motion.angle;
+    r.anim = state.isAnimating ? state.anim : nullptr;
+    r.frameIndex = state.frameIndex;
+    r.currentLoop = state.currentLoop;
+}
+
+inline void saveRetainedState() {
+    waitForDisplayIdle();
+    retained.magic = RETAINED_MAGIC;
+}
+
+// True when this boot is a deep sleep wake and the retained state is usable
+inline bool isWarmBoot() {
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP || retained.magic != RETAINED_MAGIC) {
+        retained.magic = 0;
+        memset(panelShadowValid, 0, sizeof(panelShadowValid));
+        memset(panelAsleep, 0, sizeof(panelAsleep));
+        return false;
+    }
+    return true;
+}
+
+#endif // RETAINED_STATE_H
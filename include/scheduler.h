@@ -0,0 +1,142 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include "trace.h"
+
+// Small cooperative scheduler. Each task is a function with a deadline; the
+// main loop runs whatever is due and then sleeps until the earliest deadline.
+// Tasks re-arm themselves if they need to run again. A channel task is one
+// function registered once per channel, which it gets as its argument.
+
+#define SCHEDULER_MAX_TASKS 20
+#define SCHEDULER_MAX_SLEEP_MS 60000  // Upper bound on a sleep when nothing is armed
+
+static_assert(SCHEDULER_MAX_TASKS <= 32, "runDueTasks() keeps a bit per task");
+
+typedef void (*TaskFunction)();
+typedef void (*ChannelTaskFunction)(uint8_t channel);
+
+struct ScheduledTask {
+    TaskFunction func;
+    ChannelTaskFunction channelFunc;  // Called instead of func for a channel task
+    uint8_t channel;
+    const char* name;  // For trace dumps
+    uint32_t deadline;
+    bool armed;
+};
+
+struct Scheduler {
+    ScheduledTask tasks[SCHEDULER_MAX_TASKS];
+    uint8_t taskCount;
+    uint8_t sleepInhibit;  // > 0 while something (e.g. servo PWM) must keep running
+};
+
+static Scheduler scheduler = {};
+
+// Register a task, returns its id for scheduleAt()/scheduleIn()/cancelTask()
+inline int addTask(TaskFunction func, const char* name = "") {
+    if (scheduler.taskCount >= SCHEDULER_MAX_TASKS) return -1;
+    ScheduledTask& task = scheduler.tasks[scheduler.taskCount];
+    task.func = func;
+    task.channelFunc = nullptr;
+    task.name = name;
+    task.armed = false;
+    return scheduler.taskCount++;
+}
+
+// Register the instance of a channel task for `channel`
+inline int addChannelTask(ChannelTaskFunction func, uint8_t channel, const char* name = "") {
+    int id = addTask(nullptr, name);
+    if (id < 0) return -1;
+    scheduler.tasks[id].channelFunc = func;
+    scheduler.tasks[id].channel = channel;
+    return id;
+}
+
+inline void scheduleAt(int id, uint32_t deadline) {
+    scheduler.tasks[id].deadline = deadline;
+    scheduler.tasks[id].armed = true;
+}
+
+inline void scheduleIn(int id, uint32_t delayMs) {
+    scheduleAt(id, millis() + delayMs);
+}
+
+inline void cancelTask(int id) {
+    scheduler.tasks[id].armed = false;
+}
+
+inline bool isTaskScheduled(int id) {
+    return scheduler.tasks[id].armed;
+}
+
+// Run every task whose deadline has passed, each at most once per call. The
+// most overdue goes first: when the channels' frames are all due, the one
+// that has waited longest gets the bus next, rather than always the first
+// registered, so a busy bus delays every channel alike. A task is disarmed
+// before it runs.
+inline void runDueTasks() {
+    uint32_t ran = 0;
+    for (;;) {
+        uint32_t now = millis();
+        int next = -1;
+        for (uint8_t i = 0; i < scheduler.taskCount; i++) {
+            const ScheduledTask& task = scheduler.tasks[i];
+            if (!task.armed || (ran & (1UL << i)) || (int32_t)(now - task.deadline) < 0) continue;
+            if (next < 0 || (int32_t)(task.deadline - scheduler.tasks[next].deadline) < 0) next = i;
+        }
+        if (next < 0) return;
+
+        ScheduledTask& task = scheduler.tasks[next];
+        ran |= 1UL << next;
+        task.armed = false;
+        trace(TRACE_TASK, TRACE_BEGIN, next);
+        if (task.channelFunc) {
+            task.channelFunc(task.channel);
+        } else {
+            task.func();
+        }
+        trace(TRACE_TASK, TRACE_END, next);
+    }
+}
+
+// Milliseconds until the earliest armed deadline (0 if something is already due)
+inline uint32_t timeToNextTask() {
+    uint32_t now = millis();
+    uint32_t wait = SCHEDULER_MAX_SLEEP_MS;
+    for (uint8_t i = 0; i < scheduler.taskCount; i++) {
+        const ScheduledTask& task = scheduler.tasks[i];
+        if (!task.armed) continue;
+        int32_t remaining = (int32_t)(task.deadline - now);
+        if (remaining <= 0) return 0;
+        if ((uint32_t)remaining < wait) wait = remaining;
+    }
+    return wait;
+}
+
+// Task ids and names, ahead of a trace dump
+inline void printTaskNames(Print& out) {
+    for (uint8_t i = 0; i < scheduler.taskCount; i++) {
+        const ScheduledTask& task = scheduler.tasks[i];
+        if (task.channelFunc) {
+            out.printf("# task %u %s %u\n", i, task.name, task.channel);
+        } else {
+            out.printf("# task %u %s\n", i, task.name);
+        }
+    }
+}
+
+inline void inhibitSleep() {
+    scheduler.sleepInhibit++;
+}
+
+inline void allowSleep() {
+    if (scheduler.sleepInhibit > 0) scheduler.sleepInhibit--;
+}
+
+inline bool isSleepInhibited() {
+    return scheduler.sleepInhibit > 0;
+}
+
+#endif // SCHEDULER_H
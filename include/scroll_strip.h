@@ -0,0 +1,108 @@
+#ifndef SCROLL_STRIP_H
+#define SCROLL_STRIP_H
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include <glcdfont.c>  // The 5x7 font Adafruit_GFX uses; column-major, so already page-native
+#include "display_flush.h"
+#include "sprite_blit.h"
+
+#define SCROLL_TEXT_SIZE 2                        // Same size the GFX text renderer used
+#define SCROLL_CHAR_WIDTH (6 * SCROLL_TEXT_SIZE)  // 5 glyph columns + 1 spacing, scaled
+#define SCROLL_TEXT_Y 9                           // Centered vertically on the 32 px panel
+#define SCROLL_STRIP_MAX_CHARS 64                 // Longer messages are rendered a window at a time
+#define SCROLL_STRIP_PAGES 2                      // 8 font rows * 2 = 16 px
+#define SCROLL_CHARS_PER_SCREEN (SCREEN_WIDTH / SCROLL_CHAR_WIDTH)
+
+// Set to 1 to let the SSD1306 scroll the message with its horizontal scroll
+// engine while the MCU sleeps. Messages are shown one screen-width chunk per
+// revolution, since the controller can only rotate what is in its 128 columns.
+#ifndef SCROLL_HARDWARE
+#define SCROLL_HARDWARE 0
+#endif
+
+// SSD1306 frame period at reset defaults: Fosc / (D * K * MUX) ~ 213 Hz for MUX 32
+#define SSD1306_FRAME_US 4700
+#define SCROLL_HW_INTERVAL 0x07  // Scroll step every 2 frames, close to the 3 px / 30 ms software speed
+#define SCROLL_HW_REVOLUTION_MS ((unsigned long)SCREEN_WIDTH * 2 * SSD1306_FRAME_US / 1000)
+
+// A message ready to scroll: its length and the width it scrolls across, so
+// neither has to be worked out when it is shown
+struct ScrollMessage {
+    const char* text;
+    uint16_t length;
+    uint16_t width;
+};
+
+inline ScrollMessage scrollMessage(const char* text) {
+    size_t length = strlen(text);
+    return {text, (uint16_t)length, (uint16_t)(length * SCROLL_CHAR_WIDTH)};
+}
+
+// Message pre-rendered in page order; each frame is a windowed copy of it.
+// A message longer than SCROLL_STRIP_MAX_CHARS is rendered a strip at a
+// time, again further along whenever the visible part runs past the end of
+// the strip. Every channel has one, for the message it scrolls.
+struct ScrollStrip {
+    uint8_t data[SCROLL_STRIP_PAGES * SCROLL_STRIP_MAX_CHARS * SCROLL_CHAR_WIDTH];
+    PageSprite sprite;  // Over data, as wide as the last message rendered
+};
+
+// Each font column bit doubled vertically, one nibble at a time
+static const uint8_t scrollNibbleScale[16] = {
+    0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+    0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF
+};
+
+// Render `len` characters of `text` into the strip at size 2, returns the width in pixels
+inline uint16_t renderScrollStrip(ScrollStrip& strip, const char* text, int len) {
+    if (len > SCROLL_STRIP_MAX_CHARS) len = SCROLL_STRIP_MAX_CHARS;
+    const uint16_t width = len * SCROLL_CHAR_WIDTH;
+    strip.sprite = {width, SCROLL_STRIP_PAGES * 8, strip.data, SPRITE_RAW};
+
+    uint8_t* top = strip.data;
+    uint8_t* bottom = strip.data + width;
+    for (int i = 0; i < len; i++) {
+        unsigned char c = text[i];
+        if (c >= 176) c++;  // Adafruit_GFX skips a glyph unless cp437(true) is set
+        for (int col = 0; col < 6; col++) {
+            uint8_t line = col < 5 ? pgm_read_byte(&font[c * 5 + col]) : 0;
+            uint8_t hi = scrollNibbleScale[line >> 4];
+            uint8_t lo = scrollNibbleScale[line & 0x0F];
+            for (int s = 0; s < SCROLL_TEXT_SIZE; s++) {
+                *top++ = lo;
+                *bottom++ = hi;
+            }
+        }
+    }
+    return width;
+}
+
+// Length of the next chunk that fits on screen, broken at a space where possible
+inline int nextScrollChunk(const char* text, int length) {
+    if (length <= SCROLL_CHARS_PER_SCREEN) return length;
+    for (int i = SCROLL_CHARS_PER_SCREEN; i > 0; i--) {
+        if (text[i] == ' ') return i;
+    }
+    return SCROLL_CHARS_PER_SCREEN;
+}
+
+// Start a left scroll of the whole panel; the controller keeps rotating GDDRAM on its own
+inline void startHardwareScroll(RetainedSSD1306& display) {
+    const uint8_t cmds[] = {
+        SSD1306_LEFT_HORIZONTAL_SCROLL, 0x00,
+        0x00, SCROLL_HW_INTERVAL, SCREEN_PAGES - 1,
+        0x00, 0xFF,
+        SSD1306_ACTIVATE_SCROLL
+    };
+    sendDisplayCommands(display, cmds, sizeof(cmds));
+}
+
+// Stopping leaves GDDRAM rotated, so the panel shadow no longer matches
+inline void stopHardwareScroll(RetainedSSD1306& display) {
+    const uint8_t cmd = SSD1306_DEACTIVATE_SCROLL;
+    sendDisplayCommands(display, &cmd, 1);
+    invalidateDisplay(display);
+}
+
+#endif // SCROLL_STRIP_H
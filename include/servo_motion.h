@@ -0,0 +1,193 @@
+#ifndef SERVO_MOTION_H
+#define SERVO_MOTION_H
+
+#include <Arduino.h>
+#include <ESP32Servo.h>
+#include "scheduler.h"
+#include "energy.h"
+#include "power_management.h"
+
+// Non-blocking servo motion: a queue of waypoints, each reached along an eased
+// trajectory and followed by a dwell. updateServoMotion() is called from a
+// scheduler task at motion.nextTick and writes one position per servo frame.
+// Each servo has its own ServoMotion.
+
+#define SERVO_QUEUE_LEN 8
+#define SERVO_TICK_MS 20  // One update per 50 Hz servo frame
+
+enum MotionProfile : uint8_t {
+    MOTION_LINEAR,
+    MOTION_TRAPEZOID,  // Constant acceleration for the first and last third
+    MOTION_MIN_JERK    // 10t^3 - 15t^4 + 6t^5, smoothest start and stop
+};
+
+struct ServoWaypoint {
+    int16_t angle;
+    uint16_t moveMs;   // Time to travel from the previous waypoint
+    uint16_t dwellMs;  // Time to hold the angle before the next waypoint
+    MotionProfile profile;
+};
+
+typedef void (*MotionCallback)(void* context);
+
+struct ServoMotion {
+    Servo* servo;
+    int pin;
+    int minAngle;  // Targets are clamped to the range between the two,
+    int maxAngle;  // whichever is the larger (see servoTarget())
+    int angle;     // Last commanded angle
+    ServoWaypoint queue[SERVO_QUEUE_LEN];
+    uint8_t head;
+    uint8_t count;
+    bool active;
+    bool dwelling;
+    int fromAngle;
+    int toAngle;
+    uint32_t segmentStart;
+    uint32_t nextTick;
+    MotionCallback onComplete;
+    void* context;  // Passed to onComplete
+};
+
+static uint8_t servosMoving = 0;  // Across all servos, for the energy accounting
+
+inline void initServoMotion(ServoMotion& motion, Servo& servo, int pin, int minAngle, int maxAngle, int currentAngle) {
+    motion.servo = &servo;
+    motion.pin = pin;
+    motion.minAngle = minAngle;
+    motion.maxAngle = maxAngle;
+    motion.angle = currentAngle;
+}
+
+// The angle the servo is sent to for `angle`. The ends of the range may be
+// given either way round: constrain() with them inverted would swap them
+inline int servoTarget(const ServoMotion& motion, int angle) {
+    return constrain(angle, min(motion.minAngle, motion.maxAngle), max(motion.minAngle, motion.maxAngle));
+}
+
+// Fraction of the move completed at time fraction t, both in 1/1024ths
+inline int32_t motionProgress(MotionProfile profile, int32_t t) {
+    switch (profile) {
+        case MOTION_TRAPEZOID:
+            if (t <= 341) return 9 * t * t / 4096;
+            if (t <= 683) return 256 + 3 * (t - 341) / 2;
+            return 1024 - 9 * (1024 - t) * (1024 - t) / 4096;
+        case MOTION_MIN_JERK: {
+            int64_t t2 = (int64_t)t * t >> 10;
+            int64_t t3 = t2 * t >> 10;
+            int64_t t4 = t3 * t >> 10;
+            int64_t t5 = t4 * t >> 10;
+            return (int32_t)(10 * t3 - 15 * t4 + 6 * t5);
+        }
+        case MOTION_LINEAR:
+        default:
+            return t;
+    }
+}
+
+inline void writeServoAngle(ServoMotion& motion, int angle) {
+    if (angle == motion.angle) return;
+    motion.servo->write(angle);
+    motion.angle = angle;
+}
+
+// With frequency scaling the PWM only runs during a motion: once the lock is
+// released the APB clock drops and would stretch the pulses, so in between
+// the servo gets none and the horn stays put, as it does in light sleep
+inline void startServoPwm(ServoMotion& motion) {
+    inhibitSleep();  // Servo PWM stops in light sleep
+    acquirePowerLock(POWER_LOCK_SERVO);
+    if (!motion.servo->attached()) {
+        motion.servo->attach(motion.pin);
+        motion.servo->write(motion.angle);
+    }
+}
+
+inline void stopServoPwm(ServoMotion& motion) {
+    if (motion.active) return;
+    if (power.dfs) motion.servo->detach();
+}
+
+inline void beginServoSegment(ServoMotion& motion, uint32_t start) {
+    const ServoWaypoint& wp = motion.queue[motion.head];
+    motion.fromAngle = motion.angle;
+    motion.toAngle = servoTarget(motion, wp.angle);
+    motion.segmentStart = start;
+    motion.dwelling = false;
+    motion.nextTick = start;
+}
+
+// Append a waypoint; starts moving if the servo was idle. Returns false when the queue is full.
+inline bool queueServoWaypoint(ServoMotion& motion, const ServoWaypoint& wp) {
+    if (motion.count >= SERVO_QUEUE_LEN) return false;
+    motion.queue[(motion.head + motion.count) % SERVO_QUEUE_LEN] = wp;
+    motion.count++;
+    if (!motion.active) {
+        motion.active = true;
+        startServoPwm(motion);
+        if (servosMoving++ == 0) energyServo(true);
+        beginServoSegment(motion, millis());
+    }
+    return true;
+}
+
+// Queue a whole path; `onComplete(context)` runs once the last dwell has finished
+inline void startServoPath(ServoMotion& motion, const ServoWaypoint* path, uint8_t count,
+                           MotionCallback onComplete, void* context = nullptr) {
+    motion.onComplete = onComplete;
+    motion.context = context;
+    for (uint8_t i = 0; i < count; i++) {
+        queueServoWaypoint(motion, path[i]);
+    }
+}
+
+inline bool isServoMoving(const ServoMotion& motion) {
+    return motion.active;
+}
+
+// Advance the trajectory. Returns true while there is more to do at motion.nextTick.
+inline bool updateServoMotion(ServoMotion& motion) {
+    if (!motion.active) return false;
+    uint32_t now = millis();
+    const ServoWaypoint& wp = motion.queue[motion.head];
+
+    if (!motion.dwelling) {
+        uint32_t elapsed = now - motion.segmentStart;
+        if (elapsed >= wp.moveMs) {
+            // Arrived: hold until the dwell is over
+            writeServoAngle(motion, motion.toAngle);
+            motion.dwelling = true;
+            motion.nextTick = motion.segmentStart + wp.moveMs + wp.dwellMs;
+            return true;
+        }
+        int32_t t = (int32_t)(elapsed * 1024 / wp.moveMs);
+        int32_t travel = motion.toAngle - motion.fromAngle;
+        int32_t offset = (travel * motionProgress(wp.profile, t) + (travel >= 0 ? 512 : -512)) / 1024;
+        writeServoAngle(motion, motion.fromAngle + offset);
+        motion.nextTick = now + SERVO_TICK_MS;
+        return true;
+    }
+
+    // Dwell finished: move on to the next waypoint
+    uint32_t dwellEnd = motion.nextTick;
+    motion.head = (motion.head + 1) % SERVO_QUEUE_LEN;
+    motion.count--;
+    if (motion.count > 0) {
+        beginServoSegment(motion, dwellEnd);
+        return updateServoMotion(motion);
+    }
+
+    motion.active = false;
+    allowSleep();
+    releasePowerLock(POWER_LOCK_SERVO);
+    stopServoPwm(motion);
+    if (--servosMoving == 0) energyServo(false);
+    if (motion.onComplete) {
+        MotionCallback done = motion.onComplete;
+        motion.onComplete = nullptr;
+        done(motion.context);
+    }
+    return false;
+}
+
+#endif // SERVO_MOTION_H
@@ -0,0 +1,157 @@
+#ifndef SPRITE_BLIT_H
+#define SPRITE_BLIT_H
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include "display_flush.h"
+
+enum SpriteFormat : uint8_t {
+    SPRITE_RAW,  // width * pages bytes
+    SPRITE_RLE   // Run-length encoded, see blitRLE()
+};
+
+// 1bpp sprite stored in SSD1306 page order: one byte is 8 vertical pixels,
+// LSB on top, pages of `width` bytes one after another (see tools/convert_sprites.py)
+struct PageSprite {
+    uint16_t width;
+    uint8_t height;
+    const uint8_t* data;
+    SpriteFormat format;
+};
+
+// Multi-frame animation on a fixed canvas. Frame 0 is stored whole (`key`),
+// deltas[i] is the XOR that turns frame i into frame i + 1 (the last wraps to 0).
+// All streams are RLE.
+struct SpriteClip {
+    uint16_t width;
+    uint8_t height;
+    uint8_t frameCount;
+    const uint8_t* key;
+    const uint8_t* const* deltas;
+};
+
+static uint32_t framebufferByteOps = 0;  // Framebuffer bytes written by clears and blits
+
+// Clear the framebuffer, counted like the blits
+inline void clearFrame(RetainedSSD1306& display) {
+    display.clearDisplay();
+    framebufferByteOps += SCREEN_WIDTH * SCREEN_PAGES;
+}
+
+// OR a raw sprite into a page-ordered framebuffer. Rows below the sprite's height
+// are zero in the data, so whole bytes can be composited without masking.
+inline void blitSprite(uint8_t* buffer, const PageSprite& sprite, int x, int y) {
+    int c0 = x < 0 ? -x : 0;
+    int c1 = sprite.width;
+    if (x + c1 > SCREEN_WIDTH) c1 = SCREEN_WIDTH - x;
+    if (c0 >= c1) return;
+
+    const int pages = (sprite.height + 7) >> 3;
+    const int shift = y & 7;
+    const int firstPage = y >> 3;  // Arithmetic shift floors negative y
+
+    for (int sp = 0; sp < pages; sp++) {
+        const uint8_t* src = sprite.data + sp * sprite.width;
+        int dp = firstPage + sp;
+
+        if (shift == 0) {
+            // Page-aligned: straight byte copy-OR
+            if (dp < 0 || dp >= SCREEN_PAGES) continue;
+            uint8_t* dst = buffer + dp * SCREEN_WIDTH + x;
+            for (int c = c0; c < c1; c++) dst[c] |= pgm_read_byte(&src[c]);
+            framebufferByteOps += c1 - c0;
+            continue;
+        }
+
+        // Unaligned: each source byte straddles two destination pages
+        uint8_t* upper = (dp >= 0 && dp < SCREEN_PAGES) ? buffer + dp * SCREEN_WIDTH + x : nullptr;
+        uint8_t* lower = (dp + 1 >= 0 && dp + 1 < SCREEN_PAGES) ? buffer + (dp + 1) * SCREEN_WIDTH + x : nullptr;
+        for (int c = c0; c < c1; c++) {
+            uint8_t b = pgm_read_byte(&src[c]);
+            if (upper) upper[c] |= (uint8_t)(b << shift);
+            if (lower) lower[c] |= (uint8_t)(b >> (8 - shift));
+        }
+        framebufferByteOps += (c1 - c0) * ((upper != nullptr) + (lower != nullptr));
+    }
+}
+
+// Combine one sprite byte (column dx, sprite page sp) into the framebuffer
+inline void combineSpriteByte(uint8_t* buffer, int dx, int y, int sp, uint8_t b, bool invert) {
+    if (dx < 0 || dx >= SCREEN_WIDTH) return;
+    const int shift = y & 7;
+    const int dp = (y >> 3) + sp;
+    if (dp >= 0 && dp < SCREEN_PAGES) {
+        uint8_t& dst = buffer[dp * SCREEN_WIDTH + dx];
+        dst = invert ? dst ^ (uint8_t)(b << shift) : dst | (uint8_t)(b << shift);
+        framebufferByteOps++;
+    }
+    if (shift && dp + 1 >= 0 && dp + 1 < SCREEN_PAGES) {
+        uint8_t& dst = buffer[(dp + 1) * SCREEN_WIDTH + dx];
+        dst = invert ? dst ^ (uint8_t)(b >> (8 - shift)) : dst | (uint8_t)(b >> (8 - shift));
+        framebufferByteOps++;
+    }
+}
+
+// Unpack an RLE stream of width * pages page-order bytes straight into the
+// framebuffer, OR-ing it in (sprites) or XOR-ing it (clip deltas). Control
+// byte n < 0x80: n + 1 literal bytes follow; n >= 0x80: the next byte repeated
+// (n & 0x7F) + 3 times. Zero bytes change nothing under either operation, so
+// zero runs are skipped and only the columns actually touched are marked dirty.
+inline void blitRLE(RetainedSSD1306& display, const uint8_t* data, uint16_t width, uint8_t height, int x, int y, bool invert) {
+    uint8_t* buffer = display.getBuffer();
+    const int pages = (height + 7) >> 3;
+    const uint16_t total = width * pages;
+    uint16_t pos = 0;
+    int page = 0;
+    int dirty0 = width, dirty1 = -1;  // Touched columns of the current sprite page
+
+    while (pos < total) {
+        uint8_t control = pgm_read_byte(data++);
+        bool repeat = control & 0x80;
+        uint16_t count = repeat ? (control & 0x7F) + 3 : control + 1;
+        uint8_t value = repeat ? pgm_read_byte(data++) : 0;
+        if (repeat && value == 0) {
+            pos += count;
+            continue;
+        }
+        for (uint16_t i = 0; i < count; i++, pos++) {
+            uint8_t b = repeat ? value : pgm_read_byte(data++);
+            if (!b) continue;
+            int sp = pos / width;
+            int c = pos - sp * width;
+            if (sp != page) {
+                if (dirty0 <= dirty1) markDirty(display, x + dirty0, y + page * 8, dirty1 - dirty0 + 1, 8);
+                page = sp;
+                dirty0 = width;
+                dirty1 = -1;
+            }
+            combineSpriteByte(buffer, x + c, y, sp, b, invert);
+            if (c < dirty0) dirty0 = c;
+            if (c > dirty1) dirty1 = c;
+        }
+    }
+    if (dirty0 <= dirty1) markDirty(display, x + dirty0, y + page * 8, dirty1 - dirty0 + 1, 8);
+}
+
+// Blit a sprite into the display buffer and record the area it covers
+inline void drawSprite(RetainedSSD1306& display, const PageSprite& sprite, int x, int y) {
+    if (sprite.format == SPRITE_RLE) {
+        blitRLE(display, sprite.data, sprite.width, sprite.height, x, y, false);
+        return;
+    }
+    blitSprite(display.getBuffer(), sprite, x, y);
+    markDirty(display, x, y, sprite.width, sprite.height);
+}
+
+// Draw frame 0 of a clip into a cleared area
+inline void drawClipKey(RetainedSSD1306& display, const SpriteClip& clip, int x, int y) {
+    blitRLE(display, clip.key, clip.width, clip.height, x, y, false);
+}
+
+// Turn frame `frame` of a clip, already in the framebuffer, into the next one.
+// Only the bytes that differ between the two frames are touched.
+inline void advanceClip(RetainedSSD1306& display, const SpriteClip& clip, uint8_t frame, int x, int y) {
+    blitRLE(display, clip.deltas[frame], clip.width, clip.height, x, y, true);
+}
+
+#endif // SPRITE_BLIT_H
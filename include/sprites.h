@@ -0,0 +1,55 @@
+// Generated by tools/convert_sprites.py from images.h - do not edit.
+// Page-native layout: data[page * width + x], bit n is row page * 8 + n.
+// 297 bytes stored for 379 bytes of raw sprite data.
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#include "sprite_blit.h"
+
+static const uint8_t PROGMEM sprite_lady_data[] = {  // 18 bytes raw
+    0x00,0xc0,0x60,0xf6,0xef,0xf6,0x60,0xc0,0x00,0x33,0x3c,0xbe,0xff,0x3f,0xff,0xbe,
+    0x3c,0x33,
+};
+static const PageSprite sprite_lady = {9, 16, sprite_lady_data, SPRITE_RAW};
+
+static const uint8_t PROGMEM sprite_gentleman_data[] = {  // 14 bytes raw
+    0xe0,0xf0,0xf6,0xaf,0xf6,0xf0,0xe0,0x03,0x9f,0xff,0x06,0xff,0x9f,0x03,
+};
+static const PageSprite sprite_gentleman = {7, 16, sprite_gentleman_data, SPRITE_RAW};
+
+static const uint8_t PROGMEM sprite_small_heart_data[] = {  // 9 bytes raw
+    0x0c,0x12,0x21,0x41,0x82,0x41,0x21,0x12,0x0c,
+};
+static const PageSprite sprite_small_heart = {9, 8, sprite_small_heart_data, SPRITE_RAW};
+
+static const uint8_t PROGMEM sprite_big_heart_data[] = {  // 26 bytes raw
+    0x0c,0x1c,0x22,0x41,0x81,0x01,0x02,0x04,0x02,0x01,0x81,0x41,0x22,0x1c,0x81,0x00,
+    0x04,0x01,0x02,0x04,0x02,0x01,0x81,0x00,
+};
+static const PageSprite sprite_big_heart = {13, 11, sprite_big_heart_data, SPRITE_RLE};
+
+static const uint8_t PROGMEM clip_dancing_couple_key[] = {
+    0x85,0x00,0x04,0x80,0xc0,0xe0,0xc0,0x80,0x82,0x00,0x80,0x80,0x82,0x00,0x00,0x80,
+    0x80,0xc0,0x01,0x40,0x80,0x87,0x00,0x05,0x40,0xe0,0xf0,0x38,0x18,0xfd,0x80,0xff,
+    0x00,0xfd,0x81,0x0c,0x04,0x0e,0x07,0x01,0x03,0x0e,0x81,0x08,0x00,0xf9,0x80,0xfb,
+    0x04,0x38,0x1f,0x39,0xe0,0xc0,0x85,0x00,0x09,0x01,0x03,0x07,0x06,0xff,0xff,0x07,
+    0xff,0xff,0xe0,0x87,0x00,0x09,0x60,0x7c,0xff,0xff,0x7f,0xff,0xfe,0x76,0x07,0x01,
+    0x86,0x00,0x09,0x08,0x1c,0x1e,0x0f,0x07,0x03,0x00,0x3f,0x3f,0x0f,0x89,0x00,0x07,
+    0x3f,0x3f,0x00,0x03,0x07,0x0e,0x1c,0x18,0x82,0x00,
+};
+static const uint8_t PROGMEM clip_dancing_couple_delta_0[] = {
+    0x82,0x00,0x0c,0x0c,0xfe,0xfc,0x00,0xc0,0x20,0x20,0x60,0xe0,0xe0,0x00,0x00,0x80,
+    0x80,0x78,0x06,0xc0,0x00,0x00,0xc0,0xe0,0x60,0x00,0x80,0x40,0x01,0x78,0xfc,0x86,
+    0x00,0x1f,0x40,0xe0,0xf0,0x38,0x19,0xfe,0x00,0x01,0x02,0x02,0xf3,0xf1,0x12,0x0b,
+    0x0d,0x06,0x01,0x02,0x0d,0x0f,0x06,0x75,0xf3,0x06,0x04,0x06,0xf5,0x23,0x0e,0x29,
+    0xe0,0xc0,0x85,0x00,0x0b,0x01,0x03,0x07,0x06,0x7f,0x00,0xf8,0xc0,0xe0,0x1f,0xff,
+    0xe0,0x84,0x00,0x0a,0xc0,0x9c,0x83,0x00,0x00,0x80,0x01,0x06,0x16,0x07,0x01,0x86,
+    0x00,0x0c,0x08,0x1c,0x1e,0x7f,0x78,0x7c,0x0f,0x3f,0x3f,0x0f,0x7f,0x7f,0x7e,0x84,
+    0x00,0x09,0x7f,0x7f,0x40,0x3f,0x07,0x3c,0x78,0x7e,0x1c,0x18,0x82,0x00,
+};
+static const uint8_t* const clip_dancing_couple_deltas[] = {
+    clip_dancing_couple_delta_0, clip_dancing_couple_delta_0,
+};
+static constexpr SpriteClip clip_dancing_couple = {39, 32, 2, clip_dancing_couple_key, clip_dancing_couple_deltas};
+
+#endif // SPRITES_H
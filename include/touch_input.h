@@ -0,0 +1,242 @@
+#ifndef TOUCH_INPUT_H
+#define TOUCH_INPUT_H
+
+#include <Arduino.h>
+
+// Touch input in two halves. The pin interrupt only timestamps edges into a
+// single-producer/single-consumer ring (pushTouchEdge). The main loop drains
+// it in updateTouch(), debounces the edges and turns them into gestures,
+// separately for each touch pad:
+//
+//   tap         press shorter than TOUCH_LONG_PRESS_MS, no second press
+//               within TOUCH_DOUBLE_TAP_MS of the release
+//   double tap  second press within TOUCH_DOUBLE_TAP_MS, reported on its release
+//   long press  held for TOUCH_LONG_PRESS_MS, reported while still held
+//
+// Every gesture carries the time of the press that started it, so the
+// handler can measure touch-to-response latency.
+
+#define TOUCH_QUEUE_SIZE 16         // Edges buffered between polls, power of two
+#define TOUCH_DEBOUNCE_MS 30        // A level must hold this long to count
+#define TOUCH_LONG_PRESS_MS 1000
+#define TOUCH_DOUBLE_TAP_MS 250     // 0 reports taps on release, without double taps
+#define TOUCH_EVENT_QUEUE_SIZE 4    // Recognized gestures waiting for the handler
+
+enum TouchGesture : uint8_t {
+    TOUCH_NONE,
+    TOUCH_TAP,
+    TOUCH_DOUBLE_TAP,
+    TOUCH_LONG_PRESS
+};
+
+struct TouchEvent {
+    TouchGesture gesture;
+    uint32_t pressUs;  // micros() of the press the gesture is answered from
+};
+
+struct TouchEdge {
+    uint32_t us;
+    bool pressed;
+};
+
+enum TouchPhase : uint8_t {
+    TOUCH_IDLE,
+    TOUCH_DOWN,         // First press, not yet long
+    TOUCH_HELD,         // Long press reported, waiting for the release
+    TOUCH_WAIT_SECOND,  // Short press released, a second one makes a double tap
+    TOUCH_SECOND_DOWN
+};
+
+// Edge ring and gesture state of one touch pad
+struct TouchRecognizer {
+    // Ring buffer: the ISR only writes head, the loop only writes tail
+    TouchEdge queue[TOUCH_QUEUE_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+
+    bool raw;            // Level of the last edge seen
+    uint32_t rawSinceUs;
+    bool stable;         // Debounced level
+    TouchPhase phase;
+    uint32_t pressUs;    // First press of the gesture in progress
+    uint32_t secondUs;   // Second press of a double tap
+    uint32_t releaseUs;
+    TouchEvent events[TOUCH_EVENT_QUEUE_SIZE];
+    uint8_t eventCount;
+};
+
+// Totals over all pads
+struct TouchStats {
+    uint32_t taps;
+    uint32_t doubleTaps;
+    uint32_t longPresses;
+    uint32_t glitches;       // Level changes shorter than the debounce time
+    uint32_t latencyCount;
+    uint32_t latencyMinUs;
+    uint32_t latencyMaxUs;
+    uint64_t latencySumUs;
+};
+
+static TouchStats touchStats = {};
+static volatile uint16_t touchOverflows = 0;  // Edges dropped by a full ring
+
+// Called from the pin interrupt. Drops the edge when the loop has fallen a
+// whole queue behind; the level is resynchronised on the next edge.
+inline void IRAM_ATTR pushTouchEdge(TouchRecognizer& touch, uint32_t us, bool pressed) {
+    uint8_t head = touch.head;
+    if ((uint8_t)(head - __atomic_load_n(&touch.tail, __ATOMIC_ACQUIRE)) >= TOUCH_QUEUE_SIZE) {
+        touchOverflows++;
+        return;
+    }
+    touch.queue[head & (TOUCH_QUEUE_SIZE - 1)] = {us, pressed};
+    __atomic_store_n(&touch.head, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+}
+
+inline void emitTouch(TouchRecognizer& touch, TouchGesture gesture, uint32_t pressUs) {
+    if (touch.eventCount >= TOUCH_EVENT_QUEUE_SIZE) return;
+    touch.events[touch.eventCount++] = {gesture, pressUs};
+    switch (gesture) {
+        case TOUCH_TAP:        touchStats.taps++; break;
+        case TOUCH_DOUBLE_TAP: touchStats.doubleTaps++; break;
+        case TOUCH_LONG_PRESS: touchStats.longPresses++; break;
+        default: break;
+    }
+}
+
+// Gesture timeouts that expire at or before `us`
+inline void expireTouch(TouchRecognizer& touch, uint32_t us) {
+    if (touch.phase == TOUCH_DOWN && us - touch.pressUs >= TOUCH_LONG_PRESS_MS * 1000UL) {
+        emitTouch(touch, TOUCH_LONG_PRESS, touch.pressUs);
+        touch.phase = TOUCH_HELD;
+    } else if (touch.phase == TOUCH_WAIT_SECOND && us - touch.releaseUs >= TOUCH_DOUBLE_TAP_MS * 1000UL) {
+        emitTouch(touch, TOUCH_TAP, touch.pressUs);
+        touch.phase = TOUCH_IDLE;
+    }
+}
+
+// A debounced press or release at `us`
+inline void touchTransition(TouchRecognizer& touch, bool pressed, uint32_t us) {
+    expireTouch(touch, us);
+    touch.stable = pressed;
+    switch (touch.phase) {
+        case TOUCH_IDLE:
+            if (pressed) {
+                touch.phase = TOUCH_DOWN;
+                touch.pressUs = us;
+            }
+            break;
+        case TOUCH_DOWN:
+            if (!pressed) {
+                if (TOUCH_DOUBLE_TAP_MS > 0) {
+                    touch.phase = TOUCH_WAIT_SECOND;
+                    touch.releaseUs = us;
+                } else {
+                    emitTouch(touch, TOUCH_TAP, touch.pressUs);
+                    touch.phase = TOUCH_IDLE;
+                }
+            }
+            break;
+        case TOUCH_HELD:
+            if (!pressed) touch.phase = TOUCH_IDLE;
+            break;
+        case TOUCH_WAIT_SECOND:
+            if (pressed) {
+                touch.phase = TOUCH_SECOND_DOWN;
+                touch.secondUs = us;
+            }
+            break;
+        case TOUCH_SECOND_DOWN:
+            if (!pressed) {
+                emitTouch(touch, TOUCH_DOUBLE_TAP, touch.secondUs);
+                touch.phase = TOUCH_IDLE;
+            }
+            break;
+    }
+}
+
+// Confirm a raw level that has held for the debounce time by `us`
+inline void settleTouch(TouchRecognizer& touch, uint32_t us) {
+    if (touch.raw != touch.stable && us - touch.rawSinceUs >= TOUCH_DEBOUNCE_MS * 1000UL) {
+        touchTransition(touch, touch.raw, touch.rawSinceUs);
+    }
+}
+
+// Feed one raw edge; also used for levels sampled while the interrupt is
+// off, which must not be older than an edge still in the queue
+inline void touchLevelSample(TouchRecognizer& touch, bool pressed, uint32_t us) {
+    if (pressed == touch.raw) return;
+    settleTouch(touch, us);
+    if (touch.raw != touch.stable) touchStats.glitches++;  // Reverted before it settled
+    touch.raw = pressed;
+    touch.rawSinceUs = us;
+}
+
+// Drain the edge queue and run the recognizer up to `nowUs`
+inline void updateTouch(TouchRecognizer& touch, uint32_t nowUs) {
+    uint8_t head = __atomic_load_n(&touch.head, __ATOMIC_ACQUIRE);
+    while (touch.tail != head) {
+        TouchEdge edge = touch.queue[touch.tail & (TOUCH_QUEUE_SIZE - 1)];
+        __atomic_store_n(&touch.tail, (uint8_t)(touch.tail + 1), __ATOMIC_RELEASE);
+        touchLevelSample(touch, edge.pressed, edge.us);
+    }
+    settleTouch(touch, nowUs);
+    expireTouch(touch, nowUs);
+}
+
+// Pop the oldest recognized gesture
+inline bool nextTouchEvent(TouchRecognizer& touch, TouchEvent& ev) {
+    if (touch.eventCount == 0) return false;
+    ev = touch.events[0];
+    touch.eventCount--;
+    memmove(touch.events, touch.events + 1, touch.eventCount * sizeof(TouchEvent));
+    return true;
+}
+
+// Level of the last edge, for arming the wake on the opposite one
+inline bool isTouchPressed(const TouchRecognizer& touch) {
+    return touch.raw;
+}
+
+// Edges queued by the interrupt and not drained yet
+inline bool hasTouchEdges(const TouchRecognizer& touch) {
+    return touch.head != touch.tail;
+}
+
+// Microseconds until updateTouch() has something to settle or time out;
+// false when it only needs to run on the next edge
+inline bool touchDeadline(const TouchRecognizer& touch, uint32_t nowUs, uint32_t& waitUs) {
+    uint32_t due;
+    if (touch.raw != touch.stable) {
+        due = touch.rawSinceUs + TOUCH_DEBOUNCE_MS * 1000UL;
+    } else if (touch.phase == TOUCH_DOWN) {
+        due = touch.pressUs + TOUCH_LONG_PRESS_MS * 1000UL;
+    } else if (touch.phase == TOUCH_WAIT_SECOND) {
+        due = touch.releaseUs + TOUCH_DOUBLE_TAP_MS * 1000UL;
+    } else {
+        return false;
+    }
+    waitUs = (int32_t)(due - nowUs) > 0 ? due - nowUs : 0;
+    return true;
+}
+
+// Touch-to-response time of a handled gesture
+inline void recordTouchLatency(uint32_t us) {
+    if (touchStats.latencyCount == 0 || us < touchStats.latencyMinUs) touchStats.latencyMinUs = us;
+    if (us > touchStats.latencyMaxUs) touchStats.latencyMaxUs = us;
+    touchStats.latencySumUs += us;
+    touchStats.latencyCount++;
+}
+
+inline void printTouchReport(Print& out) {
+    out.printf("touch   tap %lu double %lu long %lu glitch %lu overflow %u\n",
+               (unsigned long)touchStats.taps, (unsigned long)touchStats.doubleTaps,
+               (unsigned long)touchStats.longPresses, (unsigned long)touchStats.glitches, (unsigned)touchOverflows);
+    if (touchStats.latencyCount) {
+        out.printf("latency min %lu avg %lu max %lu ms over %lu\n",
+                   (unsigned long)(touchStats.latencyMinUs / 1000),
+                   (unsigned long)(touchStats.latencySumUs / touchStats.latencyCount / 1000),
+                   (unsigned long)(touchStats.latencyMaxUs / 1000), (unsigned long)touchStats.latencyCount);
+    }
+}
+
+#endif // TOUCH_INPUT_H
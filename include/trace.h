@@ -0,0 +1,91 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// Tracepoints: esp_timer timestamps in a RAM ring, cheap enough for the
+// touch interrupt and the display transfer task. 'x' over serial dumps the
+// ring as text and starts it over; tools/trace_to_perfetto.py turns the dump
+// into a Chrome / Perfetto trace plus frame jitter and wake latency
+// histograms.
+//
+// The timestamps are microseconds, kept to 32 bits (about 71 minutes, the
+// converter takes differences modulo 2^32). Not CPU cycles: with frequency
+// scaling the clock runs at 40 or 160 MHz depending on the PM locks held, and
+// the cycle counter may stop in light sleep, while esp_timer keeps time
+// through both. The ring is in ordinary RAM, so a deep sleep starts it over.
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+#define TRACE_RING_SIZE 512  // Events kept, power of two; 12 bytes each
+
+enum TracePoint : uint8_t {
+    TRACE_TASK,        // Scheduler task run, value = task id
+    TRACE_RENDER,      // Drawing one animation step
+    TRACE_FRAME,       // Frame due, value = how late in us (signed)
+    TRACE_FLUSH,       // Dirty region to front buffer, value = windows
+    TRACE_I2C,         // Front buffer to panel, value = windows
+    TRACE_SLEEP,       // Light sleep, value = planned us at begin (0 = until touched), slept us at end
+    TRACE_TOUCH,       // Touch pin edge in the interrupt, value = level
+    TRACE_SERVO,       // Servo trajectory step, value = angle
+    TRACE_POINT_COUNT
+};
+
+// Names and the timeline track each point is drawn on
+static const char* const traceNames[TRACE_POINT_COUNT] = {
+    "task", "render", "frame", "flush", "i2c", "sleep", "touch", "servo"
+};
+static const char* const traceTracks[TRACE_POINT_COUNT] = {
+    "loop", "loop", "loop", "loop", "oled", "loop", "isr", "loop"
+};
+
+enum TracePhase : uint8_t {
+    TRACE_BEGIN = 'B',
+    TRACE_END = 'E',
+    TRACE_INSTANT = 'i'
+};
+
+struct TraceEvent {
+    uint32_t us;
+    uint32_t value;
+    TracePoint id;
+    TracePhase phase;
+};
+
+static TraceEvent traceRing[TRACE_RING_SIZE];
+static volatile uint32_t traceHead = 0;     // Events ever recorded since the last dump
+static volatile bool tracePaused = false;
+
+// Record one event; safe from interrupts and other tasks
+inline void IRAM_ATTR trace(TracePoint id, TracePhase phase, uint32_t value = 0) {
+    if (!TRACE_ENABLED || tracePaused) return;
+    uint32_t i = __atomic_fetch_add(&traceHead, 1, __ATOMIC_RELAXED);
+    TraceEvent& ev = traceRing[i & (TRACE_RING_SIZE - 1)];
+    ev.us = (uint32_t)esp_timer_get_time();
+    ev.value = value;
+    ev.id = id;
+    ev.phase = phase;
+}
+
+// Dump the ring, oldest first, and start over
+inline void dumpTrace(Print& out) {
+    tracePaused = true;
+    uint32_t head = traceHead;
+    uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    out.printf("# trace clock us events %lu lost %lu\n", (unsigned long)(head - first), (unsigned long)first);
+    for (uint8_t p = 0; p < TRACE_POINT_COUNT; p++) {
+        out.printf("# point %u %s %s\n", p, traceTracks[p], traceNames[p]);
+    }
+    for (uint32_t i = first; i < head; i++) {
+        const TraceEvent& ev = traceRing[i & (TRACE_RING_SIZE - 1)];
+        out.printf("T %lu %u %c %lu\n", (unsigned long)ev.us, ev.id, ev.phase, (unsigned long)ev.value);
+    }
+    out.println("# end");
+    traceHead = 0;
+    tracePaused = false;
+}
+
+#endif // TRACE_H
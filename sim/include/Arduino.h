@@ -0,0 +1,167 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Host shim for the subset of the Arduino core the firmware uses.
+// Time is virtual: it only advances through delay(), light sleep and the
+// per-loop() cost charged by the simulator driver. RTC_DATA_ATTR variables
+// are collected in their own section, which is all that survives a
+// simulated deep sleep (see sim_main.cpp).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include <sys/time.h>
+
+using std::min;
+using std::max;
+
+#define PROGMEM
+#define IRAM_ATTR
+#define RTC_DATA_ATTR __attribute__((section("sim_rtc_data")))
+#define RTC_NOINIT_ATTR RTC_DATA_ATTR
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define INPUT_PULLDOWN 0x09
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToInterrupt(p) (p)
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// Virtual clock and GPIO model (sim/src/sim_hal.cpp)
+uint64_t simMicros();
+void simAdvance(uint64_t us);
+uint32_t millis();  // 32 bits wide, as on the chip: micros() wraps after 71.6 minutes
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// RTC clock on the virtual time base, keeps running through deep sleep
+int simGettimeofday(struct timeval* tv, void* tz);
+int simSettimeofday(const struct timeval* tv, const void* tz);
+#undef gettimeofday
+#define gettimeofday simGettimeofday
+#undef settimeofday
+#define settimeofday simSettimeofday
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+int analogRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+class String {
+public:
+    String() {}
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    String(int v) : s_(std::to_string(v)) {}
+    String(unsigned int v) : s_(std::to_string(v)) {}
+    String(long v) : s_(std::to_string(v)) {}
+    String(unsigned long v) : s_(std::to_string(v)) {}
+    unsigned int length() const { return (unsigned int)s_.size(); }
+    const char* c_str() const { return s_.c_str(); }
+    char operator[](unsigned int i) const { return s_[i]; }
+    char charAt(unsigned int i) const { return s_[i]; }
+    bool operator==(const String& o) const { return s_ == o.s_; }
+    bool operator==(const char* o) const { return s_ == o; }
+    bool operator!=(const String& o) const { return s_ != o.s_; }
+    bool operator!=(const char* o) const { return s_ != o; }
+    String& operator+=(const String& o) { s_ += o.s_; return *this; }
+    String& operator+=(const char* o) { s_ += o; return *this; }
+    String& operator+=(char c) { s_ += c; return *this; }
+    String operator+(const String& o) const { return String(s_ + o.s_); }
+    String operator+(const char* o) const { return String(s_ + o); }
+    String substring(unsigned int from, unsigned int to) const { return String(s_.substr(from, to - from)); }
+    String substring(unsigned int from) const { return String(s_.substr(from)); }
+    void trim();
+    int toInt() const { return atoi(s_.c_str()); }
+    bool startsWith(const char* p) const { return s_.compare(0, strlen(p), p) == 0; }
+private:
+    std::string s_;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t n) {
+        for (size_t i = 0; i < n; i++) write(buf[i]);
+        return n;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return printf_("%d", v); }
+    size_t print(unsigned int v) { return printf_("%u", v); }
+    size_t print(long v) { return printf_("%ld", v); }
+    size_t print(unsigned long v) { return printf_("%lu", v); }
+    size_t print(unsigned long long v) { return printf_("%llu", v); }
+    size_t print(double v, int digits = 2) { return printf_("%.*f", digits, v); }
+    size_t print(bool v) { return printf_("%d", (int)v); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+protected:
+    size_t printf_(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+};
+
+// Serial output goes to stdout, input comes from a scripted queue
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    void end() {}
+    size_t write(uint8_t c) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    void flush();
+    int availableForWrite();
+    operator bool() const { return true; }
+    void setTimeout(unsigned long) {}
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+    uint32_t getFreeHeap();
+    uint32_t getCycleCount();
+    void restart();
+};
+extern EspClass ESP;
+
+#endif // SIM_ARDUINO_H
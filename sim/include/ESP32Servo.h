@@ -0,0 +1,35 @@
+#ifndef SIM_ESP32SERVO_H
+#define SIM_ESP32SERVO_H
+
+#include <Arduino.h>
+
+class ESP32PWM {
+public:
+    static void allocateTimer(int) {}
+};
+
+// Servo shim: records the commanded angle and every write
+class Servo {
+public:
+    int attach(int pin) { pin_ = pin; return 1; }
+    int attach(int pin, int, int) { return attach(pin); }
+    void detach() { pin_ = -1; }
+    bool attached() const { return pin_ >= 0; }
+    void setPeriodHertz(int hz) { hz_ = hz; }
+    void write(int angle);
+    void writeMicroseconds(int us) { write((us - 500) * 180 / 2000); }
+    int read() const { return angle_; }
+private:
+    int pin_ = -1;
+    int hz_ = 50;
+    int angle_ = 0;  // Last commanded angle
+};
+
+struct SimServoStats {
+    uint32_t writes;
+    uint32_t degreesTravelled;
+    int angle[32];  // Where each horn is, by pin, kept across reboots unlike the Servo object
+};
+extern SimServoStats simServoStats;
+
+#endif // SIM_ESP32SERVO_H
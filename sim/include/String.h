@@ -0,0 +1,3 @@
+// Case-insensitive filesystems resolve the firmware's <String.h> to the C
+// <string.h>; keep that behaviour on the host.
+#include <string.h>
@@ -0,0 +1,38 @@
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+#include <Arduino.h>
+
+#define I2C_BUFFER_LENGTH 128
+
+// I2C master shim. Transactions are delivered to the simulated devices on
+// endTransmission() and counted, including the time they would take on the bus.
+class TwoWire {
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    bool setClock(uint32_t frequency) { clock_ = frequency; return true; }
+    uint32_t getClock() { return clock_; }
+    size_t setBufferSize(size_t size) { bufferSize_ = size; return size; }
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* data, size_t n);
+    uint8_t endTransmission(bool sendStop = true);
+private:
+    uint32_t clock_ = 100000;
+    size_t bufferSize_ = I2C_BUFFER_LENGTH;
+    uint8_t address_ = 0;
+    uint8_t tx_[1024];
+    size_t txLen_ = 0;
+    bool overflow_ = false;
+};
+extern TwoWire Wire;
+
+// Bus statistics collected by the simulator
+struct SimI2CStats {
+    uint32_t transactions;
+    uint32_t bytes;        // Address + payload bytes on the wire
+    uint64_t busTimeUs;    // Time the transfers occupy the bus
+};
+extern SimI2CStats simI2CStats;
+
+#endif // SIM_WIRE_H
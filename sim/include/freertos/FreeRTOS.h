@@ -0,0 +1,19 @@
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <stdint.h>
+
+// Just enough FreeRTOS for the loop task's wait: there is one task, and
+// blocking it is idle time in the simulator (see ulTaskNotifyTake())
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef struct sim_task* TaskHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))  // 1 kHz tick
+#define portYIELD_FROM_ISR(...) ((void)0)
+
+#endif // SIM_FREERTOS_H
@@ -0,0 +1,12 @@
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+
+#include <freertos/FreeRTOS.h>
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+// Advances virtual time until notified or the timeout, light sleeping when
+// esp_pm allows it
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken);
+
+#endif // SIM_FREERTOS_TASK_H
@@ -0,0 +1,17 @@
+#ifndef SIM_HAL_GPIO_LL_H
+#define SIM_HAL_GPIO_LL_H
+
+#include <stdint.h>
+#include <driver/gpio.h>
+
+// The GPIO register block; the simulator keeps the pin state in sim_hal.cpp
+typedef struct {
+    int unused;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+// Interrupt type of a pin, which is also the level it wakes light sleep on
+void gpio_ll_set_intr_type(gpio_dev_t* hw, uint32_t gpio_num, gpio_int_type_t intr_type);
+
+#endif // SIM_HAL_GPIO_LL_H
@@ -0,0 +1,13 @@
+#ifndef SECRETS_H
+#define SECRETS_H
+
+// Sample message set for simulator builds. Device builds use the private
+// include/secrets.h, which has the same shape.
+static const char* messages[] = {
+    "Time for your pills!",
+    "You are doing great",
+    "Stay healthy, love you"
+};
+static const int messageCount = sizeof(messages) / sizeof(messages[0]);
+
+#endif // SECRETS_H
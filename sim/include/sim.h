@@ -0,0 +1,98 @@
+#ifndef SIM_H
+#define SIM_H
+
+// Simulator control API used by the host driver (sim/src/sim_main.cpp).
+// Nothing in the firmware includes this header.
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <stdio.h>
+
+#define SIM_PANEL_WIDTH 128
+#define SIM_PANEL_PAGES 8
+#define SIM_MAX_PANELS 8
+#define SIM_NO_MUX 0xFF
+
+// Model of one SSD1306 controller's GDDRAM and scroll engine
+struct SimPanel {
+    uint8_t address;
+    uint8_t muxPort;           // TCA9548A port it sits behind, SIM_NO_MUX when straight on the bus
+    uint8_t visiblePages;      // 4 for 128x32 modules
+    uint8_t ram[SIM_PANEL_PAGES][SIM_PANEL_WIDTH];
+    uint8_t colStart, colEnd, pageStart, pageEnd;
+    uint8_t col, page;
+    bool displayOn;
+    bool scrollActive;
+    bool scrollLeft;
+    uint8_t scrollStartPage, scrollEndPage;
+    uint8_t scrollInterval;    // Raw interval code from the scroll setup command
+    uint8_t scrollSetup[7];
+    uint64_t scrollStartUs;
+    uint32_t dataBytes;        // GDDRAM bytes written
+    uint32_t commandBytes;
+    uint32_t frameChanges;     // Number of writes that changed visible content
+};
+
+// Time
+void simReset();
+uint64_t simNowUs();
+// Call `hook` every `periodUs` of virtual time, including inside sleeps and delays
+void simSetTickHook(uint64_t periodUs, void (*hook)(uint64_t nowUs));
+// End of the run: a sleep that would wake after it ends there instead
+void simSetHorizon(uint64_t endUs);
+
+// Scripted GPIO level changes, delivered (with interrupts) as time advances
+void simScheduleTouch(uint64_t atUs, uint32_t holdMs, uint8_t pin);
+void simSetPin(uint8_t pin, int level);
+
+// Whether the core has tickless idle, which esp_pm needs for automatic light
+// sleep; the stock Arduino core does not (default: it does)
+void simSetTicklessIdle(bool enabled);
+
+// Serial input injected as if typed on the host console
+void simSerialInput(const char* text);
+// Binary input; returns how much fit in the receive buffer
+size_t simSerialInputBytes(const uint8_t* data, size_t len);
+
+// Fill a data partition from a file, as esptool write_flash would; the rest is erased
+bool simFlashLoad(const char* label, const char* path);
+
+// Panels on the bus. Panels are created on first access by address and,
+// behind the multiplexer, port.
+SimPanel* simPanel(uint8_t address, uint8_t muxPort = SIM_NO_MUX);
+int simPanelCount();
+SimPanel* simPanelAt(int index);  // In order of creation
+// A TCA9548A at `address`: a one byte write selects its ports, one bit each,
+// and only the panels behind a selected port see the bus
+void simAddMux(uint8_t address);
+void simPanelSnapshot(const SimPanel* panel, uint8_t* out);  // Visible pixels, page-major like the SSD1306 buffer
+bool simPanelWritePBM(const SimPanel* panel, const char* path);
+// Call `hook` after every I2C transaction that reached a panel
+void simSetFrameHook(void (*hook)(const SimPanel* panel, uint64_t nowUs));
+
+// Sleep / wake accounting
+struct SimPowerStats {
+    uint64_t lightSleepUs;
+    uint64_t deepSleepUs;
+    uint32_t lightSleeps;
+    uint32_t timerWakeups;
+    uint32_t gpioWakeups;
+    uint32_t deepSleeps;
+};
+extern SimPowerStats simPowerStats;
+
+// Deep sleep ends the current "boot". The driver catches this, saves the
+// simulated hardware with simSaveState() and re-executes itself, so every
+// ordinary global of the firmware starts over. simLoadState() then restores
+// the clock, pins, peripherals and the RTC_DATA_ATTR section before setup().
+struct SimDeepSleep {
+    uint64_t wakeAtUs;
+};
+void simSaveState(FILE* f);
+bool simLoadState(FILE* f);
+
+// Panel and bus half of the above (sim_display.cpp)
+void simSaveBusState(FILE* f);
+bool simLoadBusState(FILE* f);
+
+#endif // SIM_H
@@ -0,0 +1,455 @@
+// Adafruit_GFX / Adafruit_SSD1306 / Wire shims and the SSD1306 panel model
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_GFX.h>
+#include <Adafruit_SSD1306.h>
+#include "glcdfont.c"
+#include "sim.h"
+
+TwoWire Wire;
+SimI2CStats simI2CStats;
+
+#define SIM_SSD1306_FRAME_US 4700  // ~213 Hz frame rate with the default oscillator and MUX 32
+
+namespace {
+
+SimPanel panels[SIM_MAX_PANELS];
+int panelCount = 0;
+uint8_t muxAddress = 0;  // 0: no multiplexer
+uint8_t muxSelected = 0;  // Port bits last written to it
+void (*frameHook)(const SimPanel*, uint64_t) = nullptr;
+
+// Per-panel command parser state; commands may be split across transactions
+struct CommandParser {
+    uint8_t cmd[8];
+    uint8_t len;
+    uint8_t need;
+};
+CommandParser parsers[SIM_MAX_PANELS];
+
+uint8_t commandArgCount(uint8_t c) {
+    switch (c) {
+        case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+        case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+            return 1;
+        case 0x21: case 0x22: case 0xA3:
+            return 2;
+        case 0x29: case 0x2A:
+            return 5;
+        case 0x26: case 0x27:
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+uint32_t scrollStepUs(uint8_t interval) {
+    static const uint16_t frames[8] = {5, 64, 128, 256, 3, 4, 25, 2};
+    return (uint32_t)frames[interval & 7] * SIM_SSD1306_FRAME_US;
+}
+
+uint8_t scrollOffset(const SimPanel* p) {
+    if (!p->scrollActive) return 0;
+    uint64_t steps = (simNowUs() - p->scrollStartUs) / scrollStepUs(p->scrollInterval);
+    return (uint8_t)(steps % SIM_PANEL_WIDTH);
+}
+
+uint8_t visibleColumn(const SimPanel* p, int page, int x) {
+    if (!p->scrollActive || page < p->scrollStartPage || page > p->scrollEndPage) return x;
+    int off = scrollOffset(p);
+    return p->scrollLeft ? (x + off) % SIM_PANEL_WIDTH : (x - off + SIM_PANEL_WIDTH) % SIM_PANEL_WIDTH;
+}
+
+// Deactivating scroll leaves GDDRAM in its scrolled position
+void bakeScroll(SimPanel* p) {
+    uint8_t rotated[SIM_PANEL_WIDTH];
+    for (int page = p->scrollStartPage; page <= p->scrollEndPage && page < SIM_PANEL_PAGES; page++) {
+        for (int x = 0; x < SIM_PANEL_WIDTH; x++) rotated[x] = p->ram[page][visibleColumn(p, page, x)];
+        memcpy(p->ram[page], rotated, SIM_PANEL_WIDTH);
+    }
+    p->scrollActive = false;
+}
+
+void runCommand(SimPanel* p, const uint8_t* c) {
+    switch (c[0]) {
+        case 0x21:
+            p->colStart = c[1] & 0x7F;
+            p->colEnd = c[2] & 0x7F;
+            p->col = p->colStart;
+            break;
+        case 0x22:
+            p->pageStart = c[1] & 7;
+            p->pageEnd = c[2] > 7 ? 7 : c[2];
+            p->page = p->pageStart;
+            break;
+        case 0xAE: p->displayOn = false; break;
+        case 0xAF: p->displayOn = true; break;
+        case 0x26: case 0x27:
+            p->scrollLeft = (c[0] == 0x27);
+            p->scrollStartPage = c[2] & 7;
+            p->scrollInterval = c[3] & 7;
+            p->scrollEndPage = c[4] & 7;
+            break;
+        case 0x2F:
+            p->scrollActive = true;
+            p->scrollStartUs = simNowUs();
+            break;
+        case 0x2E:
+            if (p->scrollActive) bakeScroll(p);
+            break;
+        default:
+            break;
+    }
+}
+
+void panelCommand(int idx, uint8_t b) {
+    SimPanel* p = &panels[idx];
+    CommandParser& cp = parsers[idx];
+    p->commandBytes++;
+    if (cp.len == 0) {
+        cp.need = commandArgCount(b);
+    }
+    cp.cmd[cp.len++] = b;
+    if (cp.len > cp.need) {
+        runCommand(p, cp.cmd);
+        cp.len = 0;
+    }
+}
+
+void panelData(SimPanel* p, uint8_t b) {
+    if (p->ram[p->page][p->col] != b) p->frameChanges++;
+    p->ram[p->page][p->col] = b;
+    p->dataBytes++;
+    if (p->col >= p->colEnd) {
+        p->col = p->colStart;
+        p->page = (p->page >= p->pageEnd) ? p->pageStart : p->page + 1;
+    } else {
+        p->col++;
+    }
+}
+
+bool panelReachable(const SimPanel& p, uint8_t address) {
+    return p.address == address && (p.muxPort == SIM_NO_MUX || (muxSelected >> p.muxPort & 1));
+}
+
+} // namespace
+
+// ---- Panel model API --------------------------------------------------------
+
+SimPanel* simPanel(uint8_t address, uint8_t muxPort) {
+    for (int i = 0; i < panelCount; i++) {
+        if (panels[i].address == address && panels[i].muxPort == muxPort) return &panels[i];
+    }
+    if (panelCount >= SIM_MAX_PANELS) return nullptr;
+    SimPanel* p = &panels[panelCount];
+    memset(p, 0, sizeof(*p));
+    memset(&parsers[panelCount], 0, sizeof(parsers[panelCount]));
+    p->address = address;
+    p->muxPort = muxPort;
+    p->visiblePages = 4;
+    p->colEnd = SIM_PANEL_WIDTH - 1;
+    p->pageEnd = SIM_PANEL_PAGES - 1;
+    panelCount++;
+    return p;
+}
+
+int simPanelCount() { return panelCount; }
+
+SimPanel* simPanelAt(int index) { return index >= 0 && index < panelCount ? &panels[index] : nullptr; }
+
+void simAddMux(uint8_t address) {
+    muxAddress = address;
+    muxSelected = 0;
+}
+
+void simPanelSnapshot(const SimPanel* panel, uint8_t* out) {
+    for (int page = 0; page < panel->visiblePages; page++) {
+        for (int x = 0; x < SIM_PANEL_WIDTH; x++) {
+            out[page * SIM_PANEL_WIDTH + x] = panel->displayOn ? panel->ram[page][visibleColumn(panel, page, x)] : 0;
+        }
+    }
+}
+
+void simSetFrameHook(void (*hook)(const SimPanel* panel, uint64_t nowUs)) {
+    frameHook = hook;
+}
+
+bool simPanelWritePBM(const SimPanel* panel, const char* path) {
+    uint8_t pix[SIM_PANEL_PAGES * SIM_PANEL_WIDTH];
+    simPanelSnapshot(panel, pix);
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    int h = panel->visiblePages * 8;
+    fprintf(f, "P1\n%d %d\n", SIM_PANEL_WIDTH, h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < SIM_PANEL_WIDTH; x++) {
+            fputc((pix[(y >> 3) * SIM_PANEL_WIDTH + x] >> (y & 7)) & 1 ? '1' : '0', f);
+            fputc(x == SIM_PANEL_WIDTH - 1 ? '\n' : ' ', f);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+void simSaveBusState(FILE* f) {
+    fwrite(&panelCount, sizeof(panelCount), 1, f);
+    fwrite(panels, sizeof(SimPanel), panelCount, f);
+    fwrite(parsers, sizeof(CommandParser), panelCount, f);
+    fwrite(&muxAddress, sizeof(muxAddress), 1, f);
+    fwrite(&muxSelected, sizeof(muxSelected), 1, f);
+    fwrite(&simI2CStats, sizeof(simI2CStats), 1, f);
+}
+
+bool simLoadBusState(FILE* f) {
+    if (fread(&panelCount, sizeof(panelCount), 1, f) != 1 || panelCount > SIM_MAX_PANELS) return false;
+    return fread(panels, sizeof(SimPanel), panelCount, f) == (size_t)panelCount
+        && fread(parsers, sizeof(CommandParser), panelCount, f) == (size_t)panelCount
+        && fread(&muxAddress, sizeof(muxAddress), 1, f) == 1
+        && fread(&muxSelected, sizeof(muxSelected), 1, f) == 1
+        && fread(&simI2CStats, sizeof(simI2CStats), 1, f) == 1;
+}
+
+// ---- Wire -------------------------------------------------------------------
+
+bool TwoWire::begin(int, int, uint32_t frequency) {
+    if (frequency) clock_ = frequency;
+    return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    address_ = address;
+    txLen_ = 0;
+    overflow_ = false;
+}
+
+size_t TwoWire::write(uint8_t b) {
+    if (txLen_ >= bufferSize_ || txLen_ >= sizeof(tx_)) {
+        overflow_ = true;
+        return 0;
+    }
+    tx_[txLen_++] = b;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (!write(data[i])) return i;
+    }
+    return n;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+    // Each byte is 9 clocks; add start/stop and the address byte
+    uint64_t busUs = ((uint64_t)(txLen_ + 1) * 9 + 2) * 1000000ULL / clock_;
+    simI2CStats.transactions++;
+    simI2CStats.bytes += txLen_ + 1;
+    simI2CStats.busTimeUs += busUs;
+    simAdvance(busUs);
+
+    if (muxAddress && address_ == muxAddress) {
+        if (txLen_) muxSelected = tx_[txLen_ - 1];
+        return overflow_ ? 1 : 0;
+    }
+    // Panels at the same address on two selected ports both take the write
+    bool acked = false;
+    for (int idx = 0; idx < panelCount; idx++) {
+        if (!panelReachable(panels[idx], address_)) continue;
+        acked = true;
+        // Control byte: Co (bit 7) = one byte follows then another control byte, D/C# (bit 6) = data
+        size_t i = 0;
+        while (i < txLen_) {
+            uint8_t control = tx_[i++];
+            bool data = (control & 0x40) != 0;
+            bool single = (control & 0x80) != 0;
+            size_t end = single ? (i + 1 < txLen_ ? i + 1 : txLen_) : txLen_;
+            for (; i < end; i++) {
+                if (data) panelData(&panels[idx], tx_[i]);
+                else panelCommand(idx, tx_[i]);
+            }
+        }
+        if (txLen_ && frameHook) frameHook(&panels[idx], simNowUs());
+    }
+    if (!acked) return 2;  // Address NACK
+    return overflow_ ? 1 : 0;
+}
+
+// ---- Adafruit_GFX -----------------------------------------------------------
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    for (int16_t i = x; i < x + w; i++) {
+        for (int16_t j = y; j < y + h; j++) drawPixel(i, j, color);
+    }
+}
+
+void Adafruit_GFX::drawBitmap(int16_t x, int16_t y, const uint8_t bitmap[], int16_t w, int16_t h, uint16_t color) {
+    int16_t byteWidth = (w + 7) / 8;
+    uint8_t b = 0;
+    for (int16_t j = 0; j < h; j++, y++) {
+        for (int16_t i = 0; i < w; i++) {
+            if (i & 7) b <<= 1;
+            else b = pgm_read_byte(&bitmap[j * byteWidth + i / 8]);
+            if (b & 0x80) drawPixel(x + i, y, color);
+        }
+    }
+}
+
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size_x, uint8_t size_y) {
+    if ((x >= _width) || (y >= _height) || ((x + 6 * size_x - 1) < 0) || ((y + 8 * size_y - 1) < 0)) return;
+    for (int8_t i = 0; i < 5; i++) {
+        uint8_t line = font[c * 5 + i];
+        for (int8_t j = 0; j < 8; j++, line >>= 1) {
+            if (line & 1) {
+                if (size_x == 1 && size_y == 1) drawPixel(x + i, y + j, color);
+                else fillRect(x + i * size_x, y + j * size_y, size_x, size_y, color);
+            } else if (bg != color) {
+                if (size_x == 1 && size_y == 1) drawPixel(x + i, y + j, bg);
+                else fillRect(x + i * size_x, y + j * size_y, size_x, size_y, bg);
+            }
+        }
+    }
+    if (bg != color) fillRect(x + 5 * size_x, y, size_x, 8 * size_y, bg);
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+    if (c == '\n') {
+        cursor_x = 0;
+        cursor_y += textsize_y * 8;
+    } else if (c != '\r') {
+        if (wrap && ((cursor_x + textsize_x * 6) > _width)) {
+            cursor_x = 0;
+            cursor_y += textsize_y * 8;
+        }
+        drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize_x, textsize_y);
+        cursor_x += textsize_x * 6;
+    }
+    return 1;
+}
+
+void Adafruit_GFX::getTextBounds(const char* str, int16_t x, int16_t y, int16_t* x1, int16_t* y1, uint16_t* w, uint16_t* h) {
+    int16_t minx = _width, miny = _height, maxx = -1, maxy = -1;
+    for (; *str; str++) {
+        if (*str == '\n') {
+            x = 0;
+            y += textsize_y * 8;
+            continue;
+        }
+        if (*str == '\r') continue;
+        if (wrap && ((x + textsize_x * 6) > _width)) {
+            x = 0;
+            y += textsize_y * 8;
+        }
+        int16_t x2 = x + textsize_x * 6 - 1, y2 = y + textsize_y * 8 - 1;
+        if (x2 > maxx) maxx = x2;
+        if (y2 > maxy) maxy = y2;
+        if (x < minx) minx = x;
+        if (y < miny) miny = y;
+        x += textsize_x * 6;
+    }
+    *x1 = minx;
+    *y1 = miny;
+    *w = maxx >= minx ? maxx - minx + 1 : 0;
+    *h = maxy >= miny ? maxy - miny + 1 : 0;
+}
+
+// ---- Adafruit_SSD1306 -------------------------------------------------------
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire* twi, int8_t)
+    : Adafruit_GFX(w, h), wire(twi) {}
+
+Adafruit_SSD1306::~Adafruit_SSD1306() { free(buffer); }
+
+// Like the library, run transfers at 400 kHz and restore 100 kHz afterwards
+void Adafruit_SSD1306::ssd1306_commandList(const uint8_t* c, uint8_t n) {
+    wire->setClock(400000);
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00);
+    wire->write(c, n);
+    wire->endTransmission();
+    wire->setClock(100000);
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c) {
+    ssd1306_commandList(&c, 1);
+}
+
+bool Adafruit_SSD1306::begin(uint8_t, uint8_t addr, bool, bool) {
+    if (!buffer && !(buffer = (uint8_t*)malloc(WIDTH * ((HEIGHT + 7) / 8)))) return false;
+    clearDisplay();
+    i2caddr = addr ? addr : ((HEIGHT == 32) ? 0x3C : 0x3D);
+    const uint8_t init[] = {
+        SSD1306_DISPLAYOFF, SSD1306_SETDISPLAYCLOCKDIV, 0x80, SSD1306_SETMULTIPLEX, (uint8_t)(HEIGHT - 1),
+        SSD1306_SETDISPLAYOFFSET, 0x00, SSD1306_SETSTARTLINE, SSD1306_CHARGEPUMP, 0x14,
+        SSD1306_MEMORYMODE, 0x00, SSD1306_SEGREMAP | 0x1, SSD1306_COMSCANDEC,
+        SSD1306_SETCOMPINS, 0x02, SSD1306_SETCONTRAST, 0x8F, SSD1306_SETPRECHARGE, 0xF1,
+        SSD1306_SETVCOMDETECT, 0x40, SSD1306_DISPLAYALLON_RESUME, SSD1306_NORMALDISPLAY,
+        SSD1306_DEACTIVATE_SCROLL, SSD1306_DISPLAYON
+    };
+    ssd1306_commandList(init, sizeof(init));
+    for (int i = 0; i < panelCount; i++) {
+        if (panelReachable(panels[i], i2caddr)) panels[i].visiblePages = HEIGHT / 8;
+    }
+    return true;
+}
+
+void Adafruit_SSD1306::display() {
+    const uint8_t dlist[] = {SSD1306_PAGEADDR, 0, 0xFF, SSD1306_COLUMNADDR, 0, (uint8_t)(WIDTH - 1)};
+    ssd1306_commandList(dlist, sizeof(dlist));
+    uint16_t count = WIDTH * ((HEIGHT + 7) / 8);
+    uint8_t* ptr = buffer;
+    const uint16_t chunk = I2C_BUFFER_LENGTH - 1;
+    wire->setClock(400000);
+    while (count) {
+        uint16_t n = count < chunk ? count : chunk;
+        wire->beginTransmission(i2caddr);
+        wire->write((uint8_t)0x40);
+        wire->write(ptr, n);
+        wire->endTransmission();
+        ptr += n;
+        count -= n;
+    }
+    wire->setClock(100000);
+}
+
+void Adafruit_SSD1306::clearDisplay() {
+    memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+}
+
+void Adafruit_SSD1306::invertDisplay(bool i) {
+    ssd1306_command(i ? SSD1306_INVERTDISPLAY : SSD1306_NORMALDISPLAY);
+}
+
+void Adafruit_SSD1306::dim(bool dim) {
+    const uint8_t cmds[] = {SSD1306_SETCONTRAST, (uint8_t)(dim ? 0 : 0x8F)};
+    ssd1306_commandList(cmds, sizeof(cmds));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
+    if (x < 0 || x >= width() || y < 0 || y >= height()) return;
+    uint8_t& b = buffer[x + (y / 8) * WIDTH];
+    uint8_t bit = 1 << (y & 7);
+    switch (color) {
+        case SSD1306_WHITE: b |= bit; break;
+        case SSD1306_BLACK: b &= ~bit; break;
+        case SSD1306_INVERSE: b ^= bit; break;
+    }
+}
+
+bool Adafruit_SSD1306::getPixel(int16_t x, int16_t y) {
+    if (x < 0 || x >= width() || y < 0 || y >= height()) return false;
+    return buffer[x + (y / 8) * WIDTH] & (1 << (y & 7));
+}
+
+void Adafruit_SSD1306::startscrollright(uint8_t start, uint8_t stop) {
+    const uint8_t cmds[] = {SSD1306_RIGHT_HORIZONTAL_SCROLL, 0x00, start, 0x00, stop, 0x00, 0xFF, SSD1306_ACTIVATE_SCROLL};
+    ssd1306_commandList(cmds, sizeof(cmds));
+}
+
+void Adafruit_SSD1306::startscrollleft(uint8_t start, uint8_t stop) {
+    const uint8_t cmds[] = {SSD1306_LEFT_HORIZONTAL_SCROLL, 0x00, start, 0x00, stop, 0x00, 0xFF, SSD1306_ACTIVATE_SCROLL};
+    ssd1306_commandList(cmds, sizeof(cmds));
+}
+
+void Adafruit_SSD1306::stopscroll() {
+    ssd1306_command(SSD1306_DEACTIVATE_SCROLL);
+}
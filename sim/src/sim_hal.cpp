@@ -0,0 +1,722 @@
+// Virtual clock, GPIO, serial, sleep and servo models for the host simulator
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <vector>
+#include <ESP32Servo.h>
+#include <esp_sleep.h>
+#include <esp_pm.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
+#include <freertos/task.h>
+#include "sim.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+SimPowerStats simPowerStats;
+SimServoStats simServoStats;
+SimFlashStats simFlashStats;
+bool simQuietSerial = false;
+
+namespace {
+
+struct PinEvent {
+    uint64_t atUs;
+    uint8_t pin;
+    int level;
+};
+
+uint64_t nowUs = 0;
+uint64_t bootUs = 0;  // When the current boot started
+esp_reset_reason_t resetReason = ESP_RST_POWERON;
+int pinLevel[32];
+void (*pinIsr[32])(void);
+void (*pinIsrWithArg[32])(void*);
+void* pinIsrArg[32];
+int pinIsrMode[32];
+bool pinIntrMasked[32];
+int8_t pinWakeLevel[32];  // Level that wakes from sleep, -1 for none
+bool gpioWakeEnabled = false;
+bool timerWakeEnabled = false;
+uint64_t timerWakeUs = 0;
+uint64_t horizonUs = UINT64_MAX;
+int64_t rtcOffsetUs = 0;  // Wall clock minus virtual time, set by settimeofday()
+esp_sleep_wakeup_cause_t lastWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+uint64_t gpioWakeStatus = 0;  // Pins at their wake level when the last GPIO wake happened
+std::vector<PinEvent> pinEvents;   // Kept sorted by time
+char serialInput[1024];  // Ring of typed characters; fixed so reading it never frees
+size_t serialHead = 0, serialTail = 0;
+uint32_t cpuMhz = 160;
+uint64_t cycleBase = 0;    // Cycles counted up to cycleBaseUs, at the clocks before the last change
+uint64_t cycleBaseUs = 0;
+uint32_t heapTaken = 0;    // By the simulated ESP-IDF itself, for ESP.getFreeHeap()
+
+#define SIM_FLASH_SECTOR 4096
+#define SIM_FLASH_PAGE 256
+#define SIM_FLASH_ERASE_US 45000  // Typical 4 KB sector erase of the C3's SPI flash
+#define SIM_FLASH_PAGE_US 700     // Typical page program
+#define SIM_HEAP_FREE 200000
+#define SIM_MMAP_HEAP_BYTES 32    // Bookkeeping a mapping takes from the heap, as spi_flash_mmap() does
+
+// Data partitions, as in partitions.csv
+esp_partition_t partitions[] = {
+    {ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0x290000, 0x10000, SIM_FLASH_SECTOR, "dlog", false},
+    {ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x41, 0x2A0000, 0x40000, SIM_FLASH_SECTOR, "assets", false},
+};
+#define SIM_PARTITIONS (sizeof(partitions) / sizeof(partitions[0]))
+std::vector<uint8_t> flash[SIM_PARTITIONS];
+uint64_t rngState = 1;
+
+void applyPin(uint8_t pin, int level) {
+    int old = pinLevel[pin];
+    pinLevel[pin] = level;
+    if (old == level || (!pinIsr[pin] && !pinIsrWithArg[pin]) || pinIntrMasked[pin]) return;
+    int mode = pinIsrMode[pin];
+    if ((mode == CHANGE) || (mode == RISING && level) || (mode == FALLING && !level)) {
+        if (pinIsr[pin]) pinIsr[pin]();
+        else pinIsrWithArg[pin](pinIsrArg[pin]);
+    }
+}
+
+uint64_t tickPeriodUs = 0;
+uint64_t nextTickUs = 0;
+void (*tickHook)(uint64_t) = nullptr;
+
+// Deliver pin events and periodic ticks up to `targetUs`, then move the clock there
+void advanceTo(uint64_t targetUs) {
+    for (;;) {
+        uint64_t nextPin = pinEvents.empty() ? UINT64_MAX : pinEvents.front().atUs;
+        uint64_t nextTick = tickHook ? nextTickUs : UINT64_MAX;
+        if (nextPin > targetUs && nextTick > targetUs) break;
+        if (nextTick < nextPin) {
+            if (nextTick > nowUs) nowUs = nextTick;
+            nextTickUs += tickPeriodUs;
+            tickHook(nowUs);
+        } else {
+            PinEvent ev = pinEvents.front();
+            pinEvents.erase(pinEvents.begin());
+            if (ev.atUs > nowUs) nowUs = ev.atUs;
+            applyPin(ev.pin, ev.level);
+        }
+    }
+    if (targetUs > nowUs) nowUs = targetUs;
+}
+
+// Pins at their wake level right now
+uint64_t gpioWakeMask() {
+    uint64_t mask = 0;
+    for (int p = 0; p < 32; p++) {
+        if (pinWakeLevel[p] >= 0 && pinLevel[p] == pinWakeLevel[p]) mask |= 1ULL << p;
+    }
+    return mask;
+}
+
+bool gpioWakePending() { return gpioWakeMask() != 0; }
+
+// Earliest time a GPIO wake source reaches its wake level, or UINT64_MAX
+uint64_t nextGpioWakeUs() {
+    for (const PinEvent& ev : pinEvents) {
+        if (pinWakeLevel[ev.pin] >= 0 && ev.level == pinWakeLevel[ev.pin]) return ev.atUs;
+    }
+    return UINT64_MAX;
+}
+
+// Pins that reach their wake level at `atUs`; taken before the clock gets
+// there, as the interrupts delivered on the way may move the wake levels
+uint64_t gpioWakeMaskAt(uint64_t atUs) {
+    if (atUs == nowUs) return gpioWakeMask();
+    uint64_t mask = 0;
+    for (const PinEvent& ev : pinEvents) {
+        if (ev.atUs == atUs && pinWakeLevel[ev.pin] >= 0 && ev.level == pinWakeLevel[ev.pin]) mask |= 1ULL << ev.pin;
+    }
+    return mask;
+}
+
+} // namespace
+
+// ---- Time -----------------------------------------------------------------
+
+void simReset() {
+    nowUs = 0;
+    bootUs = 0;
+    rtcOffsetUs = 0;
+    resetReason = ESP_RST_POWERON;
+    memset(pinLevel, 0, sizeof(pinLevel));
+    memset(pinIsr, 0, sizeof(pinIsr));
+    memset(pinIsrWithArg, 0, sizeof(pinIsrWithArg));
+    gpioWakeStatus = 0;
+    memset(pinIntrMasked, 0, sizeof(pinIntrMasked));
+    memset(pinWakeLevel, -1, sizeof(pinWakeLevel));
+    pinEvents.clear();
+    serialHead = serialTail = 0;
+    simPowerStats = SimPowerStats();
+    simServoStats = SimServoStats();
+    simFlashStats = SimFlashStats();
+    for (size_t i = 0; i < SIM_PARTITIONS; i++) flash[i].assign(partitions[i].size, 0xFF);
+    gpioWakeEnabled = timerWakeEnabled = false;
+    tickHook = nullptr;
+    cpuMhz = 160;
+    cycleBase = cycleBaseUs = 0;
+}
+
+uint64_t simNowUs() { return nowUs; }
+
+void simSetHorizon(uint64_t endUs) { horizonUs = endUs; }
+
+void simSetTickHook(uint64_t periodUs, void (*hook)(uint64_t nowUs)) {
+    tickPeriodUs = periodUs;
+    nextTickUs = nowUs + periodUs;
+    tickHook = periodUs ? hook : nullptr;
+}
+uint64_t simMicros() { return nowUs; }
+void simAdvance(uint64_t us) { advanceTo(nowUs + us); }
+
+uint32_t millis() { return (uint32_t)(nowUs / 1000); }
+uint32_t micros() { return (uint32_t)nowUs; }
+void delay(uint32_t ms) { simAdvance((uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us) { simAdvance(us); }
+void yield() {}
+
+int simGettimeofday(struct timeval* tv, void*) {
+    uint64_t us = nowUs + rtcOffsetUs;
+    tv->tv_sec = (time_t)(us / 1000000);
+    tv->tv_usec = (suseconds_t)(us % 1000000);
+    return 0;
+}
+
+int simSettimeofday(const struct timeval* tv, const void*) {
+    rtcOffsetUs = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - (int64_t)nowUs;
+    return 0;
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+    cycleBase += (nowUs - cycleBaseUs) * cpuMhz;
+    cycleBaseUs = nowUs;
+    cpuMhz = mhz;
+    return true;
+}
+
+uint32_t getCpuFrequencyMhz() { return cpuMhz; }
+
+// ---- GPIO -----------------------------------------------------------------
+
+void simScheduleTouch(uint64_t atUs, uint32_t holdMs, uint8_t pin) {
+    PinEvent press = {atUs, pin, HIGH};
+    PinEvent release = {atUs + (uint64_t)holdMs * 1000, pin, LOW};
+    for (const PinEvent& ev : {press, release}) {
+        auto it = pinEvents.begin();
+        while (it != pinEvents.end() && it->atUs <= ev.atUs) ++it;
+        pinEvents.insert(it, ev);
+    }
+}
+
+void simSetPin(uint8_t pin, int level) { applyPin(pin, level); }
+
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t pin) { return pinLevel[pin & 31]; }
+void digitalWrite(uint8_t pin, uint8_t val) { pinLevel[pin & 31] = val ? HIGH : LOW; }
+int analogRead(uint8_t pin) { return (int)(pin * 37 + 1234) & 0xFFF; }
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+    pinIsr[pin & 31] = isr;
+    pinIsrWithArg[pin & 31] = nullptr;
+    pinIsrMode[pin & 31] = mode;
+}
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode) {
+    pinIsr[pin & 31] = nullptr;
+    pinIsrWithArg[pin & 31] = isr;
+    pinIsrArg[pin & 31] = arg;
+    pinIsrMode[pin & 31] = mode;
+}
+
+void detachInterrupt(uint8_t pin) {
+    pinIsr[pin & 31] = nullptr;
+    pinIsrWithArg[pin & 31] = nullptr;
+}
+
+esp_err_t gpio_config(const gpio_config_t*) { return ESP_OK; }
+esp_err_t gpio_hold_en(gpio_num_t) { return ESP_OK; }
+esp_err_t gpio_hold_dis(gpio_num_t) { return ESP_OK; }
+void gpio_deep_sleep_hold_en(void) {}
+void gpio_deep_sleep_hold_dis(void) {}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type) {
+    if (type != GPIO_INTR_HIGH_LEVEL && type != GPIO_INTR_LOW_LEVEL) return ESP_ERR_INVALID_ARG;
+    pinWakeLevel[gpio & 31] = (type == GPIO_INTR_HIGH_LEVEL) ? HIGH : LOW;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio) {
+    pinWakeLevel[gpio & 31] = -1;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type) {
+    static const int modes[] = {0, RISING, FALLING, CHANGE};
+    if (type <= GPIO_INTR_ANYEDGE) pinIsrMode[gpio & 31] = modes[type];
+    return ESP_OK;
+}
+
+gpio_dev_t GPIO;
+
+void gpio_ll_set_intr_type(gpio_dev_t*, uint32_t gpio_num, gpio_int_type_t intr_type) {
+    if (intr_type == GPIO_INTR_HIGH_LEVEL || intr_type == GPIO_INTR_LOW_LEVEL) {
+        gpio_wakeup_enable(gpio_num, intr_type);
+    } else {
+        gpio_set_intr_type(gpio_num, intr_type);
+    }
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio) {
+    pinIntrMasked[gpio & 31] = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio) {
+    pinIntrMasked[gpio & 31] = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_sleep_sel_dis(gpio_num_t) { return ESP_OK; }  // Pins keep their state in light sleep here anyway
+
+// ---- Sleep ----------------------------------------------------------------
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+    timerWakeEnabled = true;
+    timerWakeUs = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+    gpioWakeEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_wakeup_cause_t source) {
+    if (source == ESP_SLEEP_WAKEUP_TIMER || source == ESP_SLEEP_WAKEUP_ALL) timerWakeEnabled = false;
+    if (source == ESP_SLEEP_WAKEUP_GPIO || source == ESP_SLEEP_WAKEUP_ALL) gpioWakeEnabled = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_light_sleep_start(void) {
+    uint64_t start = nowUs;
+    uint64_t wakeTimer = timerWakeEnabled ? nowUs + timerWakeUs : UINT64_MAX;
+    uint64_t wakeGpio = UINT64_MAX;
+    if (gpioWakeEnabled) {
+        wakeGpio = gpioWakePending() ? nowUs : nextGpioWakeUs();
+    }
+    if (!timerWakeEnabled && !gpioWakeEnabled) {
+        fprintf(stderr, "sim: light sleep with no wake source\n");
+        exit(3);
+    }
+    if (min(wakeTimer, wakeGpio) > horizonUs) {
+        advanceTo(max(horizonUs, nowUs));  // Sleeps past the end of the run
+        lastWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    } else if (wakeGpio <= wakeTimer) {
+        gpioWakeStatus = gpioWakeMaskAt(wakeGpio);
+        advanceTo(wakeGpio);
+        lastWakeCause = ESP_SLEEP_WAKEUP_GPIO;
+        simPowerStats.gpioWakeups++;
+    } else {
+        advanceTo(wakeTimer);
+        lastWakeCause = ESP_SLEEP_WAKEUP_TIMER;
+        simPowerStats.timerWakeups++;
+    }
+    simPowerStats.lightSleeps++;
+    simPowerStats.lightSleepUs += nowUs - start;
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void) { return lastWakeCause; }
+uint64_t esp_sleep_get_gpio_wakeup_status(void) { return gpioWakeStatus; }
+
+bool esp_sleep_is_valid_wakeup_gpio(int gpio_num) { return gpio_num >= 0 && gpio_num <= 5; }
+
+esp_err_t esp_deep_sleep_enable_gpio_wakeup(uint64_t gpio_pin_mask, int mode) {
+    for (int p = 0; p < 32; p++) {
+        if (gpio_pin_mask & (1ULL << p)) pinWakeLevel[p] = (mode == ESP_GPIO_WAKEUP_GPIO_HIGH) ? HIGH : LOW;
+    }
+    gpioWakeEnabled = true;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start(void) {
+    uint64_t start = nowUs;
+    uint64_t wakeTimer = timerWakeEnabled ? nowUs + timerWakeUs : UINT64_MAX;
+    uint64_t wakeGpio = gpioWakeEnabled ? nextGpioWakeUs() : UINT64_MAX;
+    uint64_t wake = min(wakeTimer, wakeGpio);
+    simPowerStats.deepSleeps++;
+    if (!timerWakeEnabled && !gpioWakeEnabled) {
+        fprintf(stderr, "sim: deep sleep with no wake source\n");
+        exit(3);
+    }
+    gpioWakeStatus = (wake <= horizonUs && wake == wakeGpio) ? gpioWakeMaskAt(wakeGpio) : 0;
+    advanceTo(wake > horizonUs ? max(horizonUs, nowUs) : wake);
+    if (wake > horizonUs) lastWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    else lastWakeCause = (wake == wakeGpio) ? ESP_SLEEP_WAKEUP_GPIO : ESP_SLEEP_WAKEUP_TIMER;
+    simPowerStats.deepSleepUs += nowUs - start;
+    bootUs = nowUs;
+    resetReason = ESP_RST_DEEPSLEEP;
+    throw SimDeepSleep{nowUs};
+}
+
+esp_reset_reason_t esp_reset_reason(void) { return resetReason; }
+int64_t esp_timer_get_time(void) { return (int64_t)(nowUs - bootUs); }
+
+// ---- Power management ------------------------------------------------------
+
+struct sim_pm_lock {
+    esp_pm_lock_type_t type;
+    int count;
+};
+
+struct sim_task {
+    uint32_t notifications;
+};
+
+namespace {
+
+#define SIM_IDLE_TICKS_BEFORE_SLEEP 3  // CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP
+#define SIM_APB_MHZ 80
+
+sim_pm_lock pmLocks[16];
+int pmLockCount = 0;
+esp_pm_config_esp32c3_t pmConfig = {};
+bool pmConfigured = false;
+bool ticklessIdle = true;  // The core supports automatic light sleep
+esp_pm_sleep_cbs_register_config_t pmSleepCallbacks = {};
+sim_task loopTask = {};
+
+int pmLocksHeld(esp_pm_lock_type_t type) {
+    int held = 0;
+    for (int i = 0; i < pmLockCount; i++) {
+        if (pmLocks[i].type == type) held += pmLocks[i].count;
+    }
+    return held;
+}
+
+// The CPU clock frequency scaling picks for the locks held
+void pmUpdateClock() {
+    if (!pmConfigured) return;
+    uint32_t mhz = pmConfig.min_freq_mhz;
+    if (pmLocksHeld(ESP_PM_APB_FREQ_MAX) && mhz < SIM_APB_MHZ) mhz = SIM_APB_MHZ;
+    if (pmLocksHeld(ESP_PM_CPU_FREQ_MAX)) mhz = pmConfig.max_freq_mhz;
+    setCpuFrequencyMhz(mhz);
+}
+
+} // namespace
+
+void simSetTicklessIdle(bool enabled) { ticklessIdle = enabled; }
+
+esp_err_t esp_pm_configure(const void* config) {
+    const esp_pm_config_esp32c3_t* c = (const esp_pm_config_esp32c3_t*)config;
+    if (c->light_sleep_enable && !ticklessIdle) return ESP_ERR_NOT_SUPPORTED;
+    pmConfig = *c;
+    pmConfigured = true;
+    pmUpdateClock();
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_light_sleep_register_cbs(esp_pm_sleep_cbs_register_config_t* cbs_conf) {
+    pmSleepCallbacks = *cbs_conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int, const char*, esp_pm_lock_handle_t* out_handle) {
+    if (pmLockCount >= 16) return ESP_FAIL;
+    pmLocks[pmLockCount].type = lock_type;
+    pmLocks[pmLockCount].count = 0;
+    *out_handle = &pmLocks[pmLockCount++];
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    handle->count++;
+    pmUpdateClock();
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    if (handle->count == 0) return ESP_ERR_INVALID_STATE;
+    handle->count--;
+    pmUpdateClock();
+    return ESP_OK;
+}
+
+// ---- FreeRTOS -------------------------------------------------------------
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return &loopTask; }
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+    task->notifications++;
+    if (higherPriorityTaskWoken) *higherPriorityTaskWoken = pdTRUE;
+}
+
+// The loop task blocks and the idle task runs. With automatic light sleep and
+// no lock held, the idle task sleeps until the timeout or a GPIO wake, whose
+// interrupt then gives the notification.
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    uint64_t start = nowUs;
+    uint64_t deadline = ticksToWait == portMAX_DELAY ? UINT64_MAX : nowUs + (uint64_t)ticksToWait * 1000;
+    bool sleeps = pmConfigured && pmConfig.light_sleep_enable && ticksToWait >= SIM_IDLE_TICKS_BEFORE_SLEEP &&
+                  !pmLocksHeld(ESP_PM_CPU_FREQ_MAX) && !pmLocksHeld(ESP_PM_APB_FREQ_MAX);
+    while (loopTask.notifications == 0 && nowUs < deadline && nowUs < horizonUs) {
+        uint64_t next = pinEvents.empty() ? deadline : min(deadline, pinEvents.front().atUs);
+        advanceTo(min(next, horizonUs));
+    }
+    uint32_t taken = loopTask.notifications;
+    if (sleeps && nowUs > start) {
+        if (pmSleepCallbacks.enter_cb) pmSleepCallbacks.enter_cb(nowUs - start, pmSleepCallbacks.enter_cb_user_arg);
+        simPowerStats.lightSleeps++;
+        simPowerStats.lightSleepUs += nowUs - start;
+        if (taken) {
+            lastWakeCause = ESP_SLEEP_WAKEUP_GPIO;
+            simPowerStats.gpioWakeups++;
+        } else if (nowUs >= deadline) {
+            lastWakeCause = ESP_SLEEP_WAKEUP_TIMER;
+            simPowerStats.timerWakeups++;
+        } else {
+            lastWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;  // End of the run
+        }
+        if (pmSleepCallbacks.exit_cb) pmSleepCallbacks.exit_cb(nowUs - start, pmSleepCallbacks.exit_cb_user_arg);
+    }
+    if (clearCountOnExit) loopTask.notifications = 0;
+    else if (taken) loopTask.notifications--;
+    return taken;
+}
+
+// ---- Flash ----------------------------------------------------------------
+
+namespace {
+
+// Contents of a partition with [offset, offset + size) inside it, or nullptr
+uint8_t* flashRange(const esp_partition_t* partition, size_t offset, size_t size) {
+    size_t i = partition - partitions;
+    if (i >= SIM_PARTITIONS || offset > partition->size || size > partition->size - offset) return nullptr;
+    return flash[i].data() + offset;
+}
+
+void flashBusy(uint64_t us) {
+    simFlashStats.busyUs += us;
+    simAdvance(us);
+}
+
+} // namespace
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+    for (const esp_partition_t& p : partitions) {
+        if (type != ESP_PARTITION_TYPE_ANY && p.type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p.subtype != subtype) continue;
+        if (label && strcmp(label, p.label)) continue;
+        return &p;
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) {
+    const uint8_t* src = flashRange(partition, src_offset, size);
+    if (!src) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, src, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size) {
+    uint8_t* dst = flashRange(partition, dst_offset, size);
+    if (!dst) return ESP_ERR_INVALID_SIZE;
+    for (size_t i = 0; i < size; i++) dst[i] &= ((const uint8_t*)src)[i];  // NOR flash only clears bits
+    size_t pages = (dst_offset + size + SIM_FLASH_PAGE - 1) / SIM_FLASH_PAGE - dst_offset / SIM_FLASH_PAGE;
+    simFlashStats.bytesWritten += size;
+    simFlashStats.writeCalls++;
+    flashBusy(pages * SIM_FLASH_PAGE_US);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    uint8_t* dst = flashRange(partition, offset, size);
+    if (!dst) return ESP_ERR_INVALID_SIZE;
+    if (offset % SIM_FLASH_SECTOR || size % SIM_FLASH_SECTOR) return ESP_ERR_INVALID_ARG;
+    memset(dst, 0xFF, size);
+    simFlashStats.sectorErases += size / SIM_FLASH_SECTOR;
+    flashBusy(size / SIM_FLASH_SECTOR * SIM_FLASH_ERASE_US);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t, const void** out_ptr, spi_flash_mmap_handle_t* out_handle) {
+    const uint8_t* src = flashRange(partition, offset, size);
+    if (!src) return ESP_ERR_INVALID_SIZE;
+    *out_ptr = src;
+    *out_handle = (spi_flash_mmap_handle_t)(src - flash[partition - partitions].data());
+    heapTaken += SIM_MMAP_HEAP_BYTES;
+    return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t) {
+    heapTaken -= SIM_MMAP_HEAP_BYTES;
+}
+
+bool simFlashLoad(const char* label, const char* path) {
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    FILE* f = fopen(path, "rb");
+    if (!part || !f) {
+        if (f) fclose(f);
+        return false;
+    }
+    std::vector<uint8_t>& contents = flash[part - partitions];
+    size_t n = fread(contents.data(), 1, contents.size(), f);
+    bool whole = fgetc(f) == EOF;
+    fclose(f);
+    memset(contents.data() + n, 0xFF, contents.size() - n);
+    return whole;
+}
+
+// ---- Misc -----------------------------------------------------------------
+
+long random(long howbig) {
+    if (howbig <= 0) return 0;
+    rngState = rngState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (long)((rngState >> 33) % (uint64_t)howbig);
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) return howsmall;
+    return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) { rngState = seed ? seed : 1; }
+
+void String::trim() {
+    size_t b = s_.find_first_not_of(" \t\r\n");
+    size_t e = s_.find_last_not_of(" \t\r\n");
+    s_ = (b == std::string::npos) ? std::string() : s_.substr(b, e - b + 1);
+}
+
+// Like the ESP32 core: formats on the stack, and on the heap when the line is longer than 63 characters
+size_t Print::printf(const char* fmt, ...) {
+    char local[64];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(local, sizeof(local), fmt, ap);
+    va_end(ap);
+    if (n < (int)sizeof(local)) return write((const uint8_t*)local, n);
+    char* buf = new char[n + 1];
+    va_start(ap, fmt);
+    vsnprintf(buf, n + 1, fmt, ap);
+    va_end(ap);
+    size_t written = write((const uint8_t*)buf, n);
+    delete[] buf;
+    return written;
+}
+
+size_t Print::printf_(const char* fmt, ...) {
+    char buf[64];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return write((const uint8_t*)buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// Text loses its '\r' for the terminal; deferred log frames (0x1E .. 0x00)
+// are binary and pass untouched
+size_t HardwareSerial::write(uint8_t c) {
+    static bool inLogFrame = false;
+    if (c == 0x1E) inLogFrame = true;
+    if (!simQuietSerial && (c != '\r' || inLogFrame)) fputc(c, stdout);
+    if (c == 0) inLogFrame = false;
+    return 1;
+}
+
+int HardwareSerial::availableForWrite() { return 4096; }  // stdout never blocks
+
+void HardwareSerial::flush() { fflush(stdout); }
+
+int HardwareSerial::available() { return (int)(serialHead - serialTail); }
+
+int HardwareSerial::read() {
+    if (serialTail == serialHead) return -1;
+    return (uint8_t)serialInput[serialTail++ % sizeof(serialInput)];
+}
+
+void simSerialInput(const char* text) {
+    while (*text && serialHead - serialTail < sizeof(serialInput)) serialInput[serialHead++ % sizeof(serialInput)] = *text++;
+}
+
+size_t simSerialInputBytes(const uint8_t* data, size_t len) {
+    size_t n = 0;
+    while (n < len && serialHead - serialTail < sizeof(serialInput)) serialInput[serialHead++ % sizeof(serialInput)] = data[n++];
+    return n;
+}
+
+uint32_t EspClass::getFreeHeap() { return SIM_HEAP_FREE - heapTaken; }
+uint32_t EspClass::getCycleCount() { return (uint32_t)(cycleBase + (nowUs - cycleBaseUs) * cpuMhz); }
+void EspClass::restart() { exit(0); }
+
+void Servo::write(int angle) {
+    simServoStats.writes++;
+    simServoStats.degreesTravelled += (uint32_t)abs(angle - simServoStats.angle[pin_ & 31]);
+    simServoStats.angle[pin_ & 31] = angle_ = angle;
+}
+
+// ---- Reboot across deep sleep ------------------------------------------------
+
+// Bounds of the RTC_DATA_ATTR section, provided by the linker
+extern uint8_t __start_sim_rtc_data[] __attribute__((weak));
+extern uint8_t __stop_sim_rtc_data[] __attribute__((weak));
+
+#define SIM_STATE_MAGIC 0x53494D31  // "SIM1"
+
+void simSaveState(FILE* f) {
+    uint32_t magic = SIM_STATE_MAGIC;
+    uint64_t rtcSize = __stop_sim_rtc_data - __start_sim_rtc_data;
+    uint64_t events = pinEvents.size();
+    fwrite(&magic, sizeof(magic), 1, f);
+    fwrite(&nowUs, sizeof(nowUs), 1, f);
+    fwrite(&bootUs, sizeof(bootUs), 1, f);
+    fwrite(&rtcOffsetUs, sizeof(rtcOffsetUs), 1, f);
+    fwrite(&resetReason, sizeof(resetReason), 1, f);
+    fwrite(&lastWakeCause, sizeof(lastWakeCause), 1, f);
+    fwrite(&gpioWakeStatus, sizeof(gpioWakeStatus), 1, f);
+    fwrite(pinLevel, sizeof(pinLevel), 1, f);
+    fwrite(&nextTickUs, sizeof(nextTickUs), 1, f);
+    fwrite(&simPowerStats, sizeof(simPowerStats), 1, f);
+    fwrite(&simServoStats, sizeof(simServoStats), 1, f);
+    fwrite(&simFlashStats, sizeof(simFlashStats), 1, f);
+    for (const std::vector<uint8_t>& contents : flash) fwrite(contents.data(), 1, contents.size(), f);
+    fwrite(&events, sizeof(events), 1, f);
+    fwrite(pinEvents.data(), sizeof(PinEvent), pinEvents.size(), f);
+    fwrite(&rtcSize, sizeof(rtcSize), 1, f);
+    fwrite(__start_sim_rtc_data, 1, rtcSize, f);
+    simSaveBusState(f);
+}
+
+bool simLoadState(FILE* f) {
+    uint32_t magic = 0;
+    uint64_t rtcSize = 0, events = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, f) == 1 && magic == SIM_STATE_MAGIC
+        && fread(&nowUs, sizeof(nowUs), 1, f) == 1
+        && fread(&bootUs, sizeof(bootUs), 1, f) == 1
+        && fread(&rtcOffsetUs, sizeof(rtcOffsetUs), 1, f) == 1
+        && fread(&resetReason, sizeof(resetReason), 1, f) == 1
+        && fread(&lastWakeCause, sizeof(lastWakeCause), 1, f) == 1
+        && fread(&gpioWakeStatus, sizeof(gpioWakeStatus), 1, f) == 1
+        && fread(pinLevel, sizeof(pinLevel), 1, f) == 1
+        && fread(&nextTickUs, sizeof(nextTickUs), 1, f) == 1
+        && fread(&simPowerStats, sizeof(simPowerStats), 1, f) == 1
+        && fread(&simServoStats, sizeof(simServoStats), 1, f) == 1
+        && fread(&simFlashStats, sizeof(simFlashStats), 1, f) == 1;
+    for (std::vector<uint8_t>& contents : flash) {
+        ok = ok && fread(contents.data(), 1, contents.size(), f) == contents.size();
+    }
+    if (!ok || fread(&events, sizeof(events), 1, f) != 1) return false;
+    pinEvents.resize(events);
+    if (fread(pinEvents.data(), sizeof(PinEvent), events, f) != events) return false;
+    if (fread(&rtcSize, sizeof(rtcSize), 1, f) != 1) return false;
+    if (rtcSize != (uint64_t)(__stop_sim_rtc_data - __start_sim_rtc_data)) return false;  // Different build
+    if (fread(__start_sim_rtc_data, 1, rtcSize, f) != rtcSize) return false;
+    return simLoadBusState(f);
+}
@@ -0,0 +1,343 @@
+// Host simulator driver: runs the firmware's setup()/loop() against the
+// virtual clock and simulated peripherals.
+//
+//   pill_sim [--hours H] [--touch-every S] [--hold-ms MS] [--touch-pin N[,N...]]
+//            [--panels N] [--mux ADDR] [--serial TEXT] [--dump-dir DIR] [--dump-every MS] [--frames FILE]
+//            [--assets FILE] [--upload FILE]
+//            [--energy-report] [--query TEXT] [--verbose] [--no-tickless-idle]
+//
+// A deep sleep reboots the firmware for real: the driver saves the simulated
+// hardware and its own counters to a temporary file and re-executes itself
+// with --resume FILE, so only RTC_DATA_ATTR state carries over. Address
+// randomization is switched off so pointers kept in RTC memory stay valid,
+// as they do with the fixed firmware image on the chip.
+//
+// --panels puts that many panels on the bus for a multi-channel build
+// (include/channels.h): at 0x3C and 0x3D, or all at 0x3C behind a TCA9548A
+// at ADDR, panel i on port i, with --mux. Several --touch-pin pins are all
+// touched at the same moments.
+//
+// The unit tests under test/ bring their own main() and link the firmware
+// only for the simulated hardware, so this driver is left out of them.
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <ESP32Servo.h>
+#include <esp_partition.h>
+#include "sim.h"
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/personality.h>
+#endif
+#include <vector>
+
+#ifndef PIO_UNIT_TESTING
+
+void setup();
+void loop();
+
+extern bool simQuietSerial;
+
+static const char* dumpDir = nullptr;
+static uint32_t dumps = 0;
+
+// Panel 0 goes to frame_<ms>.pbm, any others to frame_<ms>_p<N>.pbm
+static void dumpFrame(uint64_t nowUs) {
+    char path[512];
+    for (int i = 0; i < simPanelCount(); i++) {
+        if (i == 0) snprintf(path, sizeof(path), "%s/frame_%010llu.pbm", dumpDir, (unsigned long long)(nowUs / 1000));
+        else snprintf(path, sizeof(path), "%s/frame_%010llu_p%d.pbm", dumpDir, (unsigned long long)(nowUs / 1000), i);
+        simPanelWritePBM(simPanelAt(i), path);
+    }
+    dumps++;
+}
+
+// --frames: one "ms hash" line per change of what the panels show, for
+// tools/bench.py to compare against its golden frames. The hash runs over
+// all panels in turn, so with one panel it is that panel's. Without --dump-every,
+// --dump-dir then also gets a PBM of each of them. A flush can take several
+// transactions, so the panel is only looked at between loop() passes.
+static FILE* framesFile = nullptr;
+static bool dumpChanges = false;
+static uint64_t lastFrameHash = 0;
+static uint64_t panelWrittenUs = 0;
+static bool panelWritten = false;
+
+static uint64_t hashPanel(const SimPanel* panel, uint64_t hash) {
+    uint8_t pix[SIM_PANEL_PAGES * SIM_PANEL_WIDTH];
+    simPanelSnapshot(panel, pix);
+    for (int i = 0; i < panel->visiblePages * SIM_PANEL_WIDTH; i++) hash = (hash ^ pix[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+static void notePanelWrite(const SimPanel*, uint64_t nowUs) {
+    panelWritten = true;
+    panelWrittenUs = nowUs;
+}
+
+static void recordFrame() {
+    if (!panelWritten) return;
+    panelWritten = false;
+    uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a
+    for (int i = 0; i < simPanelCount(); i++) hash = hashPanel(simPanelAt(i), hash);
+    if (hash == lastFrameHash) return;
+    lastFrameHash = hash;
+    if (framesFile) fprintf(framesFile, "%llu %016llx\n", (unsigned long long)(panelWrittenUs / 1000), (unsigned long long)hash);
+    if (dumpChanges) dumpFrame(panelWrittenUs);
+}
+
+#define SIM_LOOP_COST_US 50  // Charged per loop() pass so busy loops still advance time
+#define SIM_UPLOAD_AT_US 10000000ULL  // --upload starts once the idle animation runs
+#define SIM_UPLOAD_CHUNK 128
+
+// --upload: the byte stream tools/upload_assets.py sends, fed into the serial
+// receive buffer as fast as it has room, as USB flow control would. The
+// replies are not waited for; --verbose shows them.
+static std::vector<uint8_t> uploadStream;
+static size_t uploadSent = 0;
+
+static uint32_t crc32(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static void put32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static bool prepareUpload(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> bundle;
+    int c;
+    while ((c = fgetc(f)) != EOF) bundle.push_back((uint8_t)c);
+    fclose(f);
+    uploadStream = {'U', 'S'};
+    put32(uploadStream, bundle.size());
+    put32(uploadStream, crc32(bundle.data(), bundle.size()));
+    for (size_t offset = 0; offset < bundle.size(); offset += SIM_UPLOAD_CHUNK) {
+        size_t len = bundle.size() - offset < SIM_UPLOAD_CHUNK ? bundle.size() - offset : SIM_UPLOAD_CHUNK;
+        uploadStream.push_back('C');
+        uploadStream.push_back((uint8_t)len);
+        uploadStream.push_back((uint8_t)(len >> 8));
+        uploadStream.insert(uploadStream.end(), bundle.begin() + offset, bundle.begin() + offset + len);
+        put32(uploadStream, crc32(bundle.data() + offset, len));
+    }
+    uploadStream.push_back('F');
+    return true;
+}
+
+struct DriverCounters {
+    uint32_t boots;
+    uint32_t loops;
+    uint32_t dumps;
+    uint64_t lastFrameHash;
+    uint64_t uploadSent;
+};
+
+// Save everything and start over as a fresh process; does not return
+static void rebootAfterDeepSleep(int argc, char** argv, const DriverCounters& counters) {
+    char path[] = "/tmp/pill_sim_XXXXXX";
+    int fd = mkstemp(path);
+    FILE* f = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+    if (!f) {
+        perror("sim: saving state");
+        exit(3);
+    }
+    fwrite(&counters, sizeof(counters), 1, f);
+    simSaveState(f);
+    fclose(f);
+
+    std::vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--resume")) {
+            i++;
+            continue;
+        }
+        args.push_back(argv[i]);
+    }
+    args.push_back((char*)"--resume");
+    args.push_back(path);
+    args.push_back(nullptr);
+    fflush(stdout);
+    fflush(stderr);
+    execvp(argv[0], args.data());
+    perror("sim: re-executing after deep sleep");
+    exit(3);
+}
+
+int main(int argc, char** argv) {
+#ifdef __linux__
+    int persona = personality(0xffffffff);
+    if (persona != -1 && !(persona & ADDR_NO_RANDOMIZE) && personality(persona | ADDR_NO_RANDOMIZE) != -1) {
+        execvp(argv[0], argv);  // Same program, now with a fixed layout
+    }
+#endif
+    double hours = 1.0;
+    double touchEverySec = 0;
+    uint32_t holdMs = 200;
+    std::vector<int> touchPins;
+    int panelCount = 1;
+    int muxAddress = 0;
+    const char* resumePath = nullptr;
+    const char* serialText = nullptr;
+    uint32_t dumpEveryMs = 0;
+    const char* query = nullptr;
+    const char* framesPath = nullptr;
+    const char* assetsPath = nullptr;
+    const char* uploadPath = nullptr;
+    simQuietSerial = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) hours = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--touch-every") && i + 1 < argc) touchEverySec = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--hold-ms") && i + 1 < argc) holdMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--touch-pin") && i + 1 < argc) {
+            for (char* p = argv[++i]; *p; p += (*p != 0)) touchPins.push_back((int)strtol(p, &p, 10));
+        }
+        else if (!strcmp(argv[i], "--panels") && i + 1 < argc) panelCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--mux") && i + 1 < argc) muxAddress = (int)strtol(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--resume") && i + 1 < argc) resumePath = argv[++i];
+        else if (!strcmp(argv[i], "--serial") && i + 1 < argc) serialText = argv[++i];
+        else if (!strcmp(argv[i], "--dump-dir") && i + 1 < argc) dumpDir = argv[++i];
+        else if (!strcmp(argv[i], "--dump-every") && i + 1 < argc) dumpEveryMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc) framesPath = argv[++i];
+        else if (!strcmp(argv[i], "--assets") && i + 1 < argc) assetsPath = argv[++i];
+        else if (!strcmp(argv[i], "--upload") && i + 1 < argc) uploadPath = argv[++i];
+        else if (!strcmp(argv[i], "--energy-report")) query = "e";
+        else if (!strcmp(argv[i], "--query") && i + 1 < argc) query = argv[++i];
+        else if (!strcmp(argv[i], "--verbose")) simQuietSerial = false;
+        else if (!strcmp(argv[i], "--no-tickless-idle")) simSetTicklessIdle(false);
+        else {
+            fprintf(stderr, "usage: %s [--hours H] [--touch-every S] [--hold-ms MS] [--touch-pin N[,N...]] [--panels N] [--mux ADDR] [--serial TEXT] [--dump-dir DIR] [--dump-every MS] [--frames FILE] [--assets FILE] [--upload FILE] [--energy-report] [--query TEXT] [--verbose] [--no-tickless-idle]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (touchPins.empty()) touchPins.push_back(10);
+    if (panelCount < 1 || panelCount > (muxAddress ? 8 : 2)) {
+        fprintf(stderr, "sim: --panels is 1-2, or 1-8 with --mux\n");
+        return 2;
+    }
+
+    simReset();
+    if (muxAddress) simAddMux((uint8_t)muxAddress);
+    for (int i = 0; i < panelCount; i++) {
+        if (muxAddress) simPanel(0x3C, (uint8_t)i);
+        else simPanel((uint8_t)(0x3C + i));
+    }
+    uint64_t endUs = (uint64_t)(hours * 3600e6);
+    simSetHorizon(endUs);
+    uint32_t touches = 0;
+    if (touchEverySec > 0) {
+        for (uint64_t t = (uint64_t)(touchEverySec * 1e6); t < endUs; t += (uint64_t)(touchEverySec * 1e6)) {
+            for (int pin : touchPins) simScheduleTouch(t, holdMs, (uint8_t)pin);
+            touches++;
+        }
+    }
+
+    if (dumpDir && dumpEveryMs) simSetTickHook((uint64_t)dumpEveryMs * 1000, dumpFrame);
+    if (framesPath || dumpDir) {
+        dumpChanges = dumpDir && !dumpEveryMs;
+        simSetFrameHook(notePanelWrite);
+    }
+    if (uploadPath && !prepareUpload(uploadPath)) {
+        perror(uploadPath);
+        return 2;
+    }
+    if (framesPath && !(framesFile = fopen(framesPath, resumePath ? "a" : "w"))) {
+        perror(framesPath);
+        return 2;
+    }
+
+    DriverCounters counters = {};
+    if (resumePath) {
+        FILE* f = fopen(resumePath, "rb");
+        bool ok = f && fread(&counters, sizeof(counters), 1, f) == 1 && simLoadState(f);
+        if (f) fclose(f);
+        unlink(resumePath);
+        if (!ok) {
+            fprintf(stderr, "sim: cannot resume from %s\n", resumePath);
+            return 3;
+        }
+        dumps = counters.dumps;
+        lastFrameHash = counters.lastFrameHash;
+        uploadSent = counters.uploadSent;
+    } else {
+        if (assetsPath && !simFlashLoad("assets", assetsPath)) {
+            fprintf(stderr, "sim: %s does not fit the assets partition\n", assetsPath);
+            return 2;
+        }
+        if (serialText) {
+            simSerialInput(serialText);
+            simSerialInput("\n");  // Entered as a line
+        }
+    }
+    uint32_t& boots = counters.boots;
+    uint32_t& loops = counters.loops;
+    bool booted = false;
+    while (simNowUs() < endUs) {
+        try {
+            if (!booted) {
+                boots++;
+                booted = true;
+                setup();
+            }
+            loop();
+        } catch (const SimDeepSleep&) {
+            recordFrame();
+            counters.dumps = dumps;
+            counters.lastFrameHash = lastFrameHash;
+            counters.uploadSent = uploadSent;
+            if (framesFile) fclose(framesFile);
+            rebootAfterDeepSleep(argc, argv, counters);
+        }
+        recordFrame();
+        if (uploadSent < uploadStream.size() && simNowUs() >= SIM_UPLOAD_AT_US) {
+            uploadSent += simSerialInputBytes(uploadStream.data() + uploadSent, uploadStream.size() - uploadSent);
+        }
+        loops++;
+        simAdvance(SIM_LOOP_COST_US);
+    }
+
+    // Ask the firmware for its own accounting over the serial query, waking
+    // it first if the run ended in deep sleep
+    if (query && !booted) {
+        boots++;
+        booted = true;
+        setup();
+    }
+    if (query) {
+        simQuietSerial = false;
+        simSerialInput(query);
+        loop();
+        simQuietSerial = true;
+    }
+
+    const SimPanel* panel = simPanelAt(0);
+    double simSec = simNowUs() / 1e6;
+    double awakeSec = simSec - (simPowerStats.lightSleepUs + simPowerStats.deepSleepUs) / 1e6;
+    printf("simulated      %.1f s (%u boots, %u loop passes, %u touches)\n", simSec, boots, loops, touches);
+    printf("awake          %.2f s (%.2f%%)\n", awakeSec, 100.0 * awakeSec / simSec);
+    printf("light sleep    %.2f s in %u sleeps (%u timer, %u gpio wakeups)\n",
+           simPowerStats.lightSleepUs / 1e6, simPowerStats.lightSleeps, simPowerStats.timerWakeups, simPowerStats.gpioWakeups);
+    printf("deep sleep     %.2f s in %u sleeps\n", simPowerStats.deepSleepUs / 1e6, simPowerStats.deepSleeps);
+    printf("i2c            %u transactions, %u bytes, %.2f s bus time\n",
+           simI2CStats.transactions, simI2CStats.bytes, simI2CStats.busTimeUs / 1e6);
+    printf("panel          %u data bytes, %u command bytes\n", panel->dataBytes, panel->commandBytes);
+    for (int i = 1; i < simPanelCount(); i++) {
+        printf("panel %-8d %u data bytes, %u command bytes\n", i, simPanelAt(i)->dataBytes, simPanelAt(i)->commandBytes);
+    }
+    printf("servo          %u writes, %u degrees\n", simServoStats.writes, simServoStats.degreesTravelled);
+    printf("flash          %u bytes in %u writes, %u sector erases, %.2f s busy\n",
+           simFlashStats.bytesWritten, simFlashStats.writeCalls, simFlashStats.sectorErases, simFlashStats.busyUs / 1e6);
+    if (dumpDir) printf("frames dumped  %u\n", dumps);
+    if (framesFile) fclose(framesFile);
+    return 0;
+}
+
+#endif // PIO_UNIT_TESTING
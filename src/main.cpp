@@ -1,7 +1,22 @@
 #include <Arduino.h>
-#include "images.h"
 #include "secrets.h"
 #include "animations.h"
+#include "scheduler.h"
+#include "servo_motion.h"
+#include "energy.h"
+#include "retained_state.h"
+#include "touch_input.h"
+#include "dose_schedule.h"
+#include "dispense_log.h"
+#include "dispense_planner.h"
+#include "message_pool.h"
+#include "asset_bundle.h"
+#include "asset_upload.h"
+#include "heap_guard.h"
+#include "trace.h"
+#include "deferred_log.h"
+#include "power_management.h"
+#include "channels.h"
 
 #include <ESP32Servo.h>
 #include <SPI.h>
@@ -12,101 +27,782 @@
 #include <esp_pm.h> 
 #include <esp_sleep.h>
 #include <driver/gpio.h> // Required for gpio_hold functions
+#include <esp_timer.h>
 
-#define TOUCHPIN 10
+#ifndef TOUCHPIN
+#define TOUCHPIN 10  // Deep sleep wake needs GPIO0-5 on the ESP32-C3
+#endif
 #define SERVO_PIN 3
 #define LED_PIN 8
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 32
-#define OLED_RESET -1
 #define SCREEN_ADDRESS 0x3C
 
+// Touch pads and servos of the channels (channels.h), channel 0 first.
+// Deep sleep needs every touch pad on GPIO0-5; GPIO2, 8 and 9 are
+// strapping pins, so touch pads, pulled down, stay off them. Pass your own
+// table when -DTOUCHPIN picks one of the other channels' pins.
+#ifndef CHANNEL_TOUCH_PINS
+#define CHANNEL_TOUCH_PINS {TOUCHPIN, 4, 5, 1}
+#endif
+#ifndef CHANNEL_SERVO_PINS
+#define CHANNEL_SERVO_PINS {SERVO_PIN, 2, 9, 0}
+#endif
+
 #define SDA 6
 #define SCL 7
 
-#define SERVO_MIN_ANGLE 30    // Minimum safe angle
-#define SERVO_MAX_ANGLE 10   // Maximum safe angle
-#define SERVO_MOVE_DELAY 20 // Delay between each degree of movement
-
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
-Servo myservo;
+#define SERVO_MIN_ANGLE 10    // Minimum safe angle: rest, homed to at boot
+#define SERVO_MAX_ANGLE 30   // Maximum safe angle: far end of the stroke
+#define SERVO_MOVE_DELAY 20 // Delay between each degree of movement (startup homing)
 
-bool servoState = false;
-bool lastTouchState = false;
-int currentServoAngle = SERVO_MIN_ANGLE;
-unsigned long lastDebounceTime = 0;
-unsigned long debounceDelay = 50;
+#define LIGHT_SLEEP_MIN_MS 20        // Shorter waits are not worth a light sleep
+#define TOUCH_REARM_DELAY_MS 500     // Presses this soon after a sequence are ignored
+#define DEBUG_INTERVAL_MS 5000
+#define SERIAL_ARG_TIMEOUT_MS 100    // For the rest of a serial query's line to arrive
 
-// Global timing variables
-unsigned long previousMillis = 0;
+#define IDLE_SLEEP_MS (5 * 60 * 1000UL)  // Sleep until touched after this long without a touch, 0 = never
+#define IDLE_PANEL_OFF true              // Panel off while asleep; false leaves the last frame showing
 
 // Global variables
-volatile bool touchDetected = false;
-volatile unsigned long lastInterruptTime = 0;
-bool touchInProgress = false;  // Flag to track if touch sequence is running
 volatile int interruptCounter = 0;  // Counter for interrupt diagnostics
 
-// Non-blocking delay function
-bool hasitbeen(unsigned long interval) {
-    unsigned long currentMillis = millis();
-    if (currentMillis - previousMillis >= interval) {
-        previousMillis = currentMillis;
-        return true;
-    }
-    return false;
-}
+// Steps of the dispense sequence, advanced by dispenseTask()
+enum DispenseStep {
+    DISPENSE_START,
+    DISPENSE_MOTION,  // Servo profile and message scroll run side by side
+    DISPENSE_DANCE,
+    DISPENSE_FINISH,
+    DISPENSE_DONE
+};
+
+// One dispenser: panel, servo and touch pad, and the sequence it runs. The
+// channels only share the I2C bus, the dose schedule and the messages.
+struct Channel {
+    uint8_t index;
+    uint8_t touchPin;
+    uint8_t servoPin;
+    RetainedSSD1306 display;
+    Servo servo;
+    ServoMotion motion;
+    AnimationState anim;
+    TouchRecognizer touch;
+    bool touchInProgress = false;            // Flag to track if touch sequence is running
+    int64_t touchAcceptAt = 0;               // Gestures pressed before this esp_timer time are ignored
+    int lastMessage = -1;                    // Index into messages[] of the last message shown
+    DispenseStep dispenseStep = DISPENSE_DONE;
+    TouchEvent dispenseTrigger;              // Gesture that started the sequence, for the dispense log
+    uint8_t dispenseFlags = 0;               // DLOG_ bits of the sequence in progress
+    DosePills dosePills;                     // What the sequence in progress has yet to dispense
+    uint16_t planPills = 0;                  // Pills of the paths planned so far
+    uint32_t pathStartMs = 0;
+    uint32_t batchMotionMs = 0;              // Servo time of the paths run so far
+    int taskAnimation;                       // Scheduler task ids
+    int taskServo;
+    int taskDispense;
+    // For the 'c' query
+    uint32_t dispenses = 0;
+    uint32_t pills = 0;
+    uint32_t motionMs = 0;                   // Servo time those pills took
+    uint32_t timedFrames = 0;                // Frames that had a due time
+    uint64_t lateSumUs = 0;                  // How long after it they were drawn
+    uint32_t lateMaxUs = 0;
+};
+
+Channel channels[CHANNEL_COUNT];
 
-void moveServoSmooth(int targetAngle) {
+// Pill compartments along the servo's sweep (dispense_planner.h), at most
+// DOSE_MAX_COMPARTMENTS. The stock mechanism has one, loaded at the rest
+// angle and dropped at the far end of the stroke.
+static const DispenseCompartment dispenseCompartments[] = {
+    {SERVO_MIN_ANGLE, SERVO_MAX_ANGLE},
+};
+#define DISPENSE_COMPARTMENTS (sizeof(dispenseCompartments) / sizeof(dispenseCompartments[0]))
+
+static const DosePills singlePill = {{1}};  // A tap while no dose is due
+
+// Scheduler task ids of the shared tasks
+int taskTouch;
+int taskDebug;
+int taskDeferredInit;
+int taskIdleSleep;
+int taskDose;
+int taskLogCommit;
+int taskAssetUpload;
+
+bool warmBoot = false;      // Woken from deep sleep with retained state
+bool bootComplete = false;  // Deferred init has run
+int64_t firstFrameUs = 0;   // esp_timer time when the first frame was on the panel
+
+// Blocking move, only used for homing during setup()
+void moveServoSmooth(Channel& ch, int targetAngle) {
     // Ensure target is within limits
-    targetAngle = constrain(targetAngle, SERVO_MIN_ANGLE, SERVO_MAX_ANGLE);
+    targetAngle = servoTarget(ch.motion, targetAngle);
     
     // Move servo smoothly to target
-    if (currentServoAngle < targetAngle) {
-        for (int angle = currentServoAngle; angle <= targetAngle; angle++) {
-            myservo.write(angle);
+    EnergyState prev = energyEnter(ENERGY_DELAY);
+    energyServo(true);
+    if (ch.motion.angle < targetAngle) {
+        for (int angle = ch.motion.angle; angle <= targetAngle; angle++) {
+            ch.servo.write(angle);
             delay(SERVO_MOVE_DELAY);
         }
     } else {
-        for (int angle = currentServoAngle; angle >= targetAngle; angle--) {
-            myservo.write(angle);
+        for (int angle = ch.motion.angle; angle >= targetAngle; angle--) {
+            ch.servo.write(angle);
             delay(SERVO_MOVE_DELAY);
         }
 
     }
-    currentServoAngle = targetAngle;
+    ch.motion.angle = targetAngle;
+    energyServo(false);
+    energyEnter(prev);
 }
 
-// Define touch pin interrupt with proper debouncing
-void IRAM_ATTR touchInterrupt() {
-    // Simple interrupt debouncing
-    unsigned long interruptTime = millis();
+// Touch pin change: only timestamp the edge, debouncing and gestures run in the loop
+void IRAM_ATTR touchInterrupt(void* arg) {
+    Channel& ch = *(Channel*)arg;
     interruptCounter++;  // Count all interrupts for diagnostics
-    
-    if (interruptTime - lastInterruptTime > 20) {  // Increase to 500ms for better debouncing
-        touchDetected = true;
-        lastInterruptTime = interruptTime;
+    bool pressed = digitalRead(ch.touchPin) == HIGH;
+    trace(TRACE_TOUCH, TRACE_INSTANT, pressed);
+    pushTouchEdge(ch.touch, micros(), pressed);
+    if (power.autoSleep) {
+        // The wake is the pin interrupt now: flip its level to catch the next edge
+        setWakeLevelFromISR(ch.touchPin, !pressed);
+        wakeLoopFromISR();
     }
 }
 
-void setup() {
-    // Reduce CPU frequency to 80MHz (from default 240MHz)
-    // setCpuFrequencyMhz(80);
+// Run the servo trajectory; it asks to be called again at its next tick
+void servoTask(uint8_t channel) {
+    Channel& ch = channels[channel];
+    trace(TRACE_SERVO, TRACE_BEGIN, ch.motion.angle);
+    if (updateServoMotion(ch.motion)) {
+        scheduleAt(ch.taskServo, ch.motion.nextTick);
+    }
+    trace(TRACE_SERVO, TRACE_END, ch.motion.angle);
+}
 
-    Serial.begin(9600);
-    Wire.begin(SDA, SCL);
-    delay(10);
+// Completion callback of a dispense path
+void onDispenseMotionDone(void* context) {
+    Channel& ch = *(Channel*)context;
+    ch.batchMotionMs += millis() - ch.pathStartMs;
+    logEvent<LOG_SERVO_DONE>();
+    scheduleIn(ch.taskDispense, 0);
+}
+
+// Plan the next servo path of the dose and set it going; false when the
+// dose is done
+bool startDispensePath(Channel& ch) {
+    DispensePlan plan;
+    planDispense(plan, ch.motion, dispenseCompartments, DISPENSE_COMPARTMENTS, ch.dosePills);
+    if (plan.unplannable) logEvent<LOG_DISPENSE_NO_COMPARTMENT>(plan.unplannable);
+    if (!plan.length) return false;
+    logEvent<LOG_SERVO_START>();
+    logEvent<LOG_DISPENSE_PLAN>(plan.pills, plan.travelDeg, plan.durationMs);
+    ch.planPills += plan.pills;
+    ch.pathStartMs = millis();
+    startServoPath(ch.motion, plan.path, plan.length, onDispenseMotionDone, &ch);
+    scheduleIn(ch.taskServo, 0);
+    return true;
+}
+
+// Draw the next animation frame and wake up again for the one after it
+void animationTask(uint8_t channel) {
+    Channel& ch = channels[channel];
+    if (isAnimating(ch.anim)) {
+        uint32_t lateUs = micros() - nextFrameTime(ch.anim) * 1000UL;
+        trace(TRACE_FRAME, TRACE_INSTANT, lateUs);
+        if ((int32_t)lateUs > 0) {
+            ch.lateSumUs += lateUs;
+            if (lateUs > ch.lateMaxUs) ch.lateMaxUs = lateUs;
+        }
+        ch.timedFrames++;
+    }
+    EnergyState prev = energyEnter(ENERGY_RENDER);
+    trace(TRACE_RENDER, TRACE_BEGIN);
+    updateAnimation(ch.display, ch.anim);
+    trace(TRACE_RENDER, TRACE_END);
+    energyEnter(prev);
+    if (isAnimating(ch.anim)) {
+        scheduleAt(ch.taskAnimation, nextFrameTime(ch.anim));
+    } else if (ch.dispenseStep != DISPENSE_DONE) {
+        scheduleIn(ch.taskDispense, 0);  // Message or dance finished, continue the sequence
+    }
+}
+
+// What the screen shows when no sequence is running
+const AnimationDesc& idleAnimation() {
+    return animationFor(isDoseDue() ? ANIMATION_REMINDER : ANIMATION_IDLE);
+}
+
+// Follow the dose schedule: switch between the idle and reminder animations
+// and wake up again when the due dose expires or the next one starts
+void doseTask() {
+    switch (updateDoseSchedule()) {
+        case DOSE_NOW_DUE:
+            logEvent<LOG_DOSE_DUE>();
+            break;
+        case DOSE_MISSED:
+            logEvent<LOG_DOSE_MISSED>();
+            break;
+        case DOSE_NO_CHANGE:
+            break;
+    }
+    // Swap idle and reminder right away; anything else finishes first
+    for (Channel& ch : channels) {
+        bool idleShowing = ch.anim.anim == &animationFor(ANIMATION_IDLE) || ch.anim.anim == &animationFor(ANIMATION_REMINDER);
+        if (!ch.touchInProgress && idleShowing && ch.anim.anim != &idleAnimation()) {
+            resumeAnimation(ch.anim, idleAnimation(), 0, 0);
+            scheduleIn(ch.taskAnimation, 0);
+        }
+    }
+    uint32_t waitSec;
+    if (doseDeadline(waitSec)) {
+        scheduleIn(taskDose, waitSec * 1000UL);
+    } else {
+        cancelTask(taskDose);
+    }
+}
+
+// Timer wake for the next dose deadline, if there is one
+void armDoseWake() {
+    uint32_t waitSec;
+    if (doseDeadline(waitSec)) {
+        esp_sleep_enable_timer_wakeup((uint64_t)waitSec * 1000000ULL + 1000000ULL);
+    } else {
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+    }
+}
+
+// (Re)start the countdown to the idle sleep
+void armIdleSleep() {
+    if (IDLE_SLEEP_MS > 0) scheduleIn(taskIdleSleep, IDLE_SLEEP_MS);
+}
+
+// Light sleep wakes on the opposite of the current touch level, so a held
+// touch does not keep waking us and its release is noticed. The wake makes
+// the pin interrupt level triggered, so the edge interrupt is masked meanwhile.
+void armTouchWake() {
+    for (Channel& ch : channels) {
+        gpio_intr_disable((gpio_num_t)ch.touchPin);
+        gpio_wakeup_enable((gpio_num_t)ch.touchPin, isTouchPressed(ch.touch) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    }
+    esp_sleep_enable_gpio_wakeup();
+}
+
+// Back to edge interrupts after a light sleep; an edge during the sleep was
+// not seen by the interrupt, so sample the level instead
+void disarmTouchWake() {
+    for (Channel& ch : channels) {
+        gpio_wakeup_disable((gpio_num_t)ch.touchPin);
+        updateTouch(ch.touch, micros());  // Edges from before the sleep come first
+        touchLevelSample(ch.touch, digitalRead(ch.touchPin) == HIGH, micros());
+        gpio_set_intr_type((gpio_num_t)ch.touchPin, GPIO_INTR_ANYEDGE);
+        gpio_intr_enable((gpio_num_t)ch.touchPin);
+    }
+}
+
+// Whether any channel has a dispense sequence running
+bool anyTouchInProgress() {
+    for (const Channel& ch : channels) {
+        if (ch.touchInProgress) return true;
+    }
+    return false;
+}
+
+// With automatic light sleep the loop only blocks: the idle task runs at the
+// lowest clock and light-sleeps whenever no lock is held. A touch ends the
+// wait early. Returns whether it did.
+bool idleWait(uint32_t waitMs) {
+    bool sleeps = !isPowerLocked() && waitMs >= POWER_SLEEP_MIN_MS;
+    energyEnter(sleeps ? ENERGY_LIGHT_SLEEP : ENERGY_DELAY);
+    trace(TRACE_SLEEP, TRACE_BEGIN, waitMs == POWER_WAIT_FOREVER ? 0 : waitMs * 1000);
+    int64_t waitedFrom = esp_timer_get_time();
+    uint32_t lightSleeps = power.lightSleeps;
+    bool touched = waitForWake(waitMs);
+    trace(TRACE_SLEEP, TRACE_END, (uint32_t)(esp_timer_get_time() - waitedFrom));
+    energyEnter(ENERGY_ACTIVE);
+    // The wake cause is that of the last sleep, which may be long ago when
+    // this wait did not get as far as one
+    if (power.lightSleeps != lightSleeps) energyCountWakeup();
+    return touched;
+}
+
+// Scroll a message across the screen
+void showMessage(Channel& ch, int index) {
+    ch.lastMessage = index;
+    const ScrollMessage& message = messagePool[index];
+    logEvent<LOG_SHOWING_MESSAGE>(index);
+
+    showScrollingText(ch.anim, message, 30); // Faster scrolling (30ms)
+    scheduleAt(ch.taskAnimation, nextFrameTime(ch.anim));
+}
+
+// Advance the dispense sequence by one step
+void dispenseTask(uint8_t channel) {
+    Channel& ch = channels[channel];
+    switch (ch.dispenseStep) {
+        case DISPENSE_START: {
+            gpio_hold_dis((gpio_num_t)ch.servoPin);
+            gpio_hold_dis((gpio_num_t)LED_PIN);
+
+            ch.dispenseFlags = markDoseTaken() ? DLOG_DOSE_TAKEN : 0;
+
+            // 1. Run the dose as planned servo paths in the background
+            ch.planPills = 0;
+            ch.batchMotionMs = 0;
+            startDispensePath(ch);
+
+            // 2. Scroll the message while the mechanism moves
+            showMessage(ch, random(0, messagePoolCount));
+            ch.dispenseStep = DISPENSE_MOTION;
+            break;
+        }
+
+        case DISPENSE_MOTION: {
+            // Called when either the servo or the message finishes; wait for
+            // both. The rest of a dose too long for one path goes once the
+            // servo is done with the last, and the message scrolls again
+            // while a long dose comes out.
+            if (!isServoMoving(ch.motion)) startDispensePath(ch);
+            if (isServoMoving(ch.motion) && !isAnimating(ch.anim)) showMessage(ch, ch.lastMessage);
+            if (isServoMoving(ch.motion) || isAnimating(ch.anim)) break;
+            uint32_t rate = pillsPerMinute100(ch.planPills, ch.batchMotionMs);
+            ch.pills += ch.planPills;
+            ch.motionMs += ch.batchMotionMs;
+            if (ch.planPills) logEvent<LOG_DISPENSE_RATE>(ch.planPills, ch.batchMotionMs, rate / 100, rate / 10 % 10);
+            ch.dispenseStep = DISPENSE_DANCE;
+        }
+            // fall through
+
+        case DISPENSE_DANCE:
+            // 3. Show dancing couple animation
+            logEvent<LOG_DANCE_START>();
+            startAnimation(ch.anim, animationFor(ANIMATION_DANCE));
+            scheduleAt(ch.taskAnimation, nextFrameTime(ch.anim));
+            ch.dispenseStep = DISPENSE_FINISH;
+            break;
+
+        case DISPENSE_FINISH:
+            logEvent<LOG_SEQUENCE_DONE>();
+            ch.dispenseStep = DISPENSE_DONE;
+            ch.touchInProgress = false;
+            ch.touchAcceptAt = esp_timer_get_time() + TOUCH_REARM_DELAY_MS * 1000LL;
+            ch.dispenses++;
+            logDispense(ch.index, ch.dispenseTrigger.gesture, ch.lastMessage,
+                        (uint32_t)(micros() - ch.dispenseTrigger.pressUs) / 1000, ch.dispenseFlags,
+                        min(ch.planPills, (uint16_t)DLOG_PILLS_MAX));
+            if (isDispenseLogCommitDue(false)) scheduleIn(taskLogCommit, 0);
+            armIdleSleep();
+            break;
+
+        case DISPENSE_DONE:
+            break;
+    }
+}
+
+// Write a batch of dispense records to flash, between sequences only
+void logCommitTask() {
+    if (anyTouchInProgress()) return;  // The sequence schedules another commit when it finishes
+    if (!commitDispenseLog()) logEvent<LOG_DISPENSE_LOG_FAILED>();
+}
+
+// Deep sleep until touched or the next dose. Does not return: the wake is a new boot that
+// resumes from the retained state.
+void enterDeepSleep() {
+    uint64_t touchMask = 0;
+    for (Channel& ch : channels) {
+        retainChannel(ch.index, ch.motion, ch.anim);
+        touchMask |= 1ULL << ch.touchPin;
+    }
+    saveRetainedState();
+    digitalWrite(LED_PIN, LOW);
+    gpio_hold_en((gpio_num_t)LED_PIN);
+    gpio_deep_sleep_hold_en();
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+    esp_deep_sleep_enable_gpio_wakeup(touchMask, ESP_GPIO_WAKEUP_GPIO_HIGH);
+    armDoseWake();
+    drainLog();
+    Serial.flush();
+    energyDeepSleep();
+    esp_deep_sleep_start();
+}
+
+// Without a deep sleep capable touch pin: light sleep until touched or the
+// next dose, then pick the idle animation up again
+void idleLightSleep() {
+    for (Channel& ch : channels) cancelTask(ch.taskAnimation);
+    cancelTask(taskDebug);
+    waitForDisplayIdle();
+    drainLog();
+    if (power.autoSleep) {
+        uint32_t waitSec;
+        uint32_t waitMs = doseDeadline(waitSec) ? waitSec * 1000UL + 1000 : POWER_WAIT_FOREVER;
+        clearWake();  // Only edges from now on count
+        bool edges = false;
+        for (const Channel& ch : channels) edges |= hasTouchEdges(ch.touch);
+        if (!edges) idleWait(waitMs);
+    } else {
+        gpio_hold_en((gpio_num_t)LED_PIN);
+        armDoseWake();
+        armTouchWake();
+        energyEnter(ENERGY_LIGHT_SLEEP);
+        trace(TRACE_SLEEP, TRACE_BEGIN, 0);
+        int64_t sleptFrom = esp_timer_get_time();
+        esp_light_sleep_start();
+        trace(TRACE_SLEEP, TRACE_END, (uint32_t)(esp_timer_get_time() - sleptFrom));
+        energyEnter(ENERGY_ACTIVE);
+        energyCountWakeup();
+        disarmTouchWake();
+        gpio_hold_dis((gpio_num_t)LED_PIN);
+    }
+
+    for (Channel& ch : channels) setPanelPower(ch.display, true);
+    scheduleIn(taskDebug, DEBUG_INTERVAL_MS);
+    scheduleIn(taskDose, 0);
+    armIdleSleep();
+}
+
+// Nobody touched the device for IDLE_SLEEP_MS: stop animating until they do,
+// unless a dose is due and its reminder has to stay up
+void idleSleepTask() {
+    if (anyTouchInProgress() || isSleepInhibited() || isDoseDue() || assetUpload.active) {
+        armIdleSleep();
+        return;
+    }
+    logEvent<LOG_IDLE_SLEEP>();
+    if (isDispenseLogCommitDue(true)) commitDispenseLog();  // Pending records stay in RTC memory otherwise
+    bool deepSleepWake = true;
+    for (Channel& ch : channels) {
+        if (IDLE_PANEL_OFF) setPanelPower(ch.display, false);
+        deepSleepWake &= esp_sleep_is_valid_wakeup_gpio((gpio_num_t)ch.touchPin);
+    }
+    if (deepSleepWake) {
+        enterDeepSleep();
+    }
+    idleLightSleep();
+}
+
+// Debug output (every 5 seconds)
+void debugTask() {
+    logEvent<LOG_DEBUG>(digitalRead(channels[0].touchPin), isAnimating(channels[0].anim), interruptCounter);
+    scheduleIn(taskDebug, DEBUG_INTERVAL_MS);
+}
+
+// Swap the content in or out: nothing may keep playing from a bundle that
+// is about to be overwritten or was just replaced. The loop starts the idle
+// animation again.
+void reloadAssets(bool fromBundle) {
+    for (Channel& ch : channels) {
+        cancelTask(ch.taskAnimation);
+        stopAnimation(ch.display, ch.anim);
+        ch.lastMessage = -1;
+    }
+    if (fromBundle) {
+        loadAssets();
+    } else {
+        unloadAssets();
+    }
+    initMessagePool();
+}
+
+// Per channel: flushes and bytes sent to its panel, how late its frames were
+// drawn, dispenses, and pills with the rate the servo dropped them at.
+// Lateness spread evenly over the channels is the bus being shared fairly.
+void printChannelReport(Print& out) {
+    out.println("channel flushes bytes late_avg_us late_max_us dispenses pills pills_per_min");
+    for (const Channel& ch : channels) {
+        uint32_t rate = pillsPerMinute100(ch.pills, ch.motionMs);
+        out.printf("%u %lu %lu %lu %lu %lu %lu %lu.%02lu\n", ch.index, (unsigned long)ch.display.stats.flushes,
+                   (unsigned long)ch.display.stats.bytes,
+                   (unsigned long)(ch.timedFrames ? ch.lateSumUs / ch.timedFrames : 0),
+                   (unsigned long)ch.lateMaxUs, (unsigned long)ch.dispenses, (unsigned long)ch.pills,
+                   (unsigned long)(rate / 100), (unsigned long)(rate % 100));
+    }
+}
+
+void resetChannelStats() {
+    for (Channel& ch : channels) {
+        ch.display.stats = {};
+        ch.dispenses = ch.timedFrames = ch.lateMaxUs = ch.pills = ch.motionMs = 0;
+        ch.lateSumUs = 0;
+    }
+}
+
+// Feed serial input to the asset upload until it ends
+void assetUploadTask() {
+    switch (pollAssetUpload(Serial, Serial)) {
+        case ASSET_UPLOAD_RUNNING:
+            scheduleIn(taskAssetUpload, ASSET_UPLOAD_POLL_MS);
+            break;
+        case ASSET_UPLOAD_DONE:
+            logEvent<LOG_ASSETS_LOADED>(assetVersion());
+            reloadAssets(true);  // The new bundle is loaded already; this brings it on screen
+            break;
+        case ASSET_UPLOAD_ABORTED:
+            reloadAssets(true);  // Whatever valid bundle the partition still holds, if any
+            break;
+    }
+}
+
+// Start the dispense sequence for `pills`
+void startDispense(Channel& ch, const TouchEvent& trigger, const DosePills& pills) {
+    ch.touchInProgress = true;  // Prevent reentrance
+    ch.dispenseTrigger = trigger;
+    ch.dosePills = pills;
+    cancelTask(taskIdleSleep);
+
+    // The sequence takes over the screen from the idle animation
+    cancelTask(ch.taskAnimation);
+
+    ch.dispenseStep = DISPENSE_START;
+    scheduleIn(ch.taskDispense, 0);
+}
 
+// Drop what is left of a serial line, e.g. after an argument that is no good
+void skipSerialLine() {
+    uint32_t start = millis();
+    while (millis() - start < SERIAL_ARG_TIMEOUT_MS) {
+        int c = Serial.read();
+        if (c == '\n' || c == '\r') return;
+        if (c < 0) delay(1);
+    }
+}
+
+// The digits after a query letter, up to the end of its line. At 9600 baud
+// the rest of the line is usually still on its way when the letter is read,
+// so this waits for it, up to SERIAL_ARG_TIMEOUT_MS between characters.
+// Returns how many digits went into `digits`; 0 for no digits, anything
+// else on the line, more than `size` of them or a line that never ended.
+uint8_t readSerialDigits(char* digits, uint8_t size) {
+    uint8_t n = 0;
+    uint32_t lastMs = millis();
+    for (;;) {
+        int c = Serial.read();
+        if (c < 0) {
+            if (millis() - lastMs >= SERIAL_ARG_TIMEOUT_MS) return 0;
+            delay(1);
+            continue;
+        }
+        lastMs = millis();
+        if (c == '\n' || c == '\r') return n;
+        if (c < '0' || c > '9' || n >= size) {
+            skipSerialLine();
+            return 0;
+        }
+        digits[n++] = c;
+    }
+}
+
+// Serial queries: 'e' prints the energy report, 'r' resets the counters,
+// 't' prints touch gesture counts and latency, 'd' the dose schedule state,
+// 'T<seconds>' sets the clock, 'P<pills>' dispenses a dose on the first
+// channel, 'l' streams the dispense log as CSV, 'x' dumps the trace ring, 'a'
+// prints what each animation has cost, 'c' what each channel has, 'U' starts
+// an asset bundle upload (asset_upload.h). 'T' and 'P' take their
+// argument up to the end of the line.
+void handleSerialQuery() {
+    if (assetUpload.active) return;  // Serial input belongs to the upload
+    while (Serial.available() > 0) {
+        switch (Serial.read()) {
+            case 'e':
+                printEnergyReport(Serial);
+                break;
+            case 'r':
+                energyReset();
+                resetAnimationStats();
+                resetChannelStats();
+                Serial.println("Energy counters reset");
+                break;
+            case 't':
+                printTouchReport(Serial);
+                break;
+            case 'd':
+                printDoseReport(Serial);
+                break;
+            case 'l':
+                printDispenseLog(Serial);
+                break;
+            case 'a':
+                printAnimationReport(Serial);
+                break;
+            case 'c':
+                printChannelReport(Serial);
+                break;
+            case 'x':
+                printTaskNames(Serial);
+                dumpTrace(Serial);
+                break;
+            case 'T': {
+                // Set the wall clock: T<local time in seconds since 1970>, then a line end
+                char digits[10];
+                uint8_t n = readSerialDigits(digits, sizeof(digits));
+                uint64_t epoch = 0;
+                for (uint8_t i = 0; i < n; i++) epoch = epoch * 10 + (digits[i] - '0');
+                if (n == 0 || epoch > UINT32_MAX) {
+                    Serial.println("bad time");
+                    break;
+                }
+                setDoseClock((uint32_t)epoch);
+                scheduleIn(taskDose, 0);
+                printDoseReport(Serial);
+                break;
+            }
+            case 'P': {
+                // Dispense: P<pills from compartment 0><from compartment 1>..., a digit each, then a line end
+                char digits[DOSE_MAX_COMPARTMENTS];
+                uint8_t n = readSerialDigits(digits, sizeof(digits));
+                if (n == 0) {
+                    Serial.println("bad dose");
+                    break;
+                }
+                DosePills pills = {};
+                for (uint8_t i = 0; i < n; i++) pills.count[i] = digits[i] - '0';
+                if (!bootComplete || channels[0].touchInProgress) {
+                    Serial.println("dispense busy");
+                    break;
+                }
+                startDispense(channels[0], {TOUCH_NONE, (uint32_t)micros()}, pills);
+                break;
+            }
+            case 'U':
+                if (anyTouchInProgress()) {
+                    assetUploadReply(Serial, "error busy", 0);
+                    break;
+                }
+                reloadAssets(false);
+                beginAssetUpload(Serial);
+                scheduleIn(taskAssetUpload, ASSET_UPLOAD_POLL_MS);
+                return;
+        }
+    }
+}
+
+// Start the dispense sequence for a tap: the due dose, or else a single pill
+void startTouchSequence(Channel& ch, const TouchEvent& ev) {
+    const DosePills* due = dueDosePills();
+    startDispense(ch, ev, due ? *due : singlePill);
+}
+
+// Tap dispenses, double tap shows the last message again, long press prints
+// the touch and energy reports
+void handleGesture(Channel& ch, const TouchEvent& ev) {
+    static const LogId gestureLogs[] = {LOG_TOUCH_TAP, LOG_TOUCH_DOUBLE_TAP, LOG_TOUCH_LONG_PRESS};
+    if (ev.gesture >= TOUCH_TAP) logWrite(gestureLogs[ev.gesture - TOUCH_TAP], nullptr, 0);
+
+    // Presses that began during a sequence, or right after it, are not for
+    // us, nor are presses while new content is being uploaded
+    int64_t pressedAt = esp_timer_get_time() - (uint32_t)(micros() - ev.pressUs);
+    if (ch.touchInProgress || pressedAt < ch.touchAcceptAt || assetUpload.active) return;
+
+    switch (ev.gesture) {
+        case TOUCH_TAP:
+            startTouchSequence(ch, ev);
+            break;
+        case TOUCH_DOUBLE_TAP:
+            cancelTask(ch.taskAnimation);
+            showMessage(ch, ch.lastMessage >= 0 ? ch.lastMessage : random(0, messagePoolCount));
+            break;
+        case TOUCH_LONG_PRESS:
+            printTouchReport(Serial);
+            printEnergyReport(Serial);
+            break;
+        default:
+            return;
+    }
+    recordTouchLatency(micros() - ev.pressUs);
+    if (!anyTouchInProgress()) armIdleSleep();
+}
+
+// Turn queued touch edges into gestures, and come back when a debounce or
+// gesture timeout is due
+void touchTask() {
+    if (!bootComplete) return;  // Edges stay queued until init is done
+    bool pending = false;
+    uint32_t nextUs = 0;
+    for (Channel& ch : channels) {
+        updateTouch(ch.touch, micros());
+        TouchEvent ev;
+        while (nextTouchEvent(ch.touch, ev)) {
+            handleGesture(ch, ev);
+        }
+        uint32_t waitUs;
+        if (touchDeadline(ch.touch, micros(), waitUs) && (!pending || waitUs < nextUs)) {
+            pending = true;
+            nextUs = waitUs;
+        }
+    }
+    if (pending) {
+        scheduleIn(taskTouch, (nextUs + 999) / 1000);
+    } else {
+        cancelTask(taskTouch);
+    }
+}
+
+// Sleep until the earliest task deadline; a touch also wakes us from light sleep
+void sleepUntilNextTask() {
+    uint32_t waitMs = timeToNextTask();
+    if (waitMs == 0) return;
+    drainLog();  // Nothing else to do until then
+
+    if (power.autoSleep) {
+        idleWait(waitMs);
+        return;
+    }
+
+    if (waitMs <= LIGHT_SLEEP_MIN_MS || isSleepInhibited()) {
+        energyEnter(ENERGY_DELAY);
+        delay(waitMs);
+        energyEnter(ENERGY_ACTIVE);
+        return;
+    }
+
+    waitForDisplayIdle();  // Light sleep would stall the I2C transfer
+
+    // Hold only the LED pin state - do NOT hold the servo pin
+    gpio_hold_en((gpio_num_t)LED_PIN);
+    for (const Channel& ch : channels) gpio_hold_en((gpio_num_t)ch.servoPin);
+
+    // Enable wake up from timer and touch pin
+    esp_sleep_enable_timer_wakeup((uint64_t)waitMs * 1000); // microseconds
+    armTouchWake();
+    energyEnter(ENERGY_LIGHT_SLEEP);
+    trace(TRACE_SLEEP, TRACE_BEGIN, waitMs * 1000);
+    int64_t sleptFrom = esp_timer_get_time();
+    esp_light_sleep_start();
+    trace(TRACE_SLEEP, TRACE_END, (uint32_t)(esp_timer_get_time() - sleptFrom));
+    energyEnter(ENERGY_ACTIVE);
+    energyCountWakeup();
+    disarmTouchWake();
+
+    // After waking up, disable pin hold
+    gpio_hold_dis((gpio_num_t)LED_PIN);
+}
+
+// Everything not needed for the first frame; runs from the scheduler right after it
+void deferredInitTask() {
     ESP32PWM::allocateTimer(0);
     ESP32PWM::allocateTimer(1);
     ESP32PWM::allocateTimer(2);
     ESP32PWM::allocateTimer(3);
-    myservo.setPeriodHertz(50);    // standard 50 hz servo
+    for (Channel& ch : channels) {
+        ch.servo.setPeriodHertz(50);    // standard 50 hz servo
+
+        // Initialize servo
+        ch.servo.attach(ch.servoPin);
+        if (warmBoot) {
+            // Position is known from before the deep sleep, no homing sweep
+            int16_t angle = retained.channels[ch.index].servoAngle;
+            initServoMotion(ch.motion, ch.servo, ch.servoPin, SERVO_MIN_ANGLE, SERVO_MAX_ANGLE, angle);
+            ch.servo.write(angle);
+        } else {
+            initServoMotion(ch.motion, ch.servo, ch.servoPin, SERVO_MIN_ANGLE, SERVO_MAX_ANGLE, SERVO_MIN_ANGLE);
+            moveServoSmooth(ch, SERVO_MIN_ANGLE);  // Move to initial position smoothly
+        }
+    }
 
-    // Initialize servo
-    myservo.attach(SERVO_PIN);
-    moveServoSmooth(SERVO_MIN_ANGLE);  // Move to initial position smoothly
-    
     // Configure LED pin for hold during sleep - DO NOT include servo pin
     gpio_config_t io_conf = {};
     io_conf.mode = GPIO_MODE_OUTPUT;
@@ -116,170 +812,169 @@ void setup() {
     io_conf.intr_type = GPIO_INTR_DISABLE;
     gpio_config(&io_conf);
 
-    // Set up touch pin with interrupt and pull-down resistor
-    pinMode(TOUCHPIN, INPUT_PULLDOWN);  // Add pull-down to prevent floating
-    attachInterrupt(digitalPinToInterrupt(TOUCHPIN), touchInterrupt, RISING);
-    
-    // Enable wake-up on GPIO pin
-    gpio_wakeup_enable((gpio_num_t)TOUCHPIN, GPIO_INTR_HIGH_LEVEL);
-    esp_sleep_enable_gpio_wakeup();
+    // Initialize random seed once at startup
+    randomSeed(analogRead(0));
+    initMessagePool();
 
-    pinMode(LED_PIN, OUTPUT);
-    digitalWrite(LED_PIN, LOW);  // Ensure LED is off initially
+    scheduleIn(taskDebug, DEBUG_INTERVAL_MS);
+    scheduleIn(taskDose, 0);
+    armIdleSleep();
+    bootComplete = true;
 
-    // Initialize display with debug messages
-    Serial.println("Initializing display...");
-    if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
-        Serial.println(F("SSD1306 allocation failed"));
+    // Frequency scaling from here on, after the homing sweep needed a steady PWM
+    initPowerManagement();
+    for (Channel& ch : channels) stopServoPwm(ch.motion);
+    if (power.autoSleep) {
+        // Sleeps happen on their own from now on: keep the LED and the touch
+        // pull-downs as they are, and have the touch pins wake us at any time
+        gpio_sleep_sel_dis((gpio_num_t)LED_PIN);
+        for (Channel& ch : channels) {
+            gpio_sleep_sel_dis((gpio_num_t)ch.touchPin);
+            gpio_wakeup_enable((gpio_num_t)ch.touchPin, isTouchPressed(ch.touch) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+        }
+        esp_sleep_enable_gpio_wakeup();
     }
-    Serial.println("Display initialized successfully!");
-    
-    display.clearDisplay();
-    display.setRotation(0);
-    display.setTextColor(WHITE);
-    display.setTextSize(1);
-    display.setCursor(0,0);
-    display.println("Starting up...");
-    display.display();
-    delay(10);  // Show startup message for 1 second
 
-    // Initialize random seed once at startup
-    randomSeed(analogRead(0));
-    
-    // Print power saving mode info
-    Serial.println("Power saving mode active - CPU at 80MHz with light sleep");
+    if (warmBoot) {
+        logEvent<LOG_FIRST_FRAME_WARM>(firstFrameUs);
+    } else {
+        logEvent<LOG_FIRST_FRAME_COLD>(firstFrameUs);
+    }
+    logEvent<LOG_POWER_MANAGEMENT>(power.dfs ? POWER_MIN_MHZ : getCpuFrequencyMhz(), power.dfs ? POWER_MAX_MHZ : getCpuFrequencyMhz(), power.autoSleep);
+
+    // Everything is allocated by now; from here on the heap must stay untouched
+    armHeapGuard();
 }
 
-void loop() {
-    // Make sure LED is explicitly OFF at the beginning of each loop iteration
-    digitalWrite(LED_PIN, LOW);
-    
-    // Handle touch event (from interrupt) - only if no sequence is already running
-    if (touchDetected && !touchInProgress) {
-        detachInterrupt(digitalPinToInterrupt(TOUCHPIN));  // Disable interrupt during sequence
-        touchInProgress = true;  // Prevent reentrance
-        
-        // Get current touch state and verify it's really HIGH
-        bool currentTouchState = digitalRead(TOUCHPIN);
-        Serial.print("Touch detected: ");
-        Serial.println(currentTouchState);
-        Serial.print("Interrupt count: ");
-        Serial.println(interruptCounter);
-        
-        if (currentTouchState == HIGH) {
-            // No need to be power efficient during touch sequence
-            gpio_hold_dis((gpio_num_t)SERVO_PIN);
-            
-            display.clearDisplay();
-            display.setCursor(0,0);
-            display.setTextSize(1.5);
-            display.println("Giving u some meds");
-            display.display();
-
-            // 1. Perform a sequence of servo movements
-            Serial.println("Starting servo sequence");
-            
-            // First movement: Home position
-            moveServoSmooth(SERVO_MAX_ANGLE);
-            delay(1000);  // Pause at position
-            
-            moveServoSmooth(SERVO_MIN_ANGLE);
-            delay(500);  // Pause at position
-
-            moveServoSmooth(SERVO_MAX_ANGLE);
-            delay(10);  // small pause for stability
+void setup() {
+    // The clock is left to esp_pm once the deferred init is done (power_management.h)
 
-            gpio_hold_dis((gpio_num_t)LED_PIN);
-            // 2. Show scrolling text message
-            int randomIndex = random(0, messageCount);
-            String message = messages[randomIndex];
-            Serial.print("Showing message: ");
-            Serial.println(message);
-            
-            showScrollingText(display, message, 30); // Faster scrolling (30ms)
-            
-            // Wait for text scrolling to complete
-            while (isAnimating()) {
-                updateAnimation(display);
-                delay(5);
-            }
-            
-            // 3. Show dancing couple animation
-            Serial.println("Starting dancing couple animation");
-            startAnimation(drawDancingCouple, "frame1", "frame2", 20, 150, display);
-            
-            // Wait for dancing animation to complete
-            while (isAnimating()) {
-                updateAnimation(display);
-                delay(5);
-            }
+    warmBoot = isWarmBoot();
+    if (warmBoot) {
+        energyWake();
+        energyCountWakeup();
+        gpio_hold_dis((gpio_num_t)LED_PIN);
+        gpio_deep_sleep_hold_dis();
+    }
 
-            Serial.println("Touch sequence complete");
-        }
-        
-        // Reset touch flags after sequence is complete
-        touchDetected = false;
-        touchInProgress = false;
-        
-        // Wait to make sure the touch is released before re-enabling interrupt
-        while (digitalRead(TOUCHPIN) == HIGH) {
-            delay(100);
+    Serial.begin(9600);
+    logEvent<LOG_BOOT>(LOG_FORMAT_COUNT, warmBoot);
+    size_t wireBuffer = Wire.setBufferSize(DISPLAY_WIRE_BUFFER);  // Whole frame in one transaction
+    Wire.begin(SDA, SCL);
+
+    static const uint8_t touchPins[CHANNEL_MAX] = CHANNEL_TOUCH_PINS;
+    static const uint8_t servoPins[CHANNEL_MAX] = CHANNEL_SERVO_PINS;
+    for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+        channels[i].index = i;
+        channels[i].touchPin = touchPins[i];
+        channels[i].servoPin = servoPins[i];
+        channels[i].display.channel = i;
+    }
+
+    // Set up touch pins with interrupt and pull-down resistor; light sleep
+    // wake on them is armed before each sleep
+    uint64_t wokenBy = 0;
+    if (warmBoot && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) wokenBy = esp_sleep_get_gpio_wakeup_status();
+    for (Channel& ch : channels) {
+        pinMode(ch.touchPin, INPUT_PULLDOWN);  // Add pull-down to prevent floating
+        if (wokenBy & (1ULL << ch.touchPin)) {
+            // The touch that woke us pressed at boot, it may already be released
+            touchLevelSample(ch.touch, true, (uint32_t)(micros() - esp_timer_get_time()));
+            touchLevelSample(ch.touch, digitalRead(ch.touchPin) == HIGH, micros());
         }
-        delay(500);  // Additional debounce delay
-        
-        attachInterrupt(digitalPinToInterrupt(TOUCHPIN), touchInterrupt, RISING);
+        attachInterruptArg(digitalPinToInterrupt(ch.touchPin), touchInterrupt, &ch, CHANGE);
     }
-    
-    // If no animation is running, return to the power-efficient default state
-    if (!isAnimating()) {
-        // Ensure LED is off in default mode
-        digitalWrite(LED_PIN, LOW);
-        startAnimation(drawLadyAndGentleman, "small", "big", 100, 500, display);
+
+    pinMode(LED_PIN, OUTPUT);
+    digitalWrite(LED_PIN, LOW);  // Ensure LED is off initially
+
+    // Register the scheduler tasks
+    for (Channel& ch : channels) {
+        ch.taskAnimation = addChannelTask(animationTask, ch.index, "animation");
+        ch.taskServo = addChannelTask(servoTask, ch.index, "servo");
+        ch.taskDispense = addChannelTask(dispenseTask, ch.index, "dispense");
     }
-    
-    // Update animation with power-saving (only in default state)
-    if (isAnimating()) {
-        // Get time until next animation frame
-        unsigned long currentTime = millis();
-        unsigned long timeSinceLastFrame = currentTime - animState.lastFrameTime;
-        unsigned long timeToNextFrame = 0;
-        
-        if (timeSinceLastFrame < animState.delayMs) {
-            timeToNextFrame = animState.delayMs - timeSinceLastFrame;
+    taskTouch = addTask(touchTask, "touch");
+    taskDebug = addTask(debugTask, "debug");
+    taskDeferredInit = addTask(deferredInitTask, "init");
+    taskIdleSleep = addTask(idleSleepTask, "idle sleep");
+    taskDose = addTask(doseTask, "dose");
+    taskLogCommit = addTask(logCommitTask, "log commit");
+    taskAssetUpload = addTask(assetUploadTask, "asset upload");
+
+    // Before anything is drawn: the retained animation may be one of the bundle's
+    if (loadAssets()) logEvent<LOG_ASSETS_LOADED>(assetVersion());
+
+    if (warmBoot) {
+        // The panels are still configured and showing panelShadow: pick up where we left off
+        for (Channel& ch : channels) ch.display.resume(panelAddress(ch.index));
+        startDisplayPipeline(wireBuffer);
+        for (Channel& ch : channels) {
+            const RetainedChannel& r = retained.channels[ch.index];
+            if (r.anim && isKnownAnimation(r.anim)) {
+                resumeAnimation(ch.anim, *r.anim, r.frameIndex, r.currentLoop);
+                animationTask(ch.index);
+            }
         }
-        
-        // First update the animation
-        updateAnimation(display);
-        
-        // Then sleep until next frame if there's enough time
-        if (timeToNextFrame > 20) { // Only sleep if it's worth it (> 20ms)
-            // Hold only the LED pin state - do NOT hold the servo pin
-            gpio_hold_en((gpio_num_t)LED_PIN);
-            gpio_hold_en((gpio_num_t)SERVO_PIN);
-            
-            // Enable wake up from timer and touch pin
-            esp_sleep_enable_timer_wakeup(timeToNextFrame * 1000); // microseconds
-            esp_light_sleep_start();
-            
-            // After waking up, disable pin hold
-            gpio_hold_dis((gpio_num_t)LED_PIN);
+        for (Channel& ch : channels) {
+            setPanelPower(ch.display, true);  // After the first frame, so the wake shows it straight away
         }
     } else {
-        // If nothing to animate, sleep for a short time
-        delay(10);
-    }
-    
-    // Debug output (every 5 seconds)
-    static unsigned long lastDebugTime = 0;
-    if (millis() - lastDebugTime > 5000) { // Print debug info every 5 seconds
-        Serial.print("Touch pin state: ");
-        Serial.println(digitalRead(TOUCHPIN));
-        Serial.print("Animation running: ");
-        Serial.println(isAnimating());
-        Serial.print("Interrupt count: ");
-        Serial.println(interruptCounter);
-        Serial.println("-------------------");
-        lastDebugTime = millis();
+        delay(10);  // Panel power-up
+
+        // Initialize display with debug messages
+        logEvent<LOG_DISPLAY_INIT>();
+        for (Channel& ch : channels) {
+            selectPanel(ch.index);
+            if(!ch.display.begin(SSD1306_SWITCHCAPVCC, panelAddress(ch.index))) {
+                logEvent<LOG_DISPLAY_FAILED>();
+            }
+        }
+        logEvent<LOG_DISPLAY_READY>();
+        startDisplayPipeline(wireBuffer);
+
+        for (Channel& ch : channels) {
+            RetainedSSD1306& display = ch.display;
+            display.clearDisplay();
+            display.setRotation(0);
+            display.setTextColor(WHITE);
+            display.setTextSize(1);
+            display.setCursor(0,0);
+            display.println("Starting up...");
+            invalidateDisplay(display);
+            flushDirty(display);
+        }
     }
+    waitForDisplayIdle();
+    firstFrameUs = esp_timer_get_time();
+
+    scheduleIn(taskDeferredInit, 0);
 }
 
+void loop() {
+    // Make sure LED is explicitly OFF at the beginning of each loop iteration
+    digitalWrite(LED_PIN, LOW);
+
+    // Gestures from the touch edges queued by the interrupt
+    touchTask();
+
+    handleSerialQuery();
+    runDueTasks();
+
+    // If nothing else is using a screen, return to the power-efficient default animation
+    for (Channel& ch : channels) {
+        if (!ch.touchInProgress && !isTaskScheduled(ch.taskAnimation)) {
+            digitalWrite(LED_PIN, LOW);
+            if (!isAnimating(ch.anim)) {
+                startAnimation(ch.anim, idleAnimation());
+            } else {
+                // Its task was cancelled (idle sleep): the pause is not lateness
+                rebaseFrameClock(ch.anim, millis());
+            }
+            scheduleAt(ch.taskAnimation, nextFrameTime(ch.anim));
+        }
+    }
+
+    checkHeapGuard();
+    sleepUntilNextTask();
+}
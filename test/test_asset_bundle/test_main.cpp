@@ -0,0 +1,139 @@
+// Asset bundle checks (asset_bundle.h): anything but a whole, intact bundle
+// leaves the compiled-in content in place
+
+#include <unity.h>
+#include "sim.h"
+#include "asset_bundle.h"
+
+// Header, one message and its text
+struct TestBundle {
+    AssetHeader header;
+    AssetMessage message;
+    char text[4];
+};
+
+static TestBundle bundle;
+
+static void seal() {
+    bundle.header.crc = assetCrc32(0, (const uint8_t*)&bundle + sizeof(AssetHeader), bundle.header.size - sizeof(AssetHeader));
+}
+
+void setUp() {
+    simReset();  // Erases the partitions
+    unloadAssets();
+    memset(&bundle, 0, sizeof(bundle));
+    AssetHeader& h = bundle.header;
+    h.magic = ASSET_MAGIC;
+    h.format = ASSET_FORMAT;
+    h.headerSize = sizeof(AssetHeader);
+    h.size = sizeof(TestBundle);
+    h.version = 7;
+    h.messageCount = 1;
+    h.sprites = h.clips = h.animations = offsetof(TestBundle, message);
+    h.messages = offsetof(TestBundle, message);
+    bundle.message = {offsetof(TestBundle, text), 2, 12};
+    strcpy(bundle.text, "hi");
+    seal();
+}
+
+void tearDown() {}
+
+static bool loadBundle() {
+    const esp_partition_t* part = findAssetPartition();
+    TEST_ASSERT_NOT_NULL(part);
+    esp_partition_erase_range(part, 0, part->size);
+    esp_partition_write(part, 0, &bundle, sizeof(bundle));
+    return loadAssets();
+}
+
+static void assertBuiltin() {
+    TEST_ASSERT_EQUAL(0, assetVersion());
+    for (uint8_t r = 0; r < ANIMATION_ROLE_COUNT; r++) TEST_ASSERT_TRUE(&animationFor((AnimationRole)r) == builtinAnimations[r]);
+    uint8_t count;
+    TEST_ASSERT_NULL(assetMessages(count));
+    TEST_ASSERT_EQUAL(0, count);
+}
+
+void test_crc32_check_value() {
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, assetCrc32(0, (const uint8_t*)"123456789", 9));
+    // In pieces, as the upload computes it
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, assetCrc32(assetCrc32(0, (const uint8_t*)"1234", 4), (const uint8_t*)"56789", 5));
+}
+
+void test_empty_partition() {
+    TEST_ASSERT_FALSE(loadAssets());
+    assertBuiltin();
+}
+
+void test_valid_bundle() {
+    TEST_ASSERT_TRUE(loadBundle());
+    TEST_ASSERT_EQUAL(7, assetVersion());
+    uint8_t count;
+    const AssetMessage* messages = assetMessages(count);
+    TEST_ASSERT_NOT_NULL(messages);
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(0, strcmp((const char*)assets.base + messages[0].text, "hi"));
+}
+
+void test_bad_crc() {
+    bundle.header.crc ^= 1;
+    TEST_ASSERT_FALSE(loadBundle());
+    assertBuiltin();
+}
+
+void test_corrupt_content() {
+    bundle.text[0] = 'H';  // After the CRC was taken
+    TEST_ASSERT_FALSE(loadBundle());
+    assertBuiltin();
+}
+
+void test_bad_header() {
+    bundle.header.magic ^= 1;
+    TEST_ASSERT_FALSE(loadBundle());
+    setUp();
+    bundle.header.format = ASSET_FORMAT + 1;
+    TEST_ASSERT_FALSE(loadBundle());
+    setUp();
+    bundle.header.headerSize = sizeof(AssetHeader) + 4;
+    TEST_ASSERT_FALSE(loadBundle());
+    setUp();
+    bundle.header.size = findAssetPartition()->size + 4;
+    TEST_ASSERT_FALSE(loadBundle());
+    assertBuiltin();
+}
+
+// Checked after the CRC: a bundle can be intact and still point outside itself
+void test_table_outside_bundle() {
+    bundle.header.spriteCount = 1;
+    bundle.header.sprites = sizeof(TestBundle);
+    seal();
+    TEST_ASSERT_FALSE(loadBundle());
+    assertBuiltin();
+
+    setUp();
+    bundle.message.text = sizeof(TestBundle);
+    seal();
+    TEST_ASSERT_FALSE(loadBundle());
+    assertBuiltin();
+}
+
+// A bad bundle after a good one goes back to the compiled-in content
+void test_reload_falls_back() {
+    TEST_ASSERT_TRUE(loadBundle());
+    bundle.header.crc ^= 1;
+    TEST_ASSERT_FALSE(loadBundle());
+    assertBuiltin();
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32_check_value);
+    RUN_TEST(test_empty_partition);
+    RUN_TEST(test_valid_bundle);
+    RUN_TEST(test_bad_crc);
+    RUN_TEST(test_corrupt_content);
+    RUN_TEST(test_bad_header);
+    RUN_TEST(test_table_outside_bundle);
+    RUN_TEST(test_reload_falls_back);
+    return UNITY_END();
+}
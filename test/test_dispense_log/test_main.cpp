@@ -0,0 +1,137 @@
+// Dispense log ring in the simulated "dlog" partition (dispense_log.h)
+
+#include <unity.h>
+#include "sim.h"
+#include "dispense_log.h"
+
+#define RECORDS_PER_SECTOR (DLOG_SECTOR_SIZE / sizeof(DispenseRecord))
+
+void setUp() {
+    simReset();  // Erases the partitions
+    dispenseLog = {};
+    dlogPendingCount = 0;
+    dlogDropped = 0;
+}
+
+void tearDown() {}
+
+// Mount again as after a reboot
+static void remount() {
+    dispenseLog = {};
+    TEST_ASSERT_TRUE(mountDispenseLog());
+}
+
+static void logRecords(uint32_t count) {
+    while (count) {
+        uint32_t batch = min(count, (uint32_t)DLOG_PENDING_MAX);
+        for (uint32_t i = 0; i < batch; i++) logDispense(0, 1, 2, 1500, 0, 1);
+        TEST_ASSERT_TRUE(commitDispenseLog());
+        count -= batch;
+    }
+}
+
+static uint32_t validRecords() {
+    uint32_t valid = 0;
+    DispenseRecord rec;
+    for (uint32_t offset = 0; offset < dispenseLog.size; offset += sizeof(rec)) {
+        esp_partition_read(dispenseLog.partition, offset, &rec, sizeof(rec));
+        if (isDispenseRecordValid(rec)) valid++;
+    }
+    return valid;
+}
+
+void test_mount_empty() {
+    TEST_ASSERT_TRUE(mountDispenseLog());
+    TEST_ASSERT_EQUAL(0, dispenseLog.writeOffset);
+    TEST_ASSERT_EQUAL(0, dispenseLog.nextSeq);
+    TEST_ASSERT_EQUAL(0, dispenseLog.size % DLOG_SECTOR_SIZE);
+}
+
+void test_mount_finds_write_position() {
+    logRecords(3);
+    remount();
+    TEST_ASSERT_EQUAL(3 * sizeof(DispenseRecord), dispenseLog.writeOffset);
+    TEST_ASSERT_EQUAL(3, dispenseLog.nextSeq);
+
+    logRecords(RECORDS_PER_SECTOR);  // Into the second sector
+    remount();
+    TEST_ASSERT_EQUAL((RECORDS_PER_SECTOR + 3) * sizeof(DispenseRecord), dispenseLog.writeOffset);
+    TEST_ASSERT_EQUAL(RECORDS_PER_SECTOR + 3, dispenseLog.nextSeq);
+}
+
+// Past the end writing starts over at the front, erasing the oldest sector
+void test_wrap() {
+    TEST_ASSERT_TRUE(mountDispenseLog());
+    uint32_t ring = dispenseLog.size / sizeof(DispenseRecord);
+    logRecords(ring + 10);
+    remount();
+    TEST_ASSERT_EQUAL(10 * sizeof(DispenseRecord), dispenseLog.writeOffset);
+    TEST_ASSERT_EQUAL(ring + 10, dispenseLog.nextSeq);
+    TEST_ASSERT_EQUAL(ring - RECORDS_PER_SECTOR + 10, validRecords());
+
+    DispenseRecord first;
+    esp_partition_read(dispenseLog.partition, 0, &first, sizeof(first));
+    TEST_ASSERT_EQUAL(ring, first.seq);
+}
+
+// A reset during a write leaves a record that fails its check: it keeps its
+// slot, but its sequence number goes to the next record
+void test_torn_record() {
+    logRecords(5);
+    DispenseRecord torn;
+    memset(&torn, 0xFF, sizeof(torn));
+    torn.seq = 5;
+    torn.time = 1234;
+    esp_partition_write(dispenseLog.partition, 5 * sizeof(torn), &torn, 8);  // The rest never made it
+
+    remount();
+    TEST_ASSERT_EQUAL(6 * sizeof(DispenseRecord), dispenseLog.writeOffset);
+    TEST_ASSERT_EQUAL(5, dispenseLog.nextSeq);
+    TEST_ASSERT_EQUAL(5, validRecords());
+
+    logRecords(1);
+    DispenseRecord rec;
+    esp_partition_read(dispenseLog.partition, 6 * sizeof(rec), &rec, sizeof(rec));
+    TEST_ASSERT_TRUE(isDispenseRecordValid(rec));
+    TEST_ASSERT_EQUAL(5, rec.seq);
+}
+
+// A record torn at the start of a sector leaves the sector before it the
+// newest, and writing goes on by erasing the torn one
+void test_torn_sector_start() {
+    logRecords(RECORDS_PER_SECTOR);
+    DispenseRecord torn;
+    memset(&torn, 0, sizeof(torn));
+    torn.seq = RECORDS_PER_SECTOR;
+    esp_partition_erase_range(dispenseLog.partition, DLOG_SECTOR_SIZE, DLOG_SECTOR_SIZE);
+    esp_partition_write(dispenseLog.partition, DLOG_SECTOR_SIZE, &torn, sizeof(torn));
+
+    remount();
+    TEST_ASSERT_EQUAL(DLOG_SECTOR_SIZE, dispenseLog.writeOffset);
+    TEST_ASSERT_EQUAL(RECORDS_PER_SECTOR, dispenseLog.nextSeq);
+
+    logRecords(1);
+    DispenseRecord rec;
+    esp_partition_read(dispenseLog.partition, DLOG_SECTOR_SIZE, &rec, sizeof(rec));
+    TEST_ASSERT_TRUE(isDispenseRecordValid(rec));
+    TEST_ASSERT_EQUAL(RECORDS_PER_SECTOR, rec.seq);
+}
+
+void test_pending_overflow_is_counted() {
+    for (uint32_t i = 0; i < DLOG_PENDING_MAX + 3; i++) logDispense(0, 1, 2, 1500, 0, 1);
+    TEST_ASSERT_EQUAL(DLOG_PENDING_MAX, dlogPendingCount);
+    TEST_ASSERT_EQUAL(3, dlogDropped);
+    TEST_ASSERT_TRUE(commitDispenseLog());
+    TEST_ASSERT_EQUAL(0, dlogPendingCount);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_mount_empty);
+    RUN_TEST(test_mount_finds_write_position);
+    RUN_TEST(test_wrap);
+    RUN_TEST(test_torn_record);
+    RUN_TEST(test_torn_sector_start);
+    RUN_TEST(test_pending_overflow_is_counted);
+    return UNITY_END();
+}
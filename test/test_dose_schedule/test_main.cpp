@@ -0,0 +1,104 @@
+// Dose schedule (dose_schedule.h), against the compiled-in table: one pill
+// from the first compartment at 08:00 and 20:00 every day, 60 minutes grace
+
+#include <unity.h>
+#include "sim.h"
+#include "dose_schedule.h"
+
+#define SATURDAY 1704499200UL  // 2024-01-06 00:00
+#define HOUR 3600UL
+
+void setUp() {
+    simReset();
+    doseState = {0, -1, 0, 0};
+    doseSlotCount = 0;
+}
+
+void tearDown() {}
+
+void test_no_doses_without_clock() {
+    uint32_t waitSec;
+    TEST_ASSERT_EQUAL(DOSE_NO_CHANGE, updateDoseSchedule());
+    TEST_ASSERT_FALSE(doseDeadline(waitSec));
+    TEST_ASSERT_NULL(dueDosePills());
+}
+
+void test_due_then_taken() {
+    setDoseClock(SATURDAY + 8 * HOUR + 600);
+    TEST_ASSERT_EQUAL(DOSE_NOW_DUE, updateDoseSchedule());
+    TEST_ASSERT_TRUE(isDoseDue());
+    const DosePills* pills = dueDosePills();
+    TEST_ASSERT_NOT_NULL(pills);
+    TEST_ASSERT_EQUAL(1, pills->count[0]);
+
+    uint32_t waitSec;
+    TEST_ASSERT_TRUE(doseDeadline(waitSec));
+    TEST_ASSERT_EQUAL(50 * 60, waitSec);  // To the end of the grace window
+
+    TEST_ASSERT_TRUE(markDoseTaken());
+    TEST_ASSERT_FALSE(markDoseTaken());
+    TEST_ASSERT_EQUAL(DOSE_NO_CHANGE, updateDoseSchedule());  // Taken stays taken
+    TEST_ASSERT_FALSE(isDoseDue());
+    TEST_ASSERT_EQUAL(1, doseState.taken);
+    TEST_ASSERT_TRUE(doseDeadline(waitSec));
+    TEST_ASSERT_EQUAL(12 * HOUR - 600, waitSec);
+}
+
+void test_missed_when_grace_ends() {
+    setDoseClock(SATURDAY + 8 * HOUR);
+    TEST_ASSERT_EQUAL(DOSE_NOW_DUE, updateDoseSchedule());
+    setDoseClock(SATURDAY + 9 * HOUR - 60);
+    TEST_ASSERT_EQUAL(DOSE_NO_CHANGE, updateDoseSchedule());
+    TEST_ASSERT_TRUE(isDoseDue());
+    setDoseClock(SATURDAY + 9 * HOUR);
+    TEST_ASSERT_EQUAL(DOSE_MISSED, updateDoseSchedule());
+    TEST_ASSERT_FALSE(isDoseDue());
+    TEST_ASSERT_EQUAL(1, doseState.missed);
+    TEST_ASSERT_EQUAL(DOSE_NO_CHANGE, updateDoseSchedule());
+    TEST_ASSERT_EQUAL(1, doseState.missed);
+}
+
+// Saturday 20:00 is the last slot of the week: after it comes Sunday 08:00
+void test_week_wrap() {
+    setDoseClock(SATURDAY + 21 * HOUR);
+    TEST_ASSERT_EQUAL(DOSE_NO_CHANGE, updateDoseSchedule());
+    uint32_t waitSec;
+    TEST_ASSERT_TRUE(doseDeadline(waitSec));
+    TEST_ASSERT_EQUAL(11 * HOUR, waitSec);
+
+    setDoseClock(SATURDAY + 32 * HOUR);
+    TEST_ASSERT_EQUAL(8 * 60, minuteOfWeek(doseClockMinutes()));  // Sunday, the start of the week
+    TEST_ASSERT_EQUAL(DOSE_NOW_DUE, updateDoseSchedule());
+}
+
+// A dose still due when the clock jumps past its window, e.g. across a
+// long sleep, is missed and the one due now takes its place
+void test_missed_across_jump() {
+    setDoseClock(SATURDAY + 20 * HOUR);
+    TEST_ASSERT_EQUAL(DOSE_NOW_DUE, updateDoseSchedule());
+    setDoseClock(SATURDAY + 32 * HOUR + 1800);
+    TEST_ASSERT_EQUAL(DOSE_NOW_DUE, updateDoseSchedule());
+    TEST_ASSERT_EQUAL(1, doseState.missed);
+    TEST_ASSERT_EQUAL((int32_t)((SATURDAY + 32 * HOUR) / 60), doseState.dueMin);
+}
+
+// Occurrences that passed while nothing was due are neither due nor missed
+void test_old_occurrences_not_due() {
+    setDoseClock(SATURDAY + 8 * HOUR);
+    TEST_ASSERT_EQUAL(DOSE_NOW_DUE, updateDoseSchedule());
+    TEST_ASSERT_TRUE(markDoseTaken());
+    setDoseClock(SATURDAY + 23 * HOUR);
+    TEST_ASSERT_EQUAL(DOSE_NO_CHANGE, updateDoseSchedule());
+    TEST_ASSERT_EQUAL(0, doseState.missed);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_doses_without_clock);
+    RUN_TEST(test_due_then_taken);
+    RUN_TEST(test_missed_when_grace_ends);
+    RUN_TEST(test_week_wrap);
+    RUN_TEST(test_missed_across_jump);
+    RUN_TEST(test_old_occurrences_not_due);
+    return UNITY_END();
+}
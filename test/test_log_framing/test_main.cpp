@@ -0,0 +1,100 @@
+// Deferred log wire format (deferred_log.h): varint arguments and the COBS
+// frames tools/decode_log.py reads back
+
+#include <unity.h>
+#include "deferred_log.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+// As tools/decode_log.py does it: the frame without its 0x1E and 0x00
+static uint8_t cobsDecode(const uint8_t* in, uint8_t len, uint8_t* out) {
+    uint8_t n = 0;
+    for (uint8_t pos = 0; pos < len;) {
+        uint8_t code = in[pos++];
+        TEST_ASSERT_TRUE(code != 0 && pos + code - 1 <= len);
+        for (uint8_t i = 1; i < code; i++) out[n++] = in[pos++];
+        if (pos < len) out[n++] = 0;
+    }
+    return n;
+}
+
+static void assertFrameRoundTrip(const uint8_t* rec, uint8_t len) {
+    uint8_t frame[LOG_FRAME_MAX];
+    uint8_t n = logFrame(frame, rec, len);
+    TEST_ASSERT_EQUAL(len + 3, n);
+    TEST_ASSERT_EQUAL_HEX8(LOG_FRAME_START, frame[0]);
+    TEST_ASSERT_EQUAL_HEX8(0, frame[n - 1]);
+    for (uint8_t i = 1; i < n - 1; i++) TEST_ASSERT_TRUE(frame[i] != 0);
+
+    uint8_t decoded[LOG_RECORD_MAX];
+    TEST_ASSERT_EQUAL(len, cobsDecode(frame + 1, n - 2, decoded));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(rec, decoded, len);
+}
+
+void test_varint_round_trip() {
+    const uint32_t values[] = {0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 0x1FFFFF, 0x200000, 0x0FFFFFFF, 0x10000000, 0xFFFFFFFF};
+    const uint8_t sizes[] = {1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        uint8_t buf[5];
+        uint8_t len = logPutVarint(buf, 0, values[i]);
+        TEST_ASSERT_EQUAL(sizes[i], len);
+        uint8_t pos = 0;
+        TEST_ASSERT_EQUAL_UINT32(values[i], logGetVarint(buf, len, pos));
+        TEST_ASSERT_EQUAL(len, pos);
+    }
+}
+
+// A cut-off varint reads as far as it goes and stops at the end
+void test_varint_truncated() {
+    uint8_t buf[5];
+    uint8_t len = logPutVarint(buf, 0, 0xFFFFFFFF);
+    uint8_t pos = 0;
+    TEST_ASSERT_EQUAL_UINT32(0x3FFF, logGetVarint(buf, 2, pos));
+    TEST_ASSERT_EQUAL(2, pos);
+    TEST_ASSERT_EQUAL(5, len);
+}
+
+void test_record_encoding() {
+    const uint32_t args[] = {0, 300, 0xFFFFFFFF};
+    uint8_t rec[LOG_RECORD_MAX];
+    uint8_t len = logEncode(rec, LOG_DROPPED, args, 3);
+    TEST_ASSERT_EQUAL(LOG_DROPPED, rec[0]);
+    uint8_t pos = 1;
+    logGetVarint(rec, len, pos);  // millis()
+    for (uint32_t arg : args) TEST_ASSERT_EQUAL_UINT32(arg, logGetVarint(rec, len, pos));
+    TEST_ASSERT_EQUAL(len, pos);
+}
+
+void test_frame_without_zeros() {
+    const uint8_t rec[] = {3, 0x81, 0x01, 0x7F};
+    assertFrameRoundTrip(rec, sizeof(rec));
+}
+
+void test_frame_with_zeros() {
+    const uint8_t rec[] = {0, 5, 0, 0, 9, 0};
+    assertFrameRoundTrip(rec, sizeof(rec));
+    const uint8_t zeros[] = {0, 0, 0};
+    assertFrameRoundTrip(zeros, sizeof(zeros));
+}
+
+// The longest record a logEvent() can make
+void test_frame_longest_record() {
+    const uint32_t args[LOG_MAX_ARGS] = {0xFFFFFFFF, 0, 0x80000000, 0xFFFFFFFF};
+    uint8_t rec[LOG_RECORD_MAX];
+    uint8_t len = logEncode(rec, LOG_DROPPED, args, LOG_MAX_ARGS);
+    TEST_ASSERT_TRUE(len <= LOG_RECORD_MAX);
+    assertFrameRoundTrip(rec, len);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_varint_round_trip);
+    RUN_TEST(test_varint_truncated);
+    RUN_TEST(test_record_encoding);
+    RUN_TEST(test_frame_without_zeros);
+    RUN_TEST(test_frame_with_zeros);
+    RUN_TEST(test_frame_longest_record);
+    return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// Min-travel dispense planner (dispense_planner.h)
+
+#include <unity.h>
+#include <algorithm>
+#include "dispense_planner.h"
+
+static Servo servo;
+static ServoMotion motion;
+
+// Load and drop angles along a 10..170 sweep
+static const DispenseCompartment compartments[] = {
+    {20, 40},
+    {150, 130},
+    {60, 80},
+};
+
+void setUp() {
+    motion = {};
+    initServoMotion(motion, servo, 0, 10, 170, 10);
+}
+
+void tearDown() {}
+
+static DosePills pillsOf(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    return {{a, b, c, d}};
+}
+
+// Travel of visiting compartments in `order`, as the planner counts it
+static int orderTravel(const uint8_t* order, uint8_t n, int from) {
+    int travel = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        travel += abs(compartments[order[i]].loadAngle - from);
+        from = compartments[order[i]].dropAngle;
+    }
+    return travel;
+}
+
+void test_order_from_rest() {
+    uint8_t order[DOSE_MAX_COMPARTMENTS];
+    TEST_ASSERT_EQUAL(3, planCompartmentOrder(compartments, 3, pillsOf(1, 1, 1, 0), 10, order));
+    const uint8_t expected[] = {0, 2, 1};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, order, 3);
+}
+
+void test_order_skips_empty_compartments() {
+    uint8_t order[DOSE_MAX_COMPARTMENTS];
+    TEST_ASSERT_EQUAL(2, planCompartmentOrder(compartments, 3, pillsOf(0, 2, 1, 0), 170, order));
+    const uint8_t expected[] = {1, 2};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, order, 2);
+    TEST_ASSERT_EQUAL(0, planCompartmentOrder(compartments, 3, pillsOf(0, 0, 0, 0), 10, order));
+}
+
+// Against every permutation, from every starting angle
+void test_order_is_least_travel() {
+    for (int from = 10; from <= 170; from += 5) {
+        uint8_t order[DOSE_MAX_COMPARTMENTS];
+        uint8_t n = planCompartmentOrder(compartments, 3, pillsOf(1, 1, 1, 0), from, order);
+        TEST_ASSERT_EQUAL(3, n);
+
+        uint8_t perm[] = {0, 1, 2};
+        int least = INT32_MAX;
+        do {
+            least = std::min(least, orderTravel(perm, 3, from));
+        } while (std::next_permutation(perm, perm + 3));
+        TEST_ASSERT_EQUAL_MESSAGE(least, orderTravel(order, n, from), "not the least travel");
+    }
+}
+
+void test_plan_path() {
+    DosePills pills = pillsOf(1, 0, 1, 0);
+    DispensePlan plan;
+    planDispense(plan, motion, compartments, 3, pills);
+    TEST_ASSERT_EQUAL(2, plan.pills);
+    TEST_ASSERT_EQUAL(4, plan.length);
+    const int expected[] = {20, 40, 60, 80};
+    for (uint8_t i = 0; i < plan.length; i++) TEST_ASSERT_EQUAL(expected[i], plan.path[i].angle);
+    TEST_ASSERT_EQUAL(DISPENSE_LOAD_DWELL_MS, plan.path[0].dwellMs);
+    TEST_ASSERT_EQUAL(DISPENSE_DROP_DWELL_MS, plan.path[1].dwellMs);
+    TEST_ASSERT_EQUAL(70, plan.travelDeg);
+    uint32_t moves = dispenseMoveMs(10) + dispenseMoveMs(20) + dispenseMoveMs(20) + dispenseMoveMs(20);
+    TEST_ASSERT_EQUAL(moves + 2 * (DISPENSE_LOAD_DWELL_MS + DISPENSE_DROP_DWELL_MS), plan.durationMs);
+    TEST_ASSERT_EQUAL(0, pills.count[0] + pills.count[2]);
+}
+
+// A dose larger than the waypoint queue takes several paths, each from
+// where the last one left the horn
+void test_plan_splits_at_queue() {
+    DosePills pills = pillsOf(3, 2, 0, 0);
+    DispensePlan plan;
+    uint8_t total = 0;
+    uint8_t paths = 0;
+    for (;;) {
+        planDispense(plan, motion, compartments, 3, pills);
+        if (plan.length == 0) break;
+        TEST_ASSERT_TRUE(plan.pills <= DISPENSE_MAX_PILLS);
+        TEST_ASSERT_TRUE(plan.length <= SERVO_QUEUE_LEN);
+        total += plan.pills;
+        paths++;
+        motion.angle = plan.path[plan.length - 1].angle;
+    }
+    TEST_ASSERT_EQUAL(5, total);
+    TEST_ASSERT_EQUAL(2, paths);
+    TEST_ASSERT_EQUAL(0, plan.pills);
+}
+
+void test_plan_counts_unplannable() {
+    DosePills pills = pillsOf(1, 0, 2, 3);
+    DispensePlan plan;
+    planDispense(plan, motion, compartments, 2, pills);
+    TEST_ASSERT_EQUAL(5, plan.unplannable);
+    TEST_ASSERT_EQUAL(1, plan.pills);
+    TEST_ASSERT_EQUAL(0, pills.count[2]);
+    TEST_ASSERT_EQUAL(0, pills.count[3]);
+}
+
+// Angles past the servo's range are planned as the servo will move
+void test_plan_clamps_angles() {
+    const DispenseCompartment wide[] = {{0, 200}};
+    DosePills pills = pillsOf(1, 0, 0, 0);
+    DispensePlan plan;
+    motion.angle = 10;
+    planDispense(plan, motion, wide, 1, pills);
+    TEST_ASSERT_EQUAL(1, plan.length);  // The load angle clamps to where the horn is
+    TEST_ASSERT_EQUAL(170, plan.path[0].angle);
+    TEST_ASSERT_EQUAL(160, plan.travelDeg);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_order_from_rest);
+    RUN_TEST(test_order_skips_empty_compartments);
+    RUN_TEST(test_order_is_least_travel);
+    RUN_TEST(test_plan_path);
+    RUN_TEST(test_plan_splits_at_queue);
+    RUN_TEST(test_plan_counts_unplannable);
+    RUN_TEST(test_plan_clamps_angles);
+    return UNITY_END();
+}
@@ -0,0 +1,90 @@
+// Sprite codecs (sprite_blit.h): the RLE sprites and XOR-delta clips that
+// tools/convert_sprites.py generates must decode to the images.h bitmaps
+// they were made from
+
+#include <unity.h>
+#include "sprites.h"
+#include "images.h"
+
+static RetainedSSD1306 display;
+
+void setUp() {
+    display.resume(SCREEN_ADDRESS);
+}
+
+void tearDown() {}
+
+// Pixel of a row-major, MSB-first bitmap (Adafruit drawBitmap layout)
+static bool imagePixel(const uint8_t* image, int width, int x, int y) {
+    return image[y * ((width + 7) / 8) + x / 8] & (0x80 >> (x & 7));
+}
+
+static bool framePixel(int x, int y) {
+    return display.getBuffer()[(y / 8) * SCREEN_WIDTH + x] & (1 << (y & 7));
+}
+
+// The whole framebuffer is `image` at (x, y) and nothing else
+static void assertFrameShows(const uint8_t* image, int width, int height, int x, int y) {
+    for (int py = 0; py < SCREEN_HEIGHT; py++) {
+        for (int px = 0; px < SCREEN_WIDTH; px++) {
+            bool inside = px >= x && px < x + width && py >= y && py < y + height;
+            bool expected = inside && imagePixel(image, width, px - x, py - y);
+            TEST_ASSERT_EQUAL_MESSAGE(expected, framePixel(px, py), "pixel differs from images.h");
+        }
+    }
+}
+
+void test_raw_sprite() {
+    drawSprite(display, sprite_lady, 3, 5);
+    assertFrameShows(lady, sprite_lady.width, sprite_lady.height, 3, 5);
+}
+
+void test_rle_sprite() {
+    TEST_ASSERT_EQUAL(SPRITE_RLE, sprite_big_heart.format);
+    drawSprite(display, sprite_big_heart, 0, 0);
+    assertFrameShows(big_heart, sprite_big_heart.width, sprite_big_heart.height, 0, 0);
+}
+
+// Off the page grid the decoded bytes straddle two pages
+void test_rle_sprite_unaligned() {
+    drawSprite(display, sprite_big_heart, 50, 13);
+    assertFrameShows(big_heart, sprite_big_heart.width, sprite_big_heart.height, 50, 13);
+}
+
+// Frame 0, each delta in turn, and the last delta back to frame 0
+void test_clip_round_trip() {
+    const SpriteClip& clip = clip_dancing_couple;
+    TEST_ASSERT_EQUAL(2, clip.frameCount);
+    drawClipKey(display, clip, 20, 0);
+    assertFrameShows(dancing_couple_1, 39, 32, 20, 0);
+    advanceClip(display, clip, 0, 20, 0);
+    assertFrameShows(dancing_couple_2, 31, 32, 24, 0);
+    advanceClip(display, clip, 1, 20, 0);
+    assertFrameShows(dancing_couple_1, 39, 32, 20, 0);
+}
+
+// Every byte a delta changes lies inside the area it marks for the flush
+void test_clip_delta_marks_changed_columns() {
+    const SpriteClip& clip = clip_dancing_couple;
+    drawClipKey(display, clip, 0, 0);
+    uint8_t before[SCREEN_WIDTH * SCREEN_PAGES];
+    memcpy(before, display.getBuffer(), sizeof(before));
+    display.frameDirty = {{0xFF, 0xFF, 0xFF, 0xFF}, {0, 0, 0, 0}};
+    advanceClip(display, clip, 0, 0, 0);
+    for (int page = 0; page < SCREEN_PAGES; page++) {
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            if (before[page * SCREEN_WIDTH + x] == display.getBuffer()[page * SCREEN_WIDTH + x]) continue;
+            TEST_ASSERT_TRUE(x >= display.frameDirty.x0[page] && x <= display.frameDirty.x1[page]);
+        }
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_raw_sprite);
+    RUN_TEST(test_rle_sprite);
+    RUN_TEST(test_rle_sprite_unaligned);
+    RUN_TEST(test_clip_round_trip);
+    RUN_TEST(test_clip_delta_marks_changed_columns);
+    return UNITY_END();
+}
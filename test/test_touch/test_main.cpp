@@ -0,0 +1,127 @@
+// Touch gesture recognizer (touch_input.h), fed edges as the pin interrupt would
+
+#include <unity.h>
+#include "touch_input.h"
+
+#define MS 1000UL
+#define T0 (1000 * MS)
+
+static TouchRecognizer touch;
+
+void setUp() {
+    touch = {};
+    touchStats = {};
+}
+
+void tearDown() {}
+
+static void press(uint32_t atUs, uint32_t holdMs) {
+    pushTouchEdge(touch, atUs, true);
+    pushTouchEdge(touch, atUs + holdMs * MS, false);
+}
+
+static TouchGesture nextGesture(uint32_t* pressUs = nullptr) {
+    TouchEvent ev;
+    if (!nextTouchEvent(touch, ev)) return TOUCH_NONE;
+    if (pressUs) *pressUs = ev.pressUs;
+    return ev.gesture;
+}
+
+void test_tap_after_double_tap_window() {
+    press(T0, 100);
+    updateTouch(touch, T0 + (100 + TOUCH_DOUBLE_TAP_MS - 1) * MS);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());
+    updateTouch(touch, T0 + (100 + TOUCH_DOUBLE_TAP_MS) * MS);
+    uint32_t pressUs = 0;
+    TEST_ASSERT_EQUAL(TOUCH_TAP, nextGesture(&pressUs));
+    TEST_ASSERT_EQUAL_UINT32(T0, pressUs);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());
+}
+
+void test_double_tap() {
+    press(T0, 80);
+    press(T0 + 200 * MS, 80);
+    updateTouch(touch, T0 + 280 * MS + TOUCH_DEBOUNCE_MS * MS);
+    uint32_t pressUs = 0;
+    TEST_ASSERT_EQUAL(TOUCH_DOUBLE_TAP, nextGesture(&pressUs));
+    TEST_ASSERT_EQUAL_UINT32(T0 + 200 * MS, pressUs);  // Answered from the second press
+    updateTouch(touch, T0 + 2000 * MS);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());
+    TEST_ASSERT_EQUAL(1, touchStats.doubleTaps);
+    TEST_ASSERT_EQUAL(0, touchStats.taps);
+}
+
+void test_long_press_while_held() {
+    pushTouchEdge(touch, T0, true);
+    updateTouch(touch, T0 + TOUCH_LONG_PRESS_MS * MS - 1);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());
+    updateTouch(touch, T0 + TOUCH_LONG_PRESS_MS * MS);
+    TEST_ASSERT_EQUAL(TOUCH_LONG_PRESS, nextGesture());
+    pushTouchEdge(touch, T0 + 3000 * MS, false);
+    updateTouch(touch, T0 + 4000 * MS);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());  // The release is not a tap
+}
+
+void test_bounce_is_a_glitch() {
+    press(T0, TOUCH_DEBOUNCE_MS / 2);
+    updateTouch(touch, T0 + 1000 * MS);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());
+    TEST_ASSERT_EQUAL(1, touchStats.glitches);
+}
+
+// Contact bounce on a press still makes one tap, from the press that held
+void test_bouncy_press_is_one_tap() {
+    pushTouchEdge(touch, T0, true);
+    pushTouchEdge(touch, T0 + 2 * MS, false);
+    pushTouchEdge(touch, T0 + 4 * MS, true);
+    pushTouchEdge(touch, T0 + 100 * MS, false);
+    updateTouch(touch, T0 + 1000 * MS);
+    uint32_t pressUs = 0;
+    TEST_ASSERT_EQUAL(TOUCH_TAP, nextGesture(&pressUs));
+    TEST_ASSERT_EQUAL_UINT32(T0 + 4 * MS, pressUs);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());
+}
+
+// micros() wraps every 71.6 minutes
+void test_long_press_across_micros_wrap() {
+    uint32_t at = 0xFFFFFFFFUL - 200 * MS;
+    pushTouchEdge(touch, at, true);
+    updateTouch(touch, at + 500 * MS);
+    TEST_ASSERT_EQUAL(TOUCH_NONE, nextGesture());
+    updateTouch(touch, at + TOUCH_LONG_PRESS_MS * MS);
+    TEST_ASSERT_EQUAL(TOUCH_LONG_PRESS, nextGesture());
+}
+
+void test_deadline() {
+    uint32_t waitUs;
+    TEST_ASSERT_FALSE(touchDeadline(touch, T0, waitUs));
+    pushTouchEdge(touch, T0, true);
+    updateTouch(touch, T0 + 10 * MS);
+    TEST_ASSERT_TRUE(touchDeadline(touch, T0 + 10 * MS, waitUs));
+    TEST_ASSERT_EQUAL_UINT32((TOUCH_DEBOUNCE_MS - 10) * MS, waitUs);
+    updateTouch(touch, T0 + 100 * MS);
+    TEST_ASSERT_TRUE(touchDeadline(touch, T0 + 100 * MS, waitUs));
+    TEST_ASSERT_EQUAL_UINT32(TOUCH_LONG_PRESS_MS * MS - 100 * MS, waitUs);
+}
+
+// A ring full of edges drops the newest and counts it
+void test_edge_ring_overflow() {
+    touchOverflows = 0;
+    for (uint32_t i = 0; i < TOUCH_QUEUE_SIZE + 2; i++) pushTouchEdge(touch, T0 + i * MS, !(i & 1));
+    TEST_ASSERT_EQUAL(2, touchOverflows);
+    updateTouch(touch, T0 + 100 * MS);
+    TEST_ASSERT_FALSE(hasTouchEdges(touch));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tap_after_double_tap_window);
+    RUN_TEST(test_double_tap);
+    RUN_TEST(test_long_press_while_held);
+    RUN_TEST(test_bounce_is_a_glitch);
+    RUN_TEST(test_bouncy_press_is_one_tap);
+    RUN_TEST(test_long_press_across_micros_wrap);
+    RUN_TEST(test_deadline);
+    RUN_TEST(test_edge_ring_overflow);
+    return UNITY_END();
+}
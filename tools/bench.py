@@ -0,0 +1,211 @@
+"""Benchmark and golden frame check on the host simulator: runs the native
+build through a few fixed scenarios, compares every picture the panel shows
+with the golden frames in bench/golden/ and the costs with bench/budgets.json,
+and exits 1 if a picture changed or a cost went over its budget.
+
+    pio run -e native && python tools/bench.py
+    python tools/bench.py --update     # accept the current frames and costs
+
+Each scenario runs with --frames, which lists a hash of every new panel
+image, and asks the firmware for its animation stats ('a') at the end:
+frames, bytes sent to the panel, framebuffer bytes written and time spent
+per animation. On top come the simulator's awake time, I2C traffic and
+servo travel, and the awake time one dispense costs (the dispense scenario
+minus idle). The upload scenario sends a bundle built by tools/build_assets.py
+over serial, and fails if the firmware's heap guard trips on the way.
+
+Frames are compared as a sequence of images; when they differ the scenario
+runs again with --dump-dir, leaving a PBM of each frame in --out for a look
+at what changed. --update writes the new golden frames and sets every budget
+to the measured value plus BUDGET_HEADROOM. Servo travel is the other way
+round: it is a floor, the measured value minus BUDGET_HEADROOM, since a
+dispense that stops moving the servo is the failure to catch there.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import build_assets  # noqa: E402
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BENCH_DIR = os.path.join(PROJECT_DIR, "bench")
+BUDGET_HEADROOM = 0.10
+BUNDLE = "<bundle>"  # Stands for the path of the asset bundle built for the run
+
+# name -> simulator arguments. Touches and the dose are a minute in, after
+# the idle animation has settled.
+SCENARIOS = {
+    "idle": ["--hours", "%.6f" % (120 / 3600.0)],
+    "dispense": ["--hours", "%.6f" % (120 / 3600.0), "--touch-every", "60"],
+    # The second dispense starts where the first left the horn
+    "redispense": ["--hours", "%.6f" % (120 / 3600.0), "--touch-every", "40"],
+    # 07:59 local time; the 08:00 dose falls due a minute in
+    "reminder": ["--hours", "%.6f" % (120 / 3600.0), "--serial", "T1792223940"],
+    # New content 10 s in; the firmware has to take it without the heap
+    "upload": ["--hours", "%.6f" % (120 / 3600.0), "--upload", BUNDLE],
+}
+
+ANIMATION_FIELDS = ["frames", "bytes", "byteops", "awake_us"]
+SIM_PATTERNS = {
+    "awake_ms": (re.compile(r"^awake\s+([\d.]+) s"), 1000.0),
+    "i2c_bytes": (re.compile(r"^i2c\s+\d+ transactions, (\d+) bytes"), 1),
+    "panel_bytes": (re.compile(r"^panel\s+(\d+) data bytes"), 1),
+    "servo_deg": (re.compile(r"^servo\s+\d+ writes, (\d+) degrees"), 1),
+}
+FLOOR_METRICS = {"servo_deg"}  # Budgeted from below
+
+
+def run_scenario(program, name, bundle, dump_dir=None):
+    """Metrics and frame hashes of one simulator run"""
+    with tempfile.TemporaryDirectory() as tmp:
+        frames_path = os.path.join(tmp, "frames.txt")
+        args = [bundle if arg == BUNDLE else arg for arg in SCENARIOS[name]]
+        cmd = [program] + args + ["--frames", frames_path, "--query", "a"]
+        if dump_dir:
+            os.makedirs(dump_dir, exist_ok=True)
+            cmd += ["--dump-dir", dump_dir]
+        run = subprocess.run(cmd, stdout=subprocess.PIPE, universal_newlines=True)
+        if run.returncode != 0:
+            raise RuntimeError("%s: the simulator exited with %d; run the scenario with --verbose to see why"
+                               % (name, run.returncode))
+        out = run.stdout
+        with open(frames_path) as f:
+            frames = [line.split() for line in f if line.strip()]
+
+    metrics = {}
+    in_table = False
+    for line in out.splitlines():
+        fields = line.split()
+        if fields == ["animation"] + ANIMATION_FIELDS:
+            in_table = True
+            continue
+        if in_table and len(fields) == len(ANIMATION_FIELDS) + 1 and all(f.isdigit() for f in fields[1:]):
+            for field, value in zip(ANIMATION_FIELDS, fields[1:]):
+                metrics["%s.%s" % (fields[0], field)] = int(value)
+            continue
+        in_table = False
+        for metric, (pattern, scale) in SIM_PATTERNS.items():
+            m = pattern.match(line)
+            if m:
+                metrics[metric] = int(round(float(m.group(1)) * scale))
+    if "awake_ms" not in metrics:
+        raise RuntimeError("%s: no simulator report in the output of %s" % (name, " ".join(cmd)))
+    return metrics, frames
+
+
+def golden_path(name):
+    return os.path.join(BENCH_DIR, "golden", name + ".txt")
+
+
+def read_golden(name):
+    try:
+        with open(golden_path(name)) as f:
+            return [line.split() for line in f if line.strip() and not line.startswith("#")]
+    except FileNotFoundError:
+        return None
+
+
+def write_golden(name, frames):
+    os.makedirs(os.path.dirname(golden_path(name)), exist_ok=True)
+    with open(golden_path(name), "w") as f:
+        f.write("# %s: ms hash of each new panel image, written by tools/bench.py --update\n" % name)
+        for ms, digest in frames:
+            f.write("%s %s\n" % (ms, digest))
+
+
+def compare_frames(name, frames, golden):
+    """Problems with the frames of a scenario, as text"""
+    if golden is None:
+        return ["%s: no golden frames, run with --update" % name]
+    got = [digest for _, digest in frames]
+    want = [digest for _, digest in golden]
+    for i, (a, b) in enumerate(zip(got, want)):
+        if a != b:
+            return ["%s: frame %d at %s ms differs from the golden frame at %s ms" % (name, i, frames[i][0], golden[i][0])]
+    if len(got) != len(want):
+        return ["%s: %d frames, the golden run has %d" % (name, len(got), len(want))]
+    return []
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--program", default=os.path.join(PROJECT_DIR, ".pio", "build", "native", "program"),
+                        help="simulator binary (default: the native build)")
+    parser.add_argument("--update", action="store_true", help="accept the current frames and costs")
+    parser.add_argument("--out", default="bench_frames", help="where frames of a mismatch are dumped")
+    args = parser.parse_args()
+
+    budgets_path = os.path.join(BENCH_DIR, "budgets.json")
+    try:
+        with open(budgets_path) as f:
+            budgets = json.load(f)
+    except FileNotFoundError:
+        budgets = {}
+
+    bundle_dir = tempfile.TemporaryDirectory()
+    bundle = os.path.join(bundle_dir.name, "assets.bin")
+    build_assets.generate(PROJECT_DIR, bundle)
+
+    results = {}
+    problems = []
+    for name in SCENARIOS:
+        try:
+            metrics, frames = run_scenario(args.program, name, bundle)
+        except RuntimeError as e:
+            problems.append(str(e))
+            continue
+        results[name] = metrics
+        metrics["frames_shown"] = len(frames)
+        if args.update:
+            write_golden(name, frames)
+            continue
+        mismatch = compare_frames(name, frames, read_golden(name))
+        if mismatch:
+            dump_dir = os.path.join(args.out, name)
+            run_scenario(args.program, name, bundle, dump_dir)
+            mismatch.append("%s: frames of this run are in %s" % (name, dump_dir))
+        problems += mismatch
+    if "dispense" in results and "idle" in results:
+        results["dispense"]["dispense_awake_ms"] = results["dispense"]["awake_ms"] - results["idle"]["awake_ms"]
+
+    print("%-10s %-22s %12s %12s" % ("scenario", "metric", "measured", "budget"))
+    for name, metrics in results.items():
+        for metric, value in sorted(metrics.items()):
+            budget = budgets.get(name, {}).get(metric)
+            floor = metric in FLOOR_METRICS
+            over = budget is not None and (value < budget if floor else value > budget)
+            print("%-10s %-22s %12d %12s%s" % (name, metric, value, "-" if budget is None else budget,
+                                               ("  UNDER" if floor else "  OVER") if over and not args.update else ""))
+            if over and not args.update:
+                problems.append("%s: %s is %d, the budget is %s %d" % (name, metric, value,
+                                                                        "at least" if floor else "at most", budget))
+
+    if args.update and problems:
+        for problem in problems:
+            print("FAIL " + problem)
+        print("nothing updated")
+        return 1
+    if args.update:
+        budgets = {name: {metric: int(value * (1 - BUDGET_HEADROOM)) if metric in FLOOR_METRICS
+                          else int(value * (1 + BUDGET_HEADROOM)) + 1 for metric, value in sorted(metrics.items())}
+                   for name, metrics in results.items()}
+        with open(budgets_path, "w") as f:
+            json.dump(budgets, f, indent=1, sort_keys=True)
+            f.write("\n")
+        print("golden frames and budgets updated in %s" % BENCH_DIR)
+        return 0
+
+    for problem in problems:
+        print("FAIL " + problem)
+    print("%d problems" % len(problems) if problems else "all frames match, all costs within budget")
+    return 1 if problems else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
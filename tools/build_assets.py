@@ -0,0 +1,174 @@
+"""Build the asset bundle for the "assets" flash partition (see
+include/asset_bundle.h): the sprites and clips of include/images.h, encoded
+as tools/convert_sprites.py does for sprites.h, the animation timelines of
+ANIMATIONS below, and the messages with their scrolled widths worked out.
+
+    python tools/build_assets.py [-o assets.bin] [--messages messages.txt] [--version N]
+
+Messages come from a text file, one per line, or else from the messages[]
+array of include/secrets.h (sim/include/secrets.h without it). The bundle
+goes to .pio/build/esp32-c3-devkitm-1/assets.bin unless -o says otherwise,
+where the build puts its own. Get it onto the device with
+tools/upload_assets.py, or flash it at the partition's offset:
+    esptool.py write_flash 0x2A0000 .pio/build/esp32-c3-devkitm-1/assets.bin
+
+Runs as a PlatformIO pre-build script too (see platformio.ini), writing
+$BUILD_DIR/assets.bin from the default sources.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import zlib
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import convert_sprites  # noqa: E402
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DEFAULT_OUTPUT = os.path.join(PROJECT_DIR, ".pio", "build", "esp32-c3-devkitm-1", "assets.bin")
+
+ASSET_MAGIC = 0x414C4950  # "PILA"
+ASSET_FORMAT = 1
+NO_CLIP = 0xFF
+SPRITE_RAW, SPRITE_RLE = 0, 1
+
+HEADER = struct.Struct("<IHHIII4B4I")
+SPRITE = struct.Struct("<HBBI")
+CLIP = struct.Struct("<HBBII")
+ANIMATION = struct.Struct("<IIBBHhh")
+FRAME = struct.Struct("<IHBB")
+LAYER = struct.Struct("<BBhhH")
+MESSAGE = struct.Struct("<IHH")
+
+# As in include/scroll_strip.h
+SCROLL_CHAR_WIDTH = 12
+
+# Timelines, as in include/animations.h: name -> (clip or None, clip x, clip y,
+# [(duration ms, [(sprite, x, y), ...]) per frame], loops). The firmware plays
+# "idle", "reminder" and "dance" in place of its built-in ones.
+IDLE_COUPLE = [("lady", 96, 8), ("gentleman", 114, 8)]
+ANIMATIONS = {
+    "idle": (None, 0, 0, [
+        (500, IDLE_COUPLE + [("small_heart", 104, 4)]),
+        (500, IDLE_COUPLE + [("big_heart", 102, 4)]),
+    ], 100),
+    "reminder": (None, 0, 0, [
+        (250, IDLE_COUPLE + [("big_heart", 102, 4)]),
+        (250, IDLE_COUPLE),
+    ], 100),
+    "dance": ("dancing_couple", 0, 0, [
+        (150, []),
+        (150, []),
+    ], 20),
+}
+
+STRING_RE = re.compile(r'"((?:[^"\\]|\\.)*)"')
+
+
+def read_messages(project_dir, path=None):
+    if path:
+        with open(path) as f:
+            return [line.rstrip("\r\n") for line in f if line.strip()]
+    for candidate in ("include/secrets.h", "sim/include/secrets.h"):
+        full = os.path.join(project_dir, candidate)
+        if os.path.exists(full):
+            with open(full) as f:
+                src = f.read()
+            body = src[src.index("messages[]"):]
+            body = body[body.index("{"):body.index("};")]
+            return [s.encode().decode("unicode_escape") for s in STRING_RE.findall(body)]
+    raise FileNotFoundError("no secrets.h with a messages[] array")
+
+
+class Bundle:
+    """Byte buffer that hands out 4 byte aligned offsets"""
+
+    def __init__(self):
+        self.data = bytearray(HEADER.size)
+
+    def add(self, blob):
+        self.data += b"\0" * (-len(self.data) % 4)
+        offset = len(self.data)
+        self.data += blob
+        return offset
+
+
+def build(project_dir, messages, version):
+    arrays = convert_sprites.parse_images(os.path.join(project_dir, "include", "images.h"))
+    clip_only = {frame[0] for _, _, frames in convert_sprites.CLIPS.values() for frame in frames}
+    sprite_names = [name for name in convert_sprites.SPRITES if name not in clip_only]
+    clip_names = list(convert_sprites.CLIPS)
+    out = Bundle()
+
+    # Streams first, then the tables that point at them
+    sprites = []
+    for name in sprite_names:
+        width, height = convert_sprites.SPRITES[name]
+        pages = convert_sprites.to_pages(convert_sprites.to_pixels(arrays[name], width, height), width, height)
+        rle = convert_sprites.rle_encode(pages)
+        data, fmt = (rle, SPRITE_RLE) if len(rle) < len(pages) else (pages, SPRITE_RAW)
+        sprites.append(SPRITE.pack(width, height, fmt, out.add(bytes(data))))
+
+    clips = []
+    for name in clip_names:
+        width, height, frames = convert_sprites.CLIPS[name]
+        canvases = [convert_sprites.to_pages(convert_sprites.compose(arrays, width, height, *f), width, height)
+                    for f in frames]
+        key = out.add(bytes(convert_sprites.rle_encode(canvases[0])))
+        deltas = []
+        for i, canvas in enumerate(canvases):
+            after = canvases[(i + 1) % len(canvases)]
+            deltas.append(out.add(bytes(convert_sprites.rle_encode([a ^ b for a, b in zip(canvas, after)]))))
+        table = out.add(struct.pack("<%dI" % len(deltas), *deltas))
+        clips.append(CLIP.pack(width, height, len(canvases), key, table))
+
+    animations = []
+    for name, (clip, clip_x, clip_y, frames, loops) in ANIMATIONS.items():
+        if clip is not None and len(convert_sprites.CLIPS[clip][2]) != len(frames):
+            raise ValueError("%s: one frame per clip frame" % name)
+        frame_records = []
+        for duration, layers in frames:
+            placed = b"".join(LAYER.pack(sprite_names.index(s), 0, x, y, 0) for s, x, y in layers)
+            frame_records.append(FRAME.pack(out.add(placed) if layers else 0, duration, len(layers), 0))
+        animations.append(ANIMATION.pack(out.add(name.encode() + b"\0"), out.add(b"".join(frame_records)),
+                                         len(frames), NO_CLIP if clip is None else clip_names.index(clip),
+                                         loops, clip_x, clip_y))
+
+    message_records = []
+    for text in messages:
+        raw = text.encode("latin-1")
+        width = len(raw) * SCROLL_CHAR_WIDTH
+        if width > 0xFFFF:
+            raise ValueError("message too long to scroll (%d characters): %s..." % (len(raw), text[:20]))
+        message_records.append(MESSAGE.pack(out.add(raw + b"\0"), len(raw), width))
+
+    tables = [out.add(b"".join(t)) for t in (sprites, clips, animations, message_records)]
+    if max(len(sprites), len(clips), len(animations), len(message_records)) > 255:
+        raise ValueError("at most 255 of each kind")
+    crc = zlib.crc32(bytes(out.data[HEADER.size:])) & 0xFFFFFFFF
+    out.data[:HEADER.size] = HEADER.pack(ASSET_MAGIC, ASSET_FORMAT, HEADER.size, len(out.data), crc, version,
+                                         len(sprites), len(clips), len(animations), len(message_records), *tables)
+    return bytes(out.data)
+
+
+def generate(project_dir, out_path, messages_path=None, version=1):
+    bundle = build(project_dir, read_messages(project_dir, messages_path), version)
+    os.makedirs(os.path.dirname(out_path) or ".", exist_ok=True)
+    with open(out_path, "wb") as f:
+        f.write(bundle)
+    print("build_assets.py: %d bytes, version %d -> %s" % (len(bundle), version, out_path))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    generate(env.subst("$PROJECT_DIR"), env.subst("$BUILD_DIR/assets.bin"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+        parser.add_argument("-o", "--output", default=DEFAULT_OUTPUT, help="default: next to the device build")
+        parser.add_argument("--messages", help="text file with one message per line")
+        parser.add_argument("--version", type=int, default=1, help="content version the device reports")
+        args = parser.parse_args()
+        generate(PROJECT_DIR, args.output, args.messages, args.version)
@@ -0,0 +1,224 @@
+"""Convert the row-major bitmaps in include/images.h into SSD1306 page-native
+sprites (one byte = 8 vertical pixels, LSB on top) in include/sprites.h.
+
+Sprites are stored run-length encoded when that is smaller than the raw
+bytes. Clips are multi-frame animations composed on a shared canvas: frame 0
+is stored whole and every following frame as the XOR against the one before
+it, so playback only touches the bytes that change (see sprite_blit.h).
+
+Runs as a PlatformIO pre-build script (see platformio.ini) and can also be
+run by hand:  python tools/convert_sprites.py
+"""
+
+import os
+import re
+
+# Sprites used by the animations: name in images.h -> (width, height)
+SPRITES = {
+    "lady": (9, 16),
+    "gentleman": (7, 16),
+    "small_heart": (9, 8),
+    "big_heart": (13, 11),
+    "dancing_couple_1": (39, 32),
+    "dancing_couple_2": (31, 32),
+}
+
+# Clips: name -> (canvas width, canvas height, [(sprite, x, y) per frame])
+CLIPS = {
+    "dancing_couple": (39, 32, [
+        ("dancing_couple_1", 0, 0),
+        ("dancing_couple_2", 4, 0),
+    ]),
+}
+
+ARRAY_RE = re.compile(r"PROGMEM\s+(\w+)\[\]\s*=\s*\{([^}]*)\}", re.S)
+
+RLE_MAX_LITERAL = 128  # Control 0x00-0x7F: n + 1 literal bytes follow
+RLE_MIN_REPEAT = 3     # Control 0x80-0xFF: next byte repeated (n & 0x7F) + 3 times
+RLE_MAX_REPEAT = 127 + RLE_MIN_REPEAT
+
+
+def parse_images(path):
+    with open(path) as f:
+        src = f.read()
+    arrays = {}
+    for name, body in ARRAY_RE.findall(src):
+        arrays[name] = [int(v, 16) for v in re.findall(r"0x[0-9a-fA-F]+", body)]
+    return arrays
+
+
+def to_pixels(data, width, height):
+    """Row-major, MSB-first rows padded to whole bytes (Adafruit drawBitmap layout)."""
+    stride = (width + 7) // 8
+    if len(data) != stride * height:
+        raise ValueError("expected %d bytes, got %d" % (stride * height, len(data)))
+    return [[(data[y * stride + x // 8] >> (7 - (x & 7))) & 1 for x in range(width)]
+            for y in range(height)]
+
+
+def to_pages(pixels, width, height):
+    pages = (height + 7) // 8
+    out = []
+    for page in range(pages):
+        for x in range(width):
+            b = 0
+            for bit in range(8):
+                y = page * 8 + bit
+                if y < height and pixels[y][x]:
+                    b |= 1 << bit
+            out.append(b)
+    return out
+
+
+def rle_encode(data):
+    out = []
+    literal = []
+
+    def flush_literal():
+        while literal:
+            chunk = literal[:RLE_MAX_LITERAL]
+            del literal[:RLE_MAX_LITERAL]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+
+    i = 0
+    while i < len(data):
+        run = 1
+        while i + run < len(data) and data[i + run] == data[i] and run < RLE_MAX_REPEAT:
+            run += 1
+        if run >= RLE_MIN_REPEAT:
+            flush_literal()
+            out.extend([0x80 | (run - RLE_MIN_REPEAT), data[i]])
+            i += run
+        else:
+            literal.append(data[i])
+            i += 1
+    flush_literal()
+    return out
+
+
+def rle_decode(data, size):
+    out = []
+    i = 0
+    while len(out) < size:
+        control = data[i]
+        if control < 0x80:
+            out.extend(data[i + 1:i + 2 + control])
+            i += 2 + control
+        else:
+            out.extend([data[i + 1]] * ((control & 0x7F) + RLE_MIN_REPEAT))
+            i += 2
+    assert len(out) == size
+    return out
+
+
+def compose(arrays, canvas_w, canvas_h, name, x, y):
+    """Place a sprite on an empty clip canvas and return the canvas pixels."""
+    width, height = SPRITES[name]
+    sprite = to_pixels(arrays[name], width, height)
+    canvas = [[0] * canvas_w for _ in range(canvas_h)]
+    for sy in range(height):
+        for sx in range(width):
+            if sprite[sy][sx]:
+                canvas[y + sy][x + sx] = 1
+    return canvas
+
+
+def format_bytes(data, indent="    ", per_line=16):
+    lines = []
+    for i in range(0, len(data), per_line):
+        lines.append(indent + ",".join("0x%02x" % b for b in data[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def generate(project_dir):
+    images = os.path.join(project_dir, "include", "images.h")
+    output = os.path.join(project_dir, "include", "sprites.h")
+    arrays = parse_images(images)
+
+    # Sprites that only appear inside clips are not emitted on their own
+    clip_only = {frame[0] for _, _, frames in CLIPS.values() for frame in frames}
+
+    body = []
+    raw_total = 0
+    stored_total = 0
+    for name, (width, height) in SPRITES.items():
+        if name in clip_only:
+            continue
+        pages = to_pages(to_pixels(arrays[name], width, height), width, height)
+        rle = rle_encode(pages)
+        assert rle_decode(rle, len(pages)) == pages
+        if len(rle) < len(pages):
+            data, fmt = rle, "SPRITE_RLE"
+        else:
+            data, fmt = pages, "SPRITE_RAW"
+        raw_total += len(pages)
+        stored_total += len(data)
+        body.append("static const uint8_t PROGMEM sprite_%s_data[] = {  // %d bytes raw" % (name, len(pages)))
+        body.append(format_bytes(data))
+        body.append("};")
+        body.append("static const PageSprite sprite_%s = {%d, %d, sprite_%s_data, %s};"
+                    % (name, width, height, name, fmt))
+        body.append("")
+
+    for clip, (width, height, frames) in CLIPS.items():
+        canvases = [to_pages(compose(arrays, width, height, *frame), width, height) for frame in frames]
+        key = rle_encode(canvases[0])
+        assert rle_decode(key, len(canvases[0])) == canvases[0]
+        raw_total += len(canvases[0]) * len(canvases)
+        stored_total += len(key)
+        body.append("static const uint8_t PROGMEM clip_%s_key[] = {" % clip)
+        body.append(format_bytes(key))
+        body.append("};")
+
+        # Delta i turns frame i into frame i + 1, the last one wraps to frame 0.
+        # Identical deltas (always the case for two frames) are stored once.
+        delta_names = []
+        stored = {}
+        for i in range(len(canvases)):
+            after = canvases[(i + 1) % len(canvases)]
+            xor = [a ^ b for a, b in zip(canvases[i], after)]
+            delta = rle_encode(xor)
+            assert rle_decode(delta, len(xor)) == xor
+            if tuple(delta) not in stored:
+                stored[tuple(delta)] = "clip_%s_delta_%d" % (clip, i)
+                stored_total += len(delta)
+                body.append("static const uint8_t PROGMEM %s[] = {" % stored[tuple(delta)])
+                body.append(format_bytes(delta))
+                body.append("};")
+            delta_names.append(stored[tuple(delta)])
+        body.append("static const uint8_t* const clip_%s_deltas[] = {" % clip)
+        body.append("    " + ", ".join(delta_names) + ",")
+        body.append("};")
+        body.append("static constexpr SpriteClip clip_%s = {%d, %d, %d, clip_%s_key, clip_%s_deltas};"
+                    % (clip, width, height, len(canvases), clip, clip))
+        body.append("")
+
+    out = [
+        "// Generated by tools/convert_sprites.py from images.h - do not edit.",
+        "// Page-native layout: data[page * width + x], bit n is row page * 8 + n.",
+        "// %d bytes stored for %d bytes of raw sprite data." % (stored_total, raw_total),
+        "#ifndef SPRITES_H",
+        "#define SPRITES_H",
+        "",
+        '#include "sprite_blit.h"',
+        "",
+    ] + body + ["#endif // SPRITES_H"]
+    text = "\n".join(out) + "\n"
+
+    # Only touch the header when it changes so it does not force rebuilds
+    if os.path.exists(output):
+        with open(output) as f:
+            if f.read() == text:
+                return
+    with open(output, "w") as f:
+        f.write(text)
+    print("convert_sprites: wrote %s" % output)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,148 @@
+"""Decode the firmware's deferred log (see include/deferred_log.h) in a serial
+capture, a live serial port or a simulator run, and pass everything else -
+the replies to serial queries - through as it is.
+
+    python tools/decode_log.py capture.bin
+    python tools/decode_log.py --port /dev/ttyACM0          # needs pyserial
+    .pio/build/native/program --verbose | python tools/decode_log.py -
+
+Records are 0x1E, the COBS encoded record, 0x00. A record is the message id,
+the time in milliseconds and the arguments, all unsigned LEB128 varints
+except the one byte id. Each comes out as "seconds.millis text", the same
+as a LOG_TEXT=1 build prints.
+
+The message table is read from --formats (the log_formats.json the build
+writes) or else straight from include/log_formats.h; a capture from an older
+build decodes as long as the table was only appended to since.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import log_formats  # noqa: E402
+
+FRAME_START = 0x1E
+FRAME_END = 0x00
+CONVERSION_RE = re.compile(r"%(l*)(.)")
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError("bad COBS block")
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def varints(data, pos):
+    while pos < len(data):
+        value = shift = 0
+        while pos < len(data):
+            b = data[pos]
+            pos += 1
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        yield value
+
+
+def format_record(record, formats):
+    if not record:
+        return "empty log record"
+    values = list(varints(record, 1))
+    ms = values.pop(0) if values else 0
+    entry = formats.get(record[0])
+    if entry is None:
+        text = "unknown log record %d %s" % (record[0], values)
+    else:
+        args = iter(values)
+
+        def conversion(m):
+            if m.group(2) == "%":
+                return "%"
+            value = next(args, 0)
+            if m.group(2) == "d":
+                return str(value - (1 << 32) if value >= 1 << 31 else value)
+            if m.group(2) == "x":
+                return "%x" % value
+            return str(value)
+
+        text = CONVERSION_RE.sub(conversion, entry["format"])
+    return "%6d.%03d %s" % (ms // 1000, ms % 1000, text)
+
+
+def decode(chunks, formats, out):
+    """Write the text of a byte stream given in chunks, records decoded"""
+    frame = None
+    for chunk in chunks:
+        text = bytearray()
+        for b in chunk:
+            if frame is None:
+                if b == FRAME_START:
+                    frame = bytearray()
+                else:
+                    text.append(b)
+            elif b == FRAME_END:
+                out.write(text.decode(errors="replace"))
+                text = bytearray()
+                try:
+                    out.write(format_record(cobs_decode(bytes(frame)), formats) + "\n")
+                except ValueError:
+                    out.write("corrupt log record %s\n" % frame.hex())
+                frame = None
+            elif b == FRAME_START:
+                frame = bytearray()  # Lost the end of the previous one
+            else:
+                frame.append(b)
+        out.write(text.decode(errors="replace"))
+        out.flush()
+
+
+def load_formats(path):
+    if path:
+        with open(path) as f:
+            table = json.load(f)["formats"]
+    else:
+        project_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+        table = log_formats.parse(os.path.join(project_dir, "include", "log_formats.h"))
+    return {entry["id"]: entry for entry in table}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("capture", nargs="?", default="-", help="capture file, - for stdin (default)")
+    parser.add_argument("--port", help="read a serial port instead, e.g. /dev/ttyACM0")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--formats", help="log_formats.json from the build of the firmware that logged")
+    args = parser.parse_args()
+
+    formats = load_formats(args.formats)
+    if args.port:
+        import serial  # pyserial
+        port = serial.Serial(args.port, args.baud, timeout=0.1)
+        chunks = iter(lambda: port.read(256), None)
+    elif args.capture == "-":
+        stdin = sys.stdin.buffer
+        chunks = iter(lambda: stdin.read1(4096) if hasattr(stdin, "read1") else stdin.read(4096), b"")
+    else:
+        with open(args.capture, "rb") as f:
+            chunks = [f.read()]
+    try:
+        decode(chunks, formats, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,68 @@
+"""Extract the deferred log message table from include/log_formats.h and
+write it as JSON (id -> name, format, argument count), which
+tools/decode_log.py uses to turn binary log records back into text.
+
+The formats are checked on the way: only %u, %d, %x (optionally with an l
+length modifier) and %% are allowed, and at most LOG_MAX_ARGS arguments.
+
+Runs as a PlatformIO pre-build script (see platformio.ini), writing
+$BUILD_DIR/log_formats.json next to the firmware it belongs to, and can also
+be run by hand:  python tools/log_formats.py [output.json]
+which writes to the device build's directory unless told otherwise.
+"""
+
+import json
+import os
+import re
+import sys
+
+LOG_MAX_ARGS = 4  # As in include/deferred_log.h
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DEFAULT_OUTPUT = os.path.join(PROJECT_DIR, ".pio", "build", "esp32-c3-devkitm-1", "log_formats.json")
+
+ENTRY_RE = re.compile(r'X\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+CONVERSION_RE = re.compile(r"%(l*)(.)")
+
+
+def arg_count(fmt):
+    count = 0
+    for _, conv in CONVERSION_RE.findall(fmt):
+        if conv == "%":
+            continue
+        if conv not in "udx":
+            raise ValueError("unsupported conversion %%%s in %r" % (conv, fmt))
+        count += 1
+    return count
+
+
+def parse(path):
+    """The formats of log_formats.h in id order, as dicts"""
+    with open(path) as f:
+        src = f.read()
+    start = src.index("#define LOG_FORMATS(X)")
+    formats = []
+    for name, fmt in ENTRY_RE.findall(src[start:]):
+        fmt = fmt.encode().decode("unicode_escape")
+        count = arg_count(fmt)
+        if count > LOG_MAX_ARGS:
+            raise ValueError("%s takes %d arguments, at most %d fit a record" % (name, count, LOG_MAX_ARGS))
+        formats.append({"id": len(formats), "name": name, "format": fmt, "args": count})
+    if len(formats) > 256:
+        raise ValueError("%d log formats, ids are one byte" % len(formats))
+    return formats
+
+
+def generate(project_dir, out_path):
+    formats = parse(os.path.join(project_dir, "include", "log_formats.h"))
+    os.makedirs(os.path.dirname(out_path) or ".", exist_ok=True)
+    with open(out_path, "w") as f:
+        json.dump({"formats": formats}, f, indent=1)
+    print("log_formats.py: %d formats -> %s" % (len(formats), out_path))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    generate(env.subst("$PROJECT_DIR"), env.subst("$BUILD_DIR/log_formats.json"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(PROJECT_DIR, sys.argv[1] if len(sys.argv) > 1 else DEFAULT_OUTPUT)
@@ -0,0 +1,173 @@
+"""Convert trace dumps from the firmware ('x' over serial, see include/trace.h)
+into Chrome trace event JSON, which https://ui.perfetto.dev and
+chrome://tracing open directly, and print frame jitter and wake latency
+histograms.
+
+The input is a serial capture; lines that are not part of a dump are
+ignored. Every dump in it becomes its own process in the timeline.
+
+    python tools/trace_to_perfetto.py capture.txt -o trace.json
+
+Timestamps are esp_timer microseconds; between events the time is their
+difference modulo 2^32. Dumps from firmware that still stamped CPU cycles
+("# trace cpu_mhz N") are divided by that clock instead, and across a light
+sleep they take the slept time the sleep's end event carries, since the
+cycle counter may stop there.
+"""
+
+import argparse
+import json
+import sys
+
+FRAME_BUCKETS_US = [0, 500, 1000, 2000, 5000, 10000, 20000, 50000]
+WAKE_BUCKETS_US = [0, 100, 500, 1000, 2000, 5000, 10000, 50000]
+
+
+class Dump:
+    def __init__(self, ticks_per_us, cycles):
+        self.ticks_per_us = ticks_per_us
+        self.cycles = cycles  # Old CPU cycle timestamps, which stop in light sleep
+        self.points = {}  # id -> (track, name)
+        self.tasks = {}   # scheduler task id -> name
+        self.events = []  # (timestamp, id, phase, value)
+
+
+def parse(lines):
+    """Split a capture into dumps; task names apply to the dump that follows them"""
+    dumps = []
+    tasks = {}
+    current = None
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[:2] == ["#", "task"] and len(fields) >= 3:
+            tasks[int(fields[2])] = " ".join(fields[3:]) or "task %s" % fields[2]
+        elif fields[:2] == ["#", "trace"]:
+            info = dict(zip(fields[2::2], fields[3::2]))
+            if info.get("clock") == "us":
+                current = Dump(1, False)
+            else:
+                current = Dump(int(info.get("cpu_mhz", 160)), True)
+            current.tasks = dict(tasks)
+            dumps.append(current)
+        elif current is None:
+            continue
+        elif fields[:2] == ["#", "point"] and len(fields) >= 5:
+            current.points[int(fields[2])] = (fields[3], " ".join(fields[4:]))
+        elif fields[:2] == ["#", "end"]:
+            current = None
+        elif fields[0] == "T" and len(fields) == 5:
+            current.events.append((int(fields[1]), int(fields[2]), fields[3], int(fields[4])))
+    return dumps
+
+
+def signed32(value):
+    return value - (1 << 32) if value >= 1 << 31 else value
+
+
+def convert(dump, pid, out, stats):
+    """Append the dump's events to `out` and collect jitter samples in `stats`"""
+    tids = {}
+    depth = {}
+    open_sleep_us = None
+    planned_us = 0
+    now_us = 0.0
+    prev_ts = None
+
+    def tid_of(track):
+        if track not in tids:
+            tids[track] = len(tids) + 1
+            out.append({"ph": "M", "name": "thread_name", "pid": pid, "tid": tids[track], "args": {"name": track}})
+        return tids[track]
+
+    out.append({"ph": "M", "name": "process_name", "pid": pid, "args": {"name": "dump %d" % pid}})
+    for ts, point, phase, value in dump.events:
+        track, name = dump.points.get(point, ("loop", "point %d" % point))
+        if prev_ts is not None:
+            now_us += ((ts - prev_ts) & 0xFFFFFFFF) / dump.ticks_per_us
+        prev_ts = ts
+
+        if name == "sleep" and phase == "E" and open_sleep_us is not None:
+            if dump.cycles:
+                now_us = open_sleep_us + value
+            if planned_us:
+                stats["wake"].append(value - planned_us)
+        if name == "sleep" and phase == "B":
+            open_sleep_us = now_us
+            planned_us = value
+        if name == "task":
+            name = dump.tasks.get(value, "task %d" % value)
+
+        tid = tid_of(track)
+        event = {"ph": phase, "pid": pid, "tid": tid, "ts": round(now_us, 3), "name": name}
+        if phase == "B":
+            depth[tid] = depth.get(tid, 0) + 1
+            event["args"] = {"value": value}
+        elif phase == "E":
+            if depth.get(tid, 0) == 0:
+                continue  # Its begin fell out of the ring
+            depth[tid] -= 1
+            event["args"] = {"value": value}
+        else:
+            event["s"] = "t"
+            event["args"] = {"value": signed32(value)}
+        out.append(event)
+
+        if name == "frame":
+            late = signed32(value)
+            stats["frame"].append(late)
+            out.append({"ph": "C", "pid": pid, "tid": tid, "ts": round(now_us, 3), "name": "frame late us",
+                        "args": {"us": late}})
+
+
+def histogram(title, samples, buckets):
+    print("%s: %d samples" % (title, len(samples)))
+    if not samples:
+        return
+    samples = sorted(samples)
+    print("  min %d  median %d  p99 %d  max %d us" % (
+        samples[0], samples[len(samples) // 2], samples[min(len(samples) - 1, len(samples) * 99 // 100)], samples[-1]))
+    counts = [0] * (len(buckets) + 1)
+    for s in samples:
+        i = 0
+        while i < len(buckets) and s >= buckets[i]:
+            i += 1
+        counts[i] += 1
+    widest = max(counts)
+    for i, count in enumerate(counts):
+        if i == 0:
+            label = "< %d" % buckets[0]
+        elif i == len(buckets):
+            label = ">= %d" % buckets[-1]
+        else:
+            label = "%d-%d" % (buckets[i - 1], buckets[i])
+        bar = "#" * (count * 40 // widest) if widest else ""
+        print("  %14s us %6d %s" % (label, count, bar))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("capture", help="serial capture with one or more trace dumps, - for stdin")
+    parser.add_argument("-o", "--output", default="trace.json", help="Chrome trace JSON to write")
+    args = parser.parse_args()
+
+    source = sys.stdin if args.capture == "-" else open(args.capture, errors="replace")
+    with source:
+        dumps = parse(source)
+    if not dumps:
+        sys.exit("no trace dump found in %s" % args.capture)
+
+    events = []
+    stats = {"frame": [], "wake": []}
+    for pid, dump in enumerate(dumps, 1):
+        convert(dump, pid, events, stats)
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+    print("%d dumps, %d events -> %s" % (len(dumps), sum(len(d.events) for d in dumps), args.output))
+    histogram("frame lateness", stats["frame"], FRAME_BUCKETS_US)
+    histogram("wake overshoot (slept - planned)", stats["wake"], WAKE_BUCKETS_US)
+
+
+if __name__ == "__main__":
+    main()
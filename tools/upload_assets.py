@@ -0,0 +1,108 @@
+"""Upload an asset bundle (tools/build_assets.py) to the device over serial,
+straight into its "assets" partition, with the protocol of
+include/asset_upload.h. The device shows the new content as soon as the
+bundle is in and checked; no reflash, no reboot.
+
+    python tools/build_assets.py --messages messages.txt
+    python tools/upload_assets.py --port /dev/ttyACM0      # needs pyserial
+
+The bundle is the one build_assets.py writes by default, next to the device
+build, unless another file is named.
+
+Each chunk carries its own CRC-32 and is sent again when the device reports
+an error, up to --retries times. Log records the firmware sends meanwhile
+are skipped.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import time
+import zlib
+
+DEFAULT_BUNDLE = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+                              ".pio", "build", "esp32-c3-devkitm-1", "assets.bin")
+LOG_FRAME_RE = re.compile(rb"\x1e[^\x00]*\x00")
+REPLY_RE = re.compile(r"^asset (.+?) (\d+)$")
+
+
+class Device:
+    def __init__(self, port, timeout):
+        self.port = port
+        self.timeout = timeout
+        self.pending = b""
+
+    def reply(self):
+        """Next "asset <what> <value>" line as (what, value)"""
+        deadline = time.time() + self.timeout
+        while time.time() < deadline:
+            self.pending += self.port.read(self.port.in_waiting or 1)
+            self.pending = LOG_FRAME_RE.sub(b"", self.pending)
+            while b"\n" in self.pending:
+                line, self.pending = self.pending.split(b"\n", 1)
+                m = REPLY_RE.match(line.decode(errors="replace").strip())
+                if m:
+                    return m.group(1), int(m.group(2))
+        raise TimeoutError("no reply from the device")
+
+
+def upload(port, bundle, retries=3, timeout=5.0, out=sys.stdout):
+    dev = Device(port, timeout)
+    port.reset_input_buffer()
+    port.write(b"U")
+    what, chunk_max = dev.reply()
+    if what != "ready":
+        raise RuntimeError("device refused the upload: %s" % what)
+
+    port.write(b"S" + struct.pack("<II", len(bundle), zlib.crc32(bundle) & 0xFFFFFFFF))
+    what, written = dev.reply()
+    if what != "ack":
+        raise RuntimeError("device rejected the bundle: %s" % what)
+
+    started = time.time()
+    failures = 0
+    while written < len(bundle):
+        chunk = bundle[written:written + chunk_max]
+        port.write(b"C" + struct.pack("<H", len(chunk)) + chunk + struct.pack("<I", zlib.crc32(chunk) & 0xFFFFFFFF))
+        what, acked = dev.reply()
+        if what == "ack" and acked == written + len(chunk):
+            written = acked
+            failures = 0
+            out.write("\r%d / %d bytes" % (written, len(bundle)))
+            out.flush()
+            continue
+        failures += 1  # Send the same chunk again
+        if failures > retries or what == "error flash":
+            port.write(b"A")
+            raise RuntimeError("upload failed at %d bytes: %s" % (written, what))
+
+    port.write(b"F")
+    what, version = dev.reply()
+    if what != "done":
+        raise RuntimeError("device could not load the bundle: %s" % what)
+    out.write("\nversion %d loaded, %.1f s\n" % (version, time.time() - started))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("bundle", nargs="?", default=DEFAULT_BUNDLE,
+                        help="assets.bin from tools/build_assets.py (default: its default output)")
+    parser.add_argument("--port", required=True, help="serial port, e.g. /dev/ttyACM0")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--retries", type=int, default=3, help="attempts per chunk after the first")
+    args = parser.parse_args()
+
+    with open(args.bundle, "rb") as f:
+        bundle = f.read()
+    import serial  # pyserial
+    with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+        try:
+            upload(port, bundle, args.retries)
+        except (RuntimeError, TimeoutError) as e:
+            sys.exit("upload_assets: %s" % e)
+
+
+if __name__ == "__main__":
+    main()